@@ -6,6 +6,9 @@ mkdir build
 xcopy /y /q /E data build
 
 pushd build
+rem bake assets.pack next to the exe, the game falls back to the source images without it
+cl -Zi /std:c++20 -FC -I..\sauce\ ../sauce/th_packer.cpp -Fe:th_packer.exe user32.lib telescope_core.lib
+th_packer.exe
 rem -DTH_SPEED=1 (removes asserts) TH_RELEASE
 cl -Zi /std:c++20 -FC -I..\sauce\ ../sauce/anvil.cpp -Fe:anvil.exe user32.lib telescope_core.lib
 popd
\ No newline at end of file
@@ -1,10 +1,19 @@
+#ifdef TH_HEADLESS
+// no window, no GPU. sokol_app is only included for its keycodes
+#define SOKOL_DUMMY_BACKEND
+#define SOKOL_GFX_IMPL
+#define SOKOL_GP_IMPL
+#define SOKOL_TIME_IMPL
+#else
 #ifdef _WIN32
 #define SOKOL_D3D11
 #elif __linux__
 #define SOKOL_GLCORE33
 #endif
 #define SOKOL_IMPL
+#endif
 
+#define MINICORO_IMPL // minicoro comes in through th_coro.h
 #include "thomas.h"
 #define SOKOL_LOG(msg) PRINT_STRING(msg)
 
@@ -13,7 +22,11 @@
 #include "third_party/sokol_gfx.h"
 #include "third_party/sokol_gp.h"
 #include "third_party/sokol_app.h"
+#ifdef TH_HEADLESS
+#include "third_party/sokol_time.h"
+#else
 #include "third_party/sokol_glue.h"
+#endif
 #define function static
 
 #define HANDMADE_MATH_IMPLEMENTATION
@@ -22,303 +35,238 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "third_party/stb_image.h"
 
+#ifndef TH_SHIP
+// only dev builds parse the definition files, shipping loads them baked into the pack
+#include "th_metadesk.h"
+#endif
+
+#define CUTE_C2_IMPLEMENTATION
+#include "third_party/cute_c2.h"
+
+#include "th_render.h"
+
 #include "anvil.h"
 
 /*
 
-- [ ] write a mini portable memory arena using malloc
+- [x] write a mini portable memory arena using malloc (reserve + commit instead, see th_memory.h)
 
 */
 
-static void frame(void) {
+// RENDER
+
+static void render(void) {
+	TH_PROFILE_ZONE("render");
 	GameState* gs = game_state();
 	WorldState* world = world_state();
-	if (gs->key_pressed[SAPP_KEYCODE_B]) {
-		MemoryZeroStruct(world);
-		th_world_init(world);
-	}
-
-	ForEach(entity, world->entities, Entity*) {
-		MemoryZeroStruct(&entity->frame);
-	}
-
-	Entity*& player = world->player;
-	const Vec2 window_size = { (F32)sapp_width(), (F32)sapp_height() };
-	gs->window_size = window_size;
-	F32 ratio = window_size.x / (F32)window_size.y;
-	F32 delta_t = sapp_frame_duration();
-	const Vec2 world_mouse = mouse_pos_in_worldspace();
-
-	// PLAYER INPUT
-	if (world->player) {
-		if (gs->key_pressed[SAPP_KEYCODE_SPACE]) {
-			player->vel.y = 300.0f;
-		}
-		Vec2 axis_input = { 0 };
-		if (gs->key_down[SAPP_KEYCODE_A]) {
-			axis_input.x -= 1.0f;
-			world->player->x_dir = -1;
-		}
-		if (gs->key_down[SAPP_KEYCODE_D]) {
-			axis_input.x += 1.0f;
-			world->player->x_dir = 1;
-		}
-		player->acc = axis_input * MOVE_SPEED;
-	}
-
-	// Particle Emit
-	for (int i = 0; i < gs->emitter_count; i++) {
-		Emitter* emitter = &gs->emitters[i];
-		
-		F32 freq_remainder = emitter->frequency - floorf(emitter->frequency);
-		B8 remainder = 0;
-		if (((F32)rand() / (F32)RAND_MAX) < freq_remainder)
-			remainder = 1;
-
-		U32 emit_amount = floorf(emitter->frequency) + remainder;
-		for (int j = 0; j < emit_amount; j++) {
-			gs->particle_count++;
-			if (gs->particle_count == ArrayCount(gs->particles))
-				gs->particle_count = 0;
-			Particle* new_particle = &gs->particles[gs->particle_count];
-			if (!float_is_zero(new_particle->life))
-				LOG("warning: particles are being overridden");
-			emitter->emit_func(new_particle, emitter);
-		}
-	}
-
-	// Entity Physics
-	ForEach(entity, world->entities, Entity*) {
-		if (!entity->rigid_body)
-			continue;
-
-		// acc counter force with existing velocity
-		entity->acc.x += -entity->x_friction_mult * entity->vel.x;
-
-		// gravity
-		B8 falling = entity->vel.y < 0.f;
-		entity->acc.y -= (falling ? 2.f : 1.f) * GRAVITY;
-
-		// integrate acceleration and velocity into position
-		Vec2 next_pos = 0.5f * entity->acc * SQUARE(delta_t) + entity->vel * delta_t + entity->pos;
-
-		// integrate acceleration into velocity
-		entity->vel += entity->acc * delta_t;
-		entity->acc.x = 0;
-		entity->acc.y = 0;
-
-		if (next_pos.y < 0.0f) {
-			next_pos.y = 0.0f;
-			entity->vel.y = 0.0f;
-		}
-
-		entity->pos = next_pos;
-	}
+	const Vec2 window_size = gs->window_size;
+	Entity* player = world->player;
+	const F32 alpha = gs->sim_alpha;
+	const Vec2 cam_pos = gs->cam.prev_pos + (gs->cam.pos - gs->cam.prev_pos) * alpha;
+	const CameraView view = th_camera_view(cam_pos, gs->cam.scale, window_size);
 
 	// BEGIN RENDER
+	sg_pass_action pass_action = { 0 };
+	sg_begin_default_pass(&pass_action, window_size.x, window_size.y);
 	sgp_begin(window_size.x, window_size.y);
 	sgp_viewport(0, 0, window_size.x, window_size.y);
 
-	#if 1
-	sgp_project(window_size.x * -0.5f, window_size.x * 0.5f, window_size.y * 0.5f, window_size.y * -0.5f);
-	sgp_scale(gs->cam.scale, gs->cam.scale);
-	sgp_translate(-gs->cam.pos.x, -gs->cam.pos.y);
-	#else
-	Rng2F32 view_rect = { 0 };
-	view_rect.max = Vec2(window_size.x, window_size.y);
-	view_rect = range2_center_middle(view_rect);
-	view_rect = Shift2F32(view_rect, Vec2(0, 100.f));
-	view_rect = range2_scale(view_rect, gs->cam.scale);
-	view_rect = Shift2F32(view_rect, gs->cam.pos);
-	sgp_project(view_rect.min.x, view_rect.max.x, view_rect.max.y, view_rect.min.y);
-	#endif
+	// sokol_gp draws in world space through the same view the batches get view.world_to_clip from
+	sgp_project(view.bounds.min.x, view.bounds.max.x, view.bounds.max.y, view.bounds.min.y);
 
 	// @sgp_helpers - vector expander, so I can use my types
 	sgp_set_blend_mode(SGP_BLENDMODE_BLEND);
 	sgp_set_color(0.1f, 0.1f, 0.1f, 1.0f);
 	sgp_clear();
 
-	if (world->player) {
-		// camera update
-		gs->cam.pos.x = player->pos.x;
-		gs->cam.pos.y = 20.0f;
-
-		// player interact
-		Rng2F32 interact_rect = { 0 };
-		interact_rect.max = Vec2(20, 20);
-		if (player->x_dir == -1)
-			interact_rect = Flip2F32(interact_rect);
-		//interact_rect = range2_center_left(interact_rect);
-		interact_rect = Shift2F32(interact_rect, player->pos);
-		sgp_set_color(1.0f, 1.0f, 1.0f, 1.0f);
-		sgp_draw_debug_rect_lines(interact_rect);
-
-		// does interact_rect overlap with any interactable entities?
-		Entity* selected_entity = 0;
-		ForEach(entity, world->entities, Entity*) {
-			if (!entity->interactable || entity->id == world->held_entity_id)
-				continue;
-
-			if (Overlap2F32(EntityBoundsInWorld(entity), interact_rect)) {
-				selected_entity = entity;
-			}
-		}
-
-		if (selected_entity && !EntityFromID(world->held_entity_id)) {
-			selected_entity->frame.render_highlight = 1; // can pick up feedback
-
-			if (gs->key_pressed[SAPP_KEYCODE_E]) { // PICKUP
-				world->held_entity_id = selected_entity->id;
-				gs->key_pressed[SAPP_KEYCODE_E] = 0;
-			}
-		}
-
-		Entity* held_entity = EntityFromID(world->held_entity_id);
-		if (held_entity) {
-			if (held_entity->seed) { // SEED PLACEMENT
-				held_entity->pos.x = roundf(world_mouse.x);
-				held_entity->pos.y = 0.0f;
-
-				sgp_set_color(1.0f, 1.0f, 1.0f, 1.0f);
-				sgp_draw_line(held_entity->pos.x, world_mouse.y, held_entity->pos.x, 0.0f);
-
-				if (gs->mouse_pressed[SAPP_MOUSEBUTTON_LEFT]) {
-					Entity* plant = th_entity_create_plant();
-					plant->pos = held_entity->pos;
-					EntityDestroy(held_entity);
-				}
-			} else {
-				held_entity->vel = player->vel;
-				held_entity->pos = player->pos;
-				held_entity->pos.x += 7.0f * player->x_dir;
-				held_entity->pos.y += 10.0f;
-				if (gs->key_pressed[SAPP_KEYCODE_E]) { // THROW
-					world->held_entity_id = 0;
-					held_entity->vel.x += player->x_dir * 100.0f;
-					held_entity->rigid_body = 1;
-				}
-			}
-		}
+	// Terrain Render
+	{
+		TH_PROFILE_ZONE("tilemap draw");
+		th_terrain_update(world);
+		sgp_flush(); // the clear goes first
+		th_tilemap_draw(&gs->tilemap, view, &gs->frame_arena);
 	}
 
-	// PLANT UPDATE
-	ForEach(plant, world->entities, Entity*) {
-		if (!plant->plant)
-			continue;
-
-		const S8 final_stage = 6;
-
-		S8 previous_stage = floorf(plant->plant_stage);
-		plant->plant_stage += delta_t * 4.f;
-		if (plant->plant_stage > (F32)final_stage + 0.999f) {
-			plant->plant_stage = (F32)final_stage + 0.999f; // lol
-		}
+	if (player) {
+		sgp_set_color(1.0f, 1.0f, 1.0f, 1.0f);
+		sgp_draw_debug_rect_lines(th_player_interact_rect(player));
 
-		S8 stage = floorf(plant->plant_stage);
-		stage = ClampTop(stage, final_stage);
-		Sprite* plant_sprite = th_texture_sprite_get("plant0");
-		plant_sprite += stage;
-		plant->sprite = plant_sprite;
-		
-		if (stage != previous_stage && stage == final_stage) {
-			// @tooling - some kind of handle information from the sprite? maybe like a red pixel, or create another layer on information on top? Ideally I'd like to have another application running in the background where I can author this data.
-			Entity* res_a = EntityCreateResource();
-			res_a->pos = plant->pos;
-			res_a->pos.y += 13;
-			res_a->pos.x += -4;
-			res_a->rigid_body = 0;
-			Entity* res_b = EntityCreateResource();
-			res_b->pos = plant->pos;
-			res_b->pos.y += 36;
-			res_b->pos.x += 6;
-			res_b->rigid_body = 0;
+		Entity* held_entity = EntityFromID(world->held_entity_id);
+		if (held_entity && held_entity->seed) {
+			sgp_draw_line(EntityPos(held_entity).x, mouse_pos_in_worldspace().y, EntityPos(held_entity).x, 0.0f);
 		}
 	}
 
 	// Particle Render
-	for (int i = 0; i < ArrayCount(gs->particles); i++) {
-		Particle* particle = &gs->particles[i];
-		if (float_is_zero(particle->life))
-			continue;
-
-		Assert(particle->life > 0.f);
-		particle->life -= delta_t;
-		if (particle->life <= 0.f) {
-			MemoryZeroStruct(particle);
-			continue;
-		}
-
-		particle->pos += particle->vel * delta_t;
-
-		F32 alpha = float_alpha(particle->life, particle->start_life, 0.f);
-		alpha = float_alpha_sin_mid(alpha);
-
-		DeferLoop(sgp_push_transform(), sgp_pop_transform()) {
-			Vec2 render_size = Vec2(1, 1) * particle->size_mult;
-			sgp_set_color(particle->col.r, particle->col.g, particle->col.b, particle->col.a * alpha);
-			sgp_translate(particle->pos.x, particle->pos.y);
-			sgp_draw_filled_rect(render_size.x * -0.5f, render_size.y * -0.5f, render_size.x, render_size.y);
-		}
+	{
+		TH_PROFILE_ZONE("particle draw");
+		sgp_flush(); // draw what's queued so far, particles layer on top of it
+		th_particle_batch_draw(&gs->particle_batch, &gs->particles, view, (alpha - 1.f) * SIM_DT);
 	}
 
-	sgp_set_color(1.0f, 1.0f, 1.0f, 1.0f);
-	sgp_draw_line(-200.f, 0.0f, 200.0f, 0.0f); // ground line
-
 	// Entity Render
-	ForEach(entity, world->entities, Entity*) {
-		if (!entity->render)
-			continue;
-
-		Rng2F32 rect = Shift2F32(entity->render_rect, entity->pos);
-		sgp_set_color(V4_EXPAND(entity->col));
-		if (entity->frame.render_highlight)
-			sgp_set_color(0.5f, 0.5f, 0.5f, 0.5f);
-		if (entity->sprite) {
-			Assert(entity->sprite->atlas); // invalid atlas
-			sgp_rect target_rect = range2_to_sgp_rect(rect);
-			sgp_rect src_rect = range2_to_sgp_rect(Pad2F32(entity->sprite->sub_rect, -0.1f)); // todo - fix this texture bleeding issue without padding it in
-			if (entity->x_dir == -1) {
-				target_rect.x += target_rect.w;
-				target_rect.w *= -1;
-			}
-			sgp_set_image(0, entity->sprite->atlas->image);
-			sgp_draw_textured_rect_ex(0, target_rect, src_rect);
-			sgp_unset_image(0);
-			sgp_reset_image(0);
-		} else {
-			sgp_rect icky_rect = range2_to_sgp_rect(rect);
-			sgp_draw_filled_rect(icky_rect.x, icky_rect.y, icky_rect.w, icky_rect.h);
+	{
+		TH_PROFILE_ZONE("entity submit");
+		ForEachComponent(entity, world, EntityComponent_render) {
+			Rng2F32 rect = Shift2F32(entity->render_rect, th_entity_render_pos(entity, alpha));
+			if (!th_camera_sees(view, rect))
+				continue;
+			RenderRect* render_rect = th_sprite_batch_push(&gs->sprite_batch);
+			if (!render_rect)
+				continue; // batch is full, counted in sprite_batch.dropped
+			render_rect->rect = rect;
+			if (entity->x_dir == -1)
+				Swap(F32, render_rect->rect.min.x, render_rect->rect.max.x);
+			render_rect->sprite = entity->sprite;
+			render_rect->col = entity->col;
+			if (entity->frame.render_highlight)
+				render_rect->col = Vec4(0.5f, 0.5f, 0.5f, 0.5f);
 		}
 	}
+	{
+		TH_PROFILE_ZONE("sprite draw");
+		sgp_flush(); // terrain and particles go underneath
+		th_sprite_batch_draw(&gs->sprite_batch, view.world_to_clip);
+	}
 
 	#ifdef RENDER_COLLIDERS
-	for (int i = 0; i < world->entities.count; i++) {
-		Entity* entity = &world->entities[i];
-		if (!entity->rigid_body)
-			continue;
+	ForEachComponent(entity, world, EntityComponent_rigid_body) {
 		Rng2F32 rect = entity->bounds;
-		rect = Shift2F32(rect, entity->pos);
+		rect = Shift2F32(rect, th_entity_render_pos(entity, alpha));
+		if (!th_camera_sees(view, rect))
+			continue;
 		sgp_set_color(RENDER_COLLIDER_COLOR);
 		sgp_draw_debug_rect_lines(rect);
 	}
 	#endif
 
-	sg_pass_action pass_action = { 0 };
-	sg_begin_default_pass(&pass_action, window_size.x, window_size.y);
+	#ifndef TH_SHIP
+	if (gs->profile_overlay)
+		th_profile_overlay_draw(&gs->frame_arena, window_size);
+	#endif
+
+	TH_PROFILE_ZONE("submit");
 	sgp_flush();
 	sgp_end();
 	sg_end_pass();
 	sg_commit();
+}
 
-	// clear press and release events
+// press and release events only count for the first sim step that sees them
+static void input_clear_events(void) {
+	GameState* gs = game_state();
 	memset(&gs->key_pressed, 0, sizeof(gs->key_pressed));
 	memset(&gs->key_released, 0, sizeof(gs->key_released));
 	memset(&gs->mouse_pressed, 0, sizeof(gs->mouse_pressed));
 	memset(&gs->mouse_released, 0, sizeof(gs->mouse_released));
 }
 
+static void recording_stop(void) {
+	GameState* gs = game_state();
+	B8 ok = th_recording_stop();
+	// not LOG, the path alone can fill its buffer
+	printf("%s %s, %u frames\n", ok ? "wrote" : "couldn't write", gs->recorder.path, gs->recorder.frame_count);
+}
+
+// one displayed frame. Runs as many fixed sim steps as the elapsed time owes us, then renders
+// in between the last two states. Input events have already been written into GameState by
+// whoever drives us.
+static void tick(F32 frame_delta_t, B8 do_render) {
+	#ifndef TH_SHIP
+	th_profile_frame_mark();
+	#endif
+	TH_PROFILE_ZONE("frame");
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	th_arena_clear(&gs->frame_arena);
+	th_jobs_timings_clear();
+	#ifndef TH_SHIP
+	if (gs->key_pressed[SAPP_KEYCODE_F3]) {
+		gs->profile_overlay = !gs->profile_overlay;
+		gs->key_pressed[SAPP_KEYCODE_F3] = 0;
+	}
+	if (gs->key_pressed[SAPP_KEYCODE_F4]) {
+		B8 ok = th_profile_write_chrome_trace(&gs->frame_arena, PROFILE_TRACE_PATH);
+		LOG("%s %s", ok ? "wrote" : "couldn't write", PROFILE_TRACE_PATH);
+		gs->key_pressed[SAPP_KEYCODE_F4] = 0;
+	}
+	{
+		TH_PROFILE_ZONE("hot reload");
+		th_assets_hot_reload();
+	}
+	#endif
+	{
+		TH_PROFILE_ZONE("texture uploads");
+		th_texture_uploads_pump(TEXTURE_UPLOAD_BUDGET);
+	}
+
+	// keys that reach outside the sim are handled here and taken out, a replay never sees them
+	if (gs->key_pressed[SAPP_KEYCODE_F5]) {
+		B8 ok = th_world_autosave(world, 1);
+		LOG("%s", ok ? "saving " AUTOSAVE_PATH : "still writing the last save");
+		gs->key_pressed[SAPP_KEYCODE_F5] = 0;
+	}
+	if (gs->key_pressed[SAPP_KEYCODE_F9]) {
+		if (gs->recorder.recording)
+			recording_stop(); // a load from disk can't be replayed
+		th_snapshot_saver_flush(&gs->autosave);
+		B8 ok = th_world_load_file(world, AUTOSAVE_PATH);
+		LOG("%s " AUTOSAVE_PATH, ok ? "loaded" : "couldn't load");
+		gs->key_pressed[SAPP_KEYCODE_F9] = 0;
+	}
+	if (gs->key_pressed[SAPP_KEYCODE_F6]) {
+		if (gs->recorder.recording) {
+			recording_stop();
+		} else {
+			th_recording_start(REPLAY_PATH);
+			LOG("recording " REPLAY_PATH);
+		}
+		gs->key_pressed[SAPP_KEYCODE_F6] = 0;
+	}
+	if (gs->record_path) {
+		if (!th_recording_start(gs->record_path))
+			printf("can't record to %s, the path is too long\n", gs->record_path);
+		gs->record_path = 0;
+	}
+	if (gs->recorder.recording) {
+		InputState input;
+		th_input_capture(&input);
+		th_replay_record_frame(&gs->recorder, &input, frame_delta_t);
+	}
+
+	gs->sim_accumulator += Min(frame_delta_t, SIM_DT * SIM_MAX_SUBSTEPS);
+	while (gs->sim_accumulator >= SIM_DT) {
+		if (gs->key_pressed[SAPP_KEYCODE_B]) {
+			th_world_clear(world);
+			th_world_init(world);
+		}
+		simulate(SIM_DT);
+		gs->sim_accumulator -= SIM_DT;
+		gs->sim_tick++;
+		if (gs->autosave_ticks && gs->sim_tick % gs->autosave_ticks == 0)
+			th_world_autosave(world); // skipped if the last one is still writing, the next one catches up
+		input_clear_events(); // no step this frame keeps them around for the next one
+	}
+	gs->sim_alpha = (F32)(gs->sim_accumulator / SIM_DT);
+
+	if (do_render)
+		render();
+}
+
+#ifndef TH_HEADLESS
+static void frame(void) {
+	GameState* gs = game_state();
+	gs->window_size = Vec2((F32)sapp_width(), (F32)sapp_height());
+	tick(sapp_frame_duration(), 1);
+}
+#endif
+
 static void init(void) {
+	#ifdef TH_HEADLESS
+	sg_desc sgdesc = { 0 };
+	#else
 	sg_desc sgdesc = { .context = sapp_sgcontext() };
+	#endif
 	sg_setup(&sgdesc);
 	if (!sg_isvalid()) {
 		fprintf(stderr, "Failed to create Sokol GFX context!\n");
@@ -333,45 +281,38 @@ static void init(void) {
 	}
 
 	// ENTRY
+	th_memory_init();
 	GameState* gs = game_state();
 	WorldState* world = world_state();
+	th_profile_thread_name("main");
+	th_jobs_init(&gs->permanent_arena, gs->job_threads);
+	th_loader_init(&gs->image_loader, TEXTURE_DECODE_THREADS, th_texture_decode, th_texture_decode_free);
+	th_snapshot_saver_init(&gs->autosave, AUTOSAVE_PATH);
+	th_replay_recorder_init(&gs->recorder);
+	th_particle_batch_init(&gs->particle_batch, &gs->permanent_arena, PARTICLE_CAPACITY);
+	th_sprite_batch_init(&gs->sprite_batch, &gs->permanent_arena, SPRITE_BATCH_CAPACITY);
 
 	printf("balls");
 
-	TextureAtlas* atlas = th_texture_atlas_load("dump.png");
-	// plant stages
-	Rng2F32 sub_rect = Rng2F32(Vec2(), Vec2(16, 64));
-	th_texture_sprite_create(atlas, "plant0", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant1", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant2", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant3", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant4", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant5", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant6", sub_rect);
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	th_texture_sprite_create(atlas, "plant7", sub_rect);
-	// resources
-	sub_rect = Shift2F32(sub_rect, Vec2(16, 0));
-	sub_rect.max = sub_rect.min;
-	sub_rect.max += Vec2(4, 4);
-	th_texture_sprite_create(atlas, "resource1", sub_rect);
-	// player
-	sub_rect.min = Vec2(16 * 10, 0);
-	sub_rect.max = sub_rect.min + Vec2(16, 32);
-	th_texture_sprite_create(atlas, "arcane_player", sub_rect);
-
-	{
-		// background emitter
-		Emitter* emitter = TH_ARRAY_PUSH(gs->emitters, gs->emitter_count);
-		emitter->emit_func = emitter_ambient_screen;
-		emitter->frequency = 10.0f;
+	U64 assets_start = th_os_time_ns();
+	B8 from_pack = th_assets_load_pack(ASSET_PACK_PATH);
+	#ifdef TH_SHIP
+	Assert(from_pack); // shipping only reads the pack, bake it with thomas_packer
+	#else
+	if (!from_pack) {
+		B8 ok = th_assets_load_sources();
+		Assert(ok); // no pack and no usable definitions, run from data/
+		th_assets_watch();
 	}
+	#endif
+	LOG("assets from %s in %.2fms", from_pack ? ASSET_PACK_PATH : ASSET_DEFS_PATH, (th_os_time_ns() - assets_start) / 1000000.0);
+	gs->archetype_ids.player = th_archetype_id("player");
+	gs->archetype_ids.seed = th_archetype_id("seed");
+	gs->archetype_ids.resource = th_archetype_id("resource");
+	gs->archetype_ids.plant = th_archetype_id("plant");
+	th_terrain_init();
+
+	th_emitter_create(th_emitter_type_id("ambient"), Vec2(0.0f, 0.0f)); // background
 
 	gs->cam.scale = DEFAULT_CAMERA_SCALE;
 
@@ -379,10 +320,23 @@ static void init(void) {
 }
 
 static void cleanup(void) {
+	GameState* gs = game_state();
+	#ifndef TH_SHIP
+	th_memory_log_stats();
+	if (gs->hot_reload)
+		th_watch_shutdown(&gs->asset_watch);
+	#endif
+	if (gs->recorder.recording)
+		recording_stop();
+	th_replay_recorder_release(&gs->recorder);
+	th_loader_shutdown(&gs->image_loader);
+	th_snapshot_saver_shutdown(&gs->autosave); // finishes a save in flight first
+	th_jobs_shutdown();
 	sgp_shutdown();
 	sg_shutdown();
 }
 
+#ifndef TH_HEADLESS
 static void event(const sapp_event* ev) {
 	GameState* gs = game_state();
 	switch (ev->type) {
@@ -426,9 +380,14 @@ static void event(const sapp_event* ev) {
 	#endif
 }
 
+// thomas [--record replay], records the whole session from the first frame. F6 records a stretch of one
 sapp_desc sokol_main(int argc, char* argv[]) {
-	(void)argc;
-	(void)argv;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (!strcmp(argv[i], "--record"))
+			game_state()->record_path = argv[++i];
+	}
+	game_state()->seed = DEFAULT_SEED;
+	game_state()->autosave_ticks = (U32)(AUTOSAVE_SECONDS / SIM_DT);
 	sapp_desc test = {
 		.init_cb = init,
 		.frame_cb = frame,
@@ -440,3 +399,220 @@ sapp_desc sokol_main(int argc, char* argv[]) {
 	};
 	return test;
 }
+#else
+// HEADLESS
+// Runs the world with no window, flat out or paced to --hz. For soak tests and timing the
+// world update on machines without a GPU. --render still walks the render path, on the dummy
+// backend, so the batching cost shows up too. The world hash printed at the end covers the whole
+// snapshot, two runs that print the same one ended in the same world.
+// --replay plays a recording back instead, frame by frame with the delta_t it was recorded at,
+// and reports how long the frames took. --out writes those numbers as thomas_bench --json lines,
+// thomas_bench --results compares them against the same replay on another build. A replay also
+// has to end in the session it was recorded into, otherwise it's reported as diverged and the
+// exit code is 1.
+//   thomas_headless [--frames N] [--dt seconds] [--hz N] [--seed N] [--plants N] [--resources N]
+//                   [--threads N] [--render] [--log-jobs] [--trace path]
+//                   [--load snapshot] [--save snapshot] [--autosave steps]
+//                   [--record replay] [--replay replay] [--out results.jsonl]
+
+#if OS_WINDOWS
+#define th_sleep_ms(ms) Sleep((DWORD)(ms))
+#else
+#include <unistd.h>
+#define th_sleep_ms(ms) usleep((useconds_t)(ms) * 1000)
+#endif
+
+#define HEADLESS_WINDOW_SIZE Vec2(1280.0f, 720.0f)
+#define HEADLESS_DEFAULT_FRAMES 10000
+
+static int headless_compare_f64(const void* a, const void* b) {
+	F64 x = *(const F64*)a;
+	F64 y = *(const F64*)b;
+	return x < y ? -1 : x > y;
+}
+
+// one thomas_bench result line. better is 0 for lower, 2 for "has to stay the same"
+static void headless_report(FILE* out, const char* bench, U64 n, const char* metric, F64 value, const char* unit, U32 better) {
+	fprintf(out, "{\"bench\":\"%.31s\",\"n\":%llu,\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\",\"better\":%u}\n",
+		bench, (unsigned long long)n, metric, value, unit, better);
+}
+
+// frame time spread over a replay, the percentiles are what regress first
+static void headless_replay_report(const char* replay_path, F64* frame_ms, U64 frame_count, U64 sim_steps, const char* out_path) {
+	if (!frame_count)
+		return;
+	F64 total = 0.0;
+	for (U64 i = 0; i < frame_count; i++)
+		total += frame_ms[i];
+	qsort(frame_ms, frame_count, sizeof(F64), headless_compare_f64);
+	F64 mean = total / frame_count;
+	F64 p50 = frame_ms[frame_count / 2];
+	F64 p95 = frame_ms[(frame_count * 95) / 100];
+	F64 p99 = frame_ms[(frame_count * 99) / 100];
+	F64 max = frame_ms[frame_count - 1];
+	printf("replay %s  %llu frames  mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms\n", replay_path,
+		(unsigned long long)frame_count, mean, p50, p95, p99, max);
+	if (!out_path)
+		return;
+	FILE* out = fopen(out_path, "ab"); // appends, so one file can hold a whole corpus
+	if (!out) {
+		fprintf(stderr, "couldn't open %s\n", out_path);
+		return;
+	}
+	// named after the file, the same replay on two builds lines up
+	const char* name = replay_path;
+	for (const char* c = replay_path; *c; c++) {
+		if (*c == '/' || *c == '\\')
+			name = c + 1;
+	}
+	headless_report(out, name, frame_count, "frame mean", mean, "ms", 0);
+	headless_report(out, name, frame_count, "frame p50", p50, "ms", 0);
+	headless_report(out, name, frame_count, "frame p95", p95, "ms", 0);
+	headless_report(out, name, frame_count, "frame p99", p99, "ms", 0);
+	headless_report(out, name, frame_count, "frame max", max, "ms", 0);
+	headless_report(out, name, frame_count, "sim steps", (F64)sim_steps, "total", 2);
+	fclose(out);
+}
+
+int main(int argc, char* argv[]) {
+	U64 frame_count = 0; // HEADLESS_DEFAULT_FRAMES, or all of the replay
+	F32 delta_t = SIM_DT; // frame time fed to tick, one sim step per frame by default
+	F64 hz = 0.0; // 0 runs as fast as it can
+	U64 seed = DEFAULT_SEED;
+	U32 plant_count = 0;
+	U32 resource_count = 0;
+	B8 do_render = 0;
+	B8 log_jobs = 0;
+	const char* trace_path = 0; // chrome trace of the last frames, on exit
+	const char* load_path = 0; // starts from this snapshot instead of a fresh world
+	const char* save_path = 0; // keyframe of the final world, on exit
+	const char* replay_path = 0; // plays this back instead of running on its own
+	const char* out_path = 0; // replay frame times, appended
+	GameState* gs = game_state();
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : 0;
+		if (!strcmp(arg, "--render")) {
+			do_render = 1;
+			continue;
+		}
+		if (!strcmp(arg, "--log-jobs")) {
+			log_jobs = 1;
+			continue;
+		}
+		if (!value) {
+			fprintf(stderr, "%s needs a value\n", arg);
+			return 1;
+		}
+		if (!strcmp(arg, "--frames")) frame_count = strtoull(value, 0, 10);
+		else if (!strcmp(arg, "--dt")) delta_t = strtof(value, 0);
+		else if (!strcmp(arg, "--hz")) hz = strtod(value, 0);
+		else if (!strcmp(arg, "--seed")) seed = strtoull(value, 0, 10);
+		else if (!strcmp(arg, "--plants")) plant_count = strtoul(value, 0, 10);
+		else if (!strcmp(arg, "--resources")) resource_count = strtoul(value, 0, 10);
+		else if (!strcmp(arg, "--threads")) gs->job_threads = strtoul(value, 0, 10);
+		else if (!strcmp(arg, "--trace")) trace_path = value;
+		else if (!strcmp(arg, "--load")) load_path = value;
+		else if (!strcmp(arg, "--save")) save_path = value;
+		else if (!strcmp(arg, "--autosave")) gs->autosave_ticks = strtoul(value, 0, 10);
+		else if (!strcmp(arg, "--record")) gs->record_path = value;
+		else if (!strcmp(arg, "--replay")) replay_path = value;
+		else if (!strcmp(arg, "--out")) out_path = value;
+		else {
+			fprintf(stderr, "unknown argument %s\n", arg);
+			return 1;
+		}
+		i++;
+	}
+
+	stm_setup();
+	gs->seed = seed;
+	init();
+	WorldState* world = world_state();
+	gs->window_size = HEADLESS_WINDOW_SIZE;
+	th_world_populate(world, plant_count, resource_count);
+	if (load_path && !th_world_load_file(world, load_path)) {
+		fprintf(stderr, "couldn't load %s\n", load_path);
+		return 1;
+	}
+	Arena replay_arena;
+	th_arena_init(&replay_arena, "replay");
+	ReplayPlayer* replay = 0;
+	F64* frame_ms = 0;
+	if (replay_path) {
+		replay = ArenaPushStruct(&replay_arena, ReplayPlayer);
+		if (!th_replay_open(replay, &replay_arena, replay_path, sizeof(InputState)) || !th_session_load(replay->start, replay->start_size)) {
+			fprintf(stderr, "couldn't load %s\n", replay_path);
+			return 1;
+		}
+		frame_count = frame_count ? Min(frame_count, (U64)replay->frame_count) : replay->frame_count;
+		frame_ms = ArenaPushArray(&replay_arena, F64, frame_count);
+	} else if (!frame_count) {
+		frame_count = HEADLESS_DEFAULT_FRAMES;
+	}
+	U64 start_tick = gs->sim_tick;
+
+	U64 start = stm_now();
+	for (U64 frame = 0; frame < frame_count; frame++) {
+		if (replay) {
+			InputState input;
+			if (!th_replay_next(replay, &input, &delta_t)) {
+				fprintf(stderr, "%s is damaged after %llu frames\n", replay_path, (unsigned long long)frame);
+				frame_count = frame;
+				break;
+			}
+			th_input_apply(&input);
+			U64 frame_start = stm_now();
+			tick(delta_t, do_render);
+			frame_ms[frame] = stm_ms(stm_since(frame_start));
+			continue;
+		}
+		tick(delta_t, do_render);
+		if (hz > 0.0) {
+			F64 frame_end = (frame + 1) / hz;
+			F64 remaining = frame_end - stm_sec(stm_since(start));
+			if (remaining > 0.0)
+				th_sleep_ms(remaining * 1000.0);
+		}
+	}
+	F64 elapsed = stm_sec(stm_since(start));
+
+	th_arena_clear(&gs->frame_arena);
+	th_snapshot_saver_flush(&gs->autosave);
+	Arena* staging = th_snapshot_saver_begin(&gs->autosave); // idle now, borrowed to hash the world
+	U64 snapshot_size = th_world_save(world, staging);
+	const U8* snapshot = staging->base;
+	printf("headless %llu frames (%llu sim steps) in %.3fs  %.0f fps  %.3f ms/frame  entities %u  stored %u  particles %u  threads %u  world %016llx\n",
+		(unsigned long long)frame_count, (unsigned long long)gs->sim_tick, elapsed,
+		frame_count / elapsed, elapsed * 1000.0 / frame_count,
+		world->entity_dense_count, world->chunk_record_count - world->chunk_record_dead, gs->particles.count, th_job_system.worker_count,
+		(unsigned long long)th_snapshot_hash(snapshot, snapshot_size));
+	if (do_render) {
+		printf("render  sprite draws %u  tilemap draws %u  tiles %u  baked chunks %u/%u\n",
+			gs->sprite_batch.draw_calls, gs->tilemap.draw_calls, gs->tilemap.quad_count, gs->tilemap.baked_count, gs->tilemap.chunk_count);
+	}
+	int result = 0;
+	if (replay) {
+		// only a replay that ran to the end has an end state to check against
+		if (replay->frame == replay->frame_count) {
+			U64 session_size = th_session_save(&replay_arena);
+			B8 matches = th_snapshot_hash(replay_arena.base + replay_arena.pos - session_size, session_size) == replay->end_hash;
+			printf("replay %s\n", matches ? "matches the recording" : "DIVERGED from the recording");
+			result = matches ? 0 : 1;
+		}
+		headless_replay_report(replay_path, frame_ms, frame_count, gs->sim_tick - start_tick, out_path);
+	}
+	if (save_path && !th_snapshot_write_file(&gs->frame_arena, save_path, snapshot, snapshot_size, 0, 0))
+		fprintf(stderr, "couldn't write %s\n", save_path);
+	if (log_jobs)
+		th_jobs_log_timings(); // last frame only
+	#ifndef TH_SHIP
+	if (trace_path && !th_profile_write_chrome_trace(&gs->frame_arena, trace_path))
+		fprintf(stderr, "couldn't write %s\n", trace_path);
+	#endif
+
+	cleanup();
+	th_arena_release(&replay_arena);
+	return result;
+}
+#endif
@@ -1,11 +1,37 @@
 #ifndef ANVIL_H
 #define ANVIL_H
 
+#include "anvil_assets.h"
+
 #define APP_NAME "Game C"
 #define MOVE_SPEED 2000.0f
 #define PIXEL_SCALE 30.0f
 #define GRAVITY 1000.0f
 #define DEFAULT_CAMERA_SCALE 5.0f
+#define PARTICLE_CAPACITY 131072
+#define SPRITE_BATCH_CAPACITY 65536
+#define TEXTURE_DECODE_THREADS 2
+#define TEXTURE_UPLOAD_BUDGET Megabytes(8) // pixel bytes handed to the GPU per frame
+#define DEFAULT_SEED 1337
+#define AUTOSAVE_PATH "autosave.snap" // deltas go next to it, F5 saves now and F9 loads
+#define AUTOSAVE_SECONDS 30.0 // of sim time
+#define REPLAY_PATH "last.replay" // F6 starts and stops recording into it
+#define PROFILE_TRACE_PATH "profile.json" // F4 writes it, F3 toggles the overlay
+// the sim always steps at SIM_DT, whatever the display rate. A hitch runs at most
+// SIM_MAX_SUBSTEPS steps and drops the rest, so the game slows down instead of spiralling
+#define SIM_DT (1.0f / 60.0f)
+#define SIM_MAX_SUBSTEPS 4
+#define BROADPHASE_CELL_SIZE 32.0f
+#define PHYSICS_JOB_GRAIN 2048 // bodies per job, below this it all runs on one thread
+#define PARTICLE_JOB_GRAIN 4096
+#define COLLISION_ITERATIONS 4
+#define COLLISION_SLOP 0.01f // penetration left in on purpose, so resting contacts don't jitter
+#define PLANT_FINAL_STAGE 6
+#define PLANT_STAGE_SECONDS 0.25f
+#define CHUNK_WIDTH 256.0f // the world streams in vertical strips this wide
+#define CHUNK_LOAD_RADIUS 2 // chunks either side of the camera's that are live, see th_world_stream
+#define TERRAIN_TILE_SIZE 16.0f // world units, the ground tiles are 16 atlas pixels
+#define TERRAIN_DEPTH 32 // rows of tiles under the ground line
 
 #ifndef TH_SHIP
 //#define FUN_VAL
@@ -17,59 +43,93 @@
 #define TH_BLACK Vec4(0.0f, 0.0f, 0.0f, 1.0f)
 #define TH_WHITE Vec4(1.0f, 1.0f, 1.0f, 1.0f)
 
-typedef struct Emitter Emitter;
-typedef struct Particle Particle;
-typedef void (*ParticleEmitterFunc)(Particle*, Emitter*);
-#define PARTICLE_EMITTER_FUNC(function_name) static void function_name(Particle* particle, Emitter* emitter)
+typedef U32 ArchetypeID;
+typedef U32 EmitterTypeID;
+
+// every random stream's id, they all share the game's seed. Emitters take one each, counting up
+// from RandomStreamID_emitters
+enum RandomStreamID {
+	RandomStreamID_world = 1,
+	RandomStreamID_terrain = 2,
+	RandomStreamID_emitters = 0x1000,
+};
 
+// what an emitter spawns and how often comes from its type, so editing the definition changes
+// emitters that are already running
 struct Emitter {
 	Vec2 pos;
-	F32 frequency;
-	ParticleEmitterFunc emit_func;
+	EmitterTypeID type;
+	RandomStream rng;
 };
 
-struct Particle {
-	Vec2 pos;
-	Vec2 vel;
-	Vec4 col;
-	F32 start_life;
-	F32 life;
-	F32 size_mult;
-	// flags;
-	B8 fade_in;
-	B8 fade_out;
+struct EntityFrame {
+	B8 render_highlight;
+	B8 interpolate; // prev_pos is from the previous step, not a fresh spawn
 };
 
-struct TextureAtlas {
-	char name[128];
-	sg_image image;
+// Entity IDs are handles: the low bits index into WorldState::entities, the high bits are
+// the slot's generation. Destroying an entity bumps the generation, so stale IDs stop
+// resolving instead of silently pointing at whatever reused the slot. 0 is never a valid ID.
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GENERATION_MAX ((1u << (32 - ENTITY_INDEX_BITS)) - 1)
+#define ENTITY_NIL_INDEX 0xFFFFFFFF
+
+// Systems only walk the entities that opted into them. Each component keeps a packed list of
+// slot indices, set membership through EntitySetComponent so the flag and the list agree.
+enum EntityComponent {
+	EntityComponent_rigid_body,
+	EntityComponent_render,
+	EntityComponent_plant,
+	EntityComponent_interactable,
+	EntityComponent_collider,
+	EntityComponent_COUNT,
 };
 
-struct Sprite {
-	char name[128];
-	TextureAtlas* atlas;
-	Rng2F32 sub_rect;
+// collider shapes, both built from Entity::bounds
+enum EntityShape {
+	EntityShape_aabb,
+	EntityShape_capsule, // rounded ends, rides over the corners of boxes instead of snagging
 };
 
-struct RenderRect {
-	Rng2F32 rect;
-	Sprite* sprite;
-	Vec4 col;
+struct ComponentList {
+	Arena arena;
+	U32* slots;
+	U32 count;
 };
 
-struct EntityFrame {
-	B8 render_highlight;
+struct EntitySlot {
+	U32 generation;
+	U32 next; // live: index into WorldState::entity_dense, dead: next free slot
+	U32 component_index[EntityComponent_COUNT]; // position in each ComponentList, ENTITY_NIL_INDEX if absent
+};
+
+// Physics state of every rigid body, packed parallel to the rigid body ComponentList and kept in
+// step with it by EntitySetComponent. While an entity has a body this is where its pos, vel, acc
+// and friction live, the integrator runs over these in place. Each array owns its arena.
+struct RigidBodies {
+	Arena pos_arena;
+	Arena vel_arena;
+	Arena acc_arena;
+	Arena friction_arena;
+	Vec2* pos;
+	Vec2* vel;
+	Vec2* acc;
+	F32* friction;
 };
 
 struct Entity {
 	U32 id;
-	EntityFrame frame; // per-frame data, zeroed out at the start of each frame
+	EntityFrame frame; // per-step data, zeroed out at the start of each sim step
 	B8 rigid_body;
+	// pos, vel, acc and x_friction_mult are stale while the entity has a rigid body, the live
+	// ones are in WorldState::bodies. Go through EntityPos and friends
 	Vec2 pos;
+	Vec2 prev_pos; // pos before the last sim step, render lerps between the two
 	Vec2 vel;
 	Vec2 acc;
 	Rng2F32 bounds;
-	B8 x_friction_mult;
+	F32 x_friction_mult;
 	B8 render;
 	Rng2F32 render_rect;
 	Sprite* sprite;
@@ -77,36 +137,169 @@ struct Entity {
 	B8 x_dir;
 	B8 plant;
 	F32 plant_stage;
+	F64 plant_next_stage_time; // on the behaviors clock, 0 until the plant's behavior first runs
+	ArchetypeID archetype; // 0 for entities that weren't made from one
 	B8 interactable;
 	B8 seed;
+	B8 collider;
+	EntityShape shape;
+};
+
+enum EntityRecordFlag {
+	EntityRecordFlag_seed = 1 << 0,
+};
+
+// What survives of an Entity, in snapshots and in the chunks that aren't live. Zeroed before
+// filling so padding never differs between saves. sprite and archetype are the live ids, except
+// in a snapshot payload where they're 1 + an index into its name tables
+struct EntityRecord {
+	U32 id; // 0 in chunk records, the entity gets a new one when its chunk goes live
+	U32 sprite; // 0 for none
+	U32 archetype;
+	U8 shape;
+	S8 x_dir;
+	U8 x_friction_mult;
+	U8 flags; // EntityRecordFlag
+	Vec2 pos;
+	Vec2 vel;
+	Vec2 acc;
+	Rng2F32 bounds;
+	Rng2F32 render_rect;
+	Vec4 col;
+	F32 plant_stage;
+	U32 components; // EntityComponent bits
+	F64 plant_next_stage_time;
+};
+
+// stored entities of one chunk, a run of WorldState::chunk_records
+struct WorldChunk {
+	S32 index; // floor(x / CHUNK_WIDTH)
+	U32 first;
+	U32 count;
+};
+
+struct CollisionStats {
+	U32 pair_count; // broadphase pairs handed to the narrowphase, last step
+	U32 contact_count; // manifold points found on the first iteration, last step
+};
+
+// the tile set the ground is generated from
+struct TerrainTiles {
+	TileID grass;
+	TileID dirt;
+	TileID rocks;
 };
 
 struct Camera {
 	Vec2 pos;
+	Vec2 prev_pos;
 	F32 scale;
 	F32 rotation;
 };
 
+// definitions from the asset files, see anvil_assets.h
+struct Archetype {
+	const char* name;
+	SpriteID sprite; // 0 sizes entities from params.size instead
+	ArchetypeParams params;
+};
+
+struct EmitterType {
+	const char* name;
+	EmitterParams params;
+};
+
+// resolved once at load, so gameplay code never looks an archetype up by name
+struct ArchetypeIDs {
+	ArchetypeID player;
+	ArchetypeID seed;
+	ArchetypeID resource;
+	ArchetypeID plant; // its sprite is the first stage, the others follow it
+};
+
 struct WorldState {
-	Entity entities[64];
-	U32 last_entity_id;
+	// slots only ever grow, so Entity* stays valid until the entity is destroyed
+	Arena entity_arena;
+	Entity* entities;
+	U32 entity_count;
+	Arena entity_slot_arena;
+	EntitySlot* entity_slots; // parallel to entities
+	U32 entity_slot_count;
+	U32 entity_free_head;
+	// packed slot indices of live entities, iterate with ForEachEntity
+	Arena entity_dense_arena;
+	U32* entity_dense;
+	U32 entity_dense_count;
+	ComponentList components[EntityComponent_COUNT];
+	RigidBodies bodies; // parallel to components[EntityComponent_rigid_body]
+	// rebuilt every sim step, entities created since then aren't in it yet
+	Arena broadphase_arena;
+	SpatialHash broadphase;
+	CollisionStats collision_stats;
+	CoroScheduler behaviors; // entity behaviors, owner is the entity id
+	RandomStream rng; // anything the world rolls dice for, seeded by th_world_init
 	Entity* player;
 	U32 held_entity_id;
+	// streaming, everything outside the resident chunks is kept as records. See th_world_stream
+	Arena chunk_arena;
+	WorldChunk* chunks; // only the ones holding records, sorted by index
+	U32 chunk_count;
+	Arena chunk_record_arena;
+	EntityRecord* chunk_records;
+	U32 chunk_record_count; // dead ones included, left behind by chunks that went live again
+	U32 chunk_record_dead;
+	S32 resident_min; // chunks [resident_min, resident_max] are live
+	S32 resident_max;
+	B8 streaming; // the resident range is set, 0 until the first th_world_stream
 };
 
 struct GameState {
+	Arena permanent_arena;
+	Arena frame_arena; // cleared at the start of every frame
 	WorldState world_state;
 	B8 key_down[SAPP_KEYCODE_MENU];
 	B8 mouse_down[SAPP_MOUSEBUTTON_MIDDLE];
 	Emitter emitters[16];
 	U32 emitter_count;
-	Particle particles[2048];
-	U32 particle_count;
+	ParticleSystem particles;
+	ParticleBatch particle_batch;
+	SpriteBatch sprite_batch;
+	Tilemap tilemap;
+	TerrainTiles terrain_tiles;
 	Camera cam;
-	TextureAtlas atlases[16];
+	Arena atlas_arena;
+	TextureAtlas* atlases;
 	U32 atlas_count;
-	Sprite sprites[64];
+	NameTable atlas_names;
+	Arena sprite_arena;
+	Sprite* sprites;
 	U32 sprite_count;
+	NameTable sprite_names;
+	Arena archetype_arena;
+	Archetype* archetypes;
+	U32 archetype_count;
+	NameTable archetype_names;
+	ArchetypeIDs archetype_ids;
+	Arena emitter_type_arena;
+	EmitterType* emitter_types;
+	U32 emitter_type_count;
+	NameTable emitter_type_names;
+	ImageLoader image_loader;
+	SnapshotSaver autosave;
+	U32 autosave_ticks; // sim steps between autosaves, 0 for none. Set before init
+	ReplayRecorder recorder;
+	const char* record_path; // records from the first frame when set before init
+#ifndef TH_SHIP
+	FileWatch asset_watch;
+	B8 hot_reload; // assets came from the sources, not the pack
+	B8 profile_overlay;
+#endif
+	// fixed timestep
+	F64 sim_accumulator; // real time not yet simulated
+	U64 sim_tick;
+	F32 sim_alpha; // how far render is between the last two sim states, 0..1
+	U32 job_threads; // 0 picks one per core, set before init
+	U64 seed; // every random stream starts from it, set before init
 	// per-frame
 	Vec2 mouse_pos;
 	Vec2 window_size;
@@ -126,25 +319,283 @@ static WorldState* world_state() {
 	return &gs->world_state;
 }
 
+static void th_memory_init() {
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	th_arena_init(&gs->permanent_arena, "permanent");
+	th_arena_init(&gs->frame_arena, "frame");
+	th_particles_init(&gs->particles, &gs->permanent_arena, PARTICLE_CAPACITY);
+	th_arena_init(&gs->atlas_arena, "atlases", Megabytes(1));
+	TH_ARENA_ARRAY_INIT(&gs->atlas_arena, gs->atlases);
+	th_names_init(&gs->atlas_names, "atlas names");
+	th_arena_init(&gs->sprite_arena, "sprites", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&gs->sprite_arena, gs->sprites);
+	th_names_init(&gs->sprite_names, "sprite names");
+	th_arena_init(&gs->archetype_arena, "archetypes", Megabytes(16));
+	TH_ARENA_ARRAY_INIT(&gs->archetype_arena, gs->archetypes);
+	th_names_init(&gs->archetype_names, "archetype names");
+	th_arena_init(&gs->emitter_type_arena, "emitter types", Megabytes(16));
+	TH_ARENA_ARRAY_INIT(&gs->emitter_type_arena, gs->emitter_types);
+	th_names_init(&gs->emitter_type_names, "emitter type names");
+	th_arena_init(&world->entity_arena, "entities");
+	TH_ARENA_ARRAY_INIT(&world->entity_arena, world->entities);
+	th_arena_init(&world->entity_slot_arena, "entity slots", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&world->entity_slot_arena, world->entity_slots);
+	th_arena_init(&world->entity_dense_arena, "entity dense", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&world->entity_dense_arena, world->entity_dense);
+	for (int i = 0; i < EntityComponent_COUNT; i++) {
+		ComponentList* list = &world->components[i];
+		th_arena_init(&list->arena, "component", Megabytes(64));
+		TH_ARENA_ARRAY_INIT(&list->arena, list->slots);
+	}
+	RigidBodies* bodies = &world->bodies;
+	th_arena_init(&bodies->pos_arena, "body pos", Megabytes(64));
+	th_arena_init(&bodies->vel_arena, "body vel", Megabytes(64));
+	th_arena_init(&bodies->acc_arena, "body acc", Megabytes(64));
+	th_arena_init(&bodies->friction_arena, "body friction", Megabytes(32));
+	TH_ARENA_ARRAY_INIT(&bodies->pos_arena, bodies->pos);
+	TH_ARENA_ARRAY_INIT(&bodies->vel_arena, bodies->vel);
+	TH_ARENA_ARRAY_INIT(&bodies->acc_arena, bodies->acc);
+	TH_ARENA_ARRAY_INIT(&bodies->friction_arena, bodies->friction);
+	th_arena_init(&world->broadphase_arena, "broadphase", Megabytes(256));
+	th_arena_init(&world->chunk_arena, "chunks", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&world->chunk_arena, world->chunks);
+	th_arena_init(&world->chunk_record_arena, "chunk records");
+	TH_ARENA_ARRAY_INIT(&world->chunk_record_arena, world->chunk_records);
+	th_coro_init(&world->behaviors);
+	world->entity_free_head = ENTITY_NIL_INDEX;
+}
+
+static void th_memory_log_stats() {
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	th_arena_log_stats(&gs->permanent_arena);
+	th_arena_log_stats(&gs->frame_arena);
+	th_arena_log_stats(&gs->atlas_arena);
+	th_names_log_stats(&gs->atlas_names);
+	th_arena_log_stats(&gs->sprite_arena);
+	th_names_log_stats(&gs->sprite_names);
+	th_arena_log_stats(&gs->archetype_arena);
+	th_names_log_stats(&gs->archetype_names);
+	th_arena_log_stats(&gs->emitter_type_arena);
+	th_names_log_stats(&gs->emitter_type_names);
+	th_arena_log_stats(&world->entity_arena);
+	th_arena_log_stats(&world->entity_slot_arena);
+	th_arena_log_stats(&world->entity_dense_arena);
+	for (int i = 0; i < EntityComponent_COUNT; i++)
+		th_arena_log_stats(&world->components[i].arena);
+	th_arena_log_stats(&world->bodies.pos_arena);
+	th_arena_log_stats(&world->bodies.vel_arena);
+	th_arena_log_stats(&world->bodies.acc_arena);
+	th_arena_log_stats(&world->bodies.friction_arena);
+	th_arena_log_stats(&world->broadphase_arena);
+	th_arena_log_stats(&world->chunk_arena);
+	th_arena_log_stats(&world->chunk_record_arena);
+	th_coro_log_stats(&world->behaviors);
+}
+
+// wipes the world but keeps its arenas (and their committed pages) around
+static void th_world_clear(WorldState* world) {
+	th_coro_clear(&world->behaviors);
+	WorldState old = *world;
+	MemoryZeroStruct(world);
+	world->entity_arena = old.entity_arena;
+	world->entity_slot_arena = old.entity_slot_arena;
+	world->entity_dense_arena = old.entity_dense_arena;
+	th_arena_clear(&world->entity_arena);
+	th_arena_clear(&world->entity_slot_arena);
+	th_arena_clear(&world->entity_dense_arena);
+	TH_ARENA_ARRAY_INIT(&world->entity_arena, world->entities);
+	TH_ARENA_ARRAY_INIT(&world->entity_slot_arena, world->entity_slots);
+	TH_ARENA_ARRAY_INIT(&world->entity_dense_arena, world->entity_dense);
+	for (int i = 0; i < EntityComponent_COUNT; i++) {
+		ComponentList* list = &world->components[i];
+		list->arena = old.components[i].arena;
+		th_arena_clear(&list->arena);
+		TH_ARENA_ARRAY_INIT(&list->arena, list->slots);
+	}
+	RigidBodies* bodies = &world->bodies;
+	*bodies = old.bodies;
+	th_arena_clear(&bodies->pos_arena);
+	th_arena_clear(&bodies->vel_arena);
+	th_arena_clear(&bodies->acc_arena);
+	th_arena_clear(&bodies->friction_arena);
+	world->broadphase_arena = old.broadphase_arena;
+	th_arena_clear(&world->broadphase_arena);
+	world->chunk_arena = old.chunk_arena;
+	world->chunk_record_arena = old.chunk_record_arena;
+	th_arena_clear(&world->chunk_arena);
+	th_arena_clear(&world->chunk_record_arena);
+	TH_ARENA_ARRAY_INIT(&world->chunk_arena, world->chunks);
+	TH_ARENA_ARRAY_INIT(&world->chunk_record_arena, world->chunk_records);
+	world->behaviors = old.behaviors;
+	world->entity_free_head = ENTITY_NIL_INDEX;
+}
+
 #ifdef FUN_VAL
 static F32 fun_val = 0.0f;
 #endif
 
+// iterates live entities only, packed. Destroying entities mid-loop will skip one, so don't.
+#define ForEachEntity(name, world) \
+	for (U32 name##_dense_i = 0; name##_dense_i < (world)->entity_dense_count; name##_dense_i++) \
+		for (Entity* name = &(world)->entities[(world)->entity_dense[name##_dense_i]]; name; name = 0)
+
+#define ForEachComponent(name, world, component) \
+	for (U32 name##_component_i = 0; name##_component_i < (world)->components[component].count; name##_component_i++) \
+		for (Entity* name = &(world)->entities[(world)->components[component].slots[name##_component_i]]; name; name = 0)
+
+static U32 EntityIndexFromID(U32 id) {
+	return id & ENTITY_INDEX_MASK;
+}
+
+static B8* EntityComponentFlag(Entity* entity, EntityComponent component) {
+	switch (component) {
+	case EntityComponent_rigid_body:
+		return &entity->rigid_body;
+	case EntityComponent_render:
+		return &entity->render;
+	case EntityComponent_plant:
+		return &entity->plant;
+	case EntityComponent_interactable:
+		return &entity->interactable;
+	case EntityComponent_collider:
+		return &entity->collider;
+	default:
+		InvalidPath;
+		return 0;
+	}
+}
+
+// a new body at the end of the arrays, starting from the entity's own copies
+static void th_rigid_body_push(RigidBodies* bodies, U32 count, const Entity* entity) {
+	U32 pos_count = count, vel_count = count, acc_count = count, friction_count = count;
+	*TH_ARENA_ARRAY_PUSH(&bodies->pos_arena, bodies->pos, pos_count) = entity->pos;
+	*TH_ARENA_ARRAY_PUSH(&bodies->vel_arena, bodies->vel, vel_count) = entity->vel;
+	*TH_ARENA_ARRAY_PUSH(&bodies->acc_arena, bodies->acc, acc_count) = entity->acc;
+	*TH_ARENA_ARRAY_PUSH(&bodies->friction_arena, bodies->friction, friction_count) = entity->x_friction_mult;
+}
+
+// hands the body at position back to its entity and swap-removes it, the same way the list does
+static void th_rigid_body_remove(RigidBodies* bodies, U32 count, U32 position, Entity* entity) {
+	entity->pos = bodies->pos[position];
+	entity->vel = bodies->vel[position];
+	entity->acc = bodies->acc[position];
+	entity->x_friction_mult = bodies->friction[position];
+	U32 last = count - 1;
+	bodies->pos[position] = bodies->pos[last];
+	bodies->vel[position] = bodies->vel[last];
+	bodies->acc[position] = bodies->acc[last];
+	bodies->friction[position] = bodies->friction[last];
+	th_arena_pop_to(&bodies->pos_arena, last * sizeof(Vec2));
+	th_arena_pop_to(&bodies->vel_arena, last * sizeof(Vec2));
+	th_arena_pop_to(&bodies->acc_arena, last * sizeof(Vec2));
+	th_arena_pop_to(&bodies->friction_arena, last * sizeof(F32));
+}
+
+function void EntitySetComponent(Entity* entity, EntityComponent component, B8 enabled) {
+	WorldState* world = world_state();
+	B8* flag = EntityComponentFlag(entity, component);
+	if (!!*flag == !!enabled)
+		return;
+	*flag = enabled;
+
+	U32 index = EntityIndexFromID(entity->id);
+	EntitySlot* slot = &world->entity_slots[index];
+	ComponentList* list = &world->components[component];
+	if (enabled) {
+		if (component == EntityComponent_rigid_body)
+			th_rigid_body_push(&world->bodies, list->count, entity);
+		slot->component_index[component] = list->count;
+		U32* packed = TH_ARENA_ARRAY_PUSH(&list->arena, list->slots, list->count);
+		*packed = index;
+	} else {
+		// swap-remove
+		U32 position = slot->component_index[component];
+		if (component == EntityComponent_rigid_body)
+			th_rigid_body_remove(&world->bodies, list->count, position, entity);
+		U32 last_index = list->slots[list->count - 1];
+		list->slots[position] = last_index;
+		world->entity_slots[last_index].component_index[component] = position;
+		list->count--;
+		th_arena_pop_to(&list->arena, list->count * sizeof(U32));
+		slot->component_index[component] = ENTITY_NIL_INDEX;
+	}
+}
+
+// Where the entity's physics state lives right now, packed with the other bodies or on the entity.
+// Adding or removing a rigid body, or destroying any body, moves it, so don't hold on to these.
+static Vec2& EntityPos(const Entity* entity) {
+	if (!entity->rigid_body)
+		return ((Entity*)entity)->pos;
+	WorldState* world = world_state();
+	return world->bodies.pos[world->entity_slots[EntityIndexFromID(entity->id)].component_index[EntityComponent_rigid_body]];
+}
+
+static Vec2& EntityVel(const Entity* entity) {
+	if (!entity->rigid_body)
+		return ((Entity*)entity)->vel;
+	WorldState* world = world_state();
+	return world->bodies.vel[world->entity_slots[EntityIndexFromID(entity->id)].component_index[EntityComponent_rigid_body]];
+}
+
+static Vec2& EntityAcc(const Entity* entity) {
+	if (!entity->rigid_body)
+		return ((Entity*)entity)->acc;
+	WorldState* world = world_state();
+	return world->bodies.acc[world->entity_slots[EntityIndexFromID(entity->id)].component_index[EntityComponent_rigid_body]];
+}
+
+static F32& EntityFriction(const Entity* entity) {
+	if (!entity->rigid_body)
+		return ((Entity*)entity)->x_friction_mult;
+	WorldState* world = world_state();
+	return world->bodies.friction[world->entity_slots[EntityIndexFromID(entity->id)].component_index[EntityComponent_rigid_body]];
+}
+
 function Entity* EntityCreate() {
 	WorldState* world = world_state();
-	Assert(world->last_entity_id + 1 < U32Max); // todo - more sophisticated IDs
-	world->last_entity_id++;
-	ForEach(entity, world->entities, Entity*) {
-		if (!entity->id) {
-			entity->id = world->last_entity_id;
-			return entity;
-		}
+	U32 index = world->entity_free_head;
+	if (index != ENTITY_NIL_INDEX) {
+		world->entity_free_head = world->entity_slots[index].next;
+	} else {
+		Assert(world->entity_count < ENTITY_INDEX_MASK); // out of index bits, bump ENTITY_INDEX_BITS
+		index = world->entity_count;
+		TH_ARENA_ARRAY_PUSH(&world->entity_arena, world->entities, world->entity_count);
+		EntitySlot* new_slot = TH_ARENA_ARRAY_PUSH(&world->entity_slot_arena, world->entity_slots, world->entity_slot_count);
+		new_slot->generation = 1;
 	}
-	Assert(0); // no more free entities :(
-	return 0;
+
+	EntitySlot* slot = &world->entity_slots[index];
+	slot->next = world->entity_dense_count;
+	for (int i = 0; i < EntityComponent_COUNT; i++)
+		slot->component_index[i] = ENTITY_NIL_INDEX;
+	U32* dense = TH_ARENA_ARRAY_PUSH(&world->entity_dense_arena, world->entity_dense, world->entity_dense_count);
+	*dense = index;
+
+	Entity* entity = &world->entities[index];
+	entity->id = (slot->generation << ENTITY_INDEX_BITS) | index;
+	return entity;
 }
 
 function void EntityDestroy(Entity* entity) {
+	WorldState* world = world_state();
+	Assert(entity->id); // already destroyed
+	U32 index = EntityIndexFromID(entity->id);
+	EntitySlot* slot = &world->entity_slots[index];
+	for (int i = 0; i < EntityComponent_COUNT; i++)
+		EntitySetComponent(entity, (EntityComponent)i, 0);
+
+	// swap-remove out of the dense list
+	U32 last_index = world->entity_dense[world->entity_dense_count - 1];
+	world->entity_dense[slot->next] = last_index;
+	world->entity_slots[last_index].next = slot->next;
+	world->entity_dense_count--;
+	th_arena_pop_to(&world->entity_dense_arena, world->entity_dense_count * sizeof(U32));
+
+	slot->generation = slot->generation == ENTITY_GENERATION_MAX ? 1 : slot->generation + 1;
+	slot->next = world->entity_free_head;
+	world->entity_free_head = index;
 	MemoryZeroStruct(entity);
 }
 
@@ -152,58 +603,74 @@ function Entity* EntityFromID(U32 id) {
 	if (id == 0)
 		return 0;
 	WorldState* world = world_state();
-	ForEach(entity, world->entities, Entity*) {
-		if (entity->id == id) {
-			return entity;
-		}
-	}
-	return 0;
+	U32 index = EntityIndexFromID(id);
+	if (index >= world->entity_count)
+		return 0;
+	Entity* entity = &world->entities[index];
+	return entity->id == id ? entity : 0; // stale ids fail the generation check
+}
+
+// what cam shows in the window. The sim's camera is gs->cam as of the last step, render
+// interpolates its own view between the last two
+static CameraView camera_view(const Camera& cam) {
+	GameState* gs = game_state();
+	return th_camera_view(cam.pos, cam.scale, gs->window_size);
 }
 
 static Rng2F32 camera_get_bounds() {
+	return camera_view(game_state()->cam).bounds;
+}
+
+// emitters live in GameState, each rolls its particles from a stream of its own
+static Emitter* th_emitter_create(EmitterTypeID type, Vec2 pos) {
 	GameState* gs = game_state();
-	// todo - @camera
-	Rng2F32 cam = { 0 };
-	cam.max = Vec2((int)gs->window_size.x, (int)gs->window_size.y);
-	cam = Shift2F32(cam, Vec2((int)gs->window_size.x, (int)gs->window_size.y) * -0.5f);
-	return cam;
+	U32 index = gs->emitter_count;
+	Emitter* emitter = TH_ARRAY_PUSH(gs->emitters, gs->emitter_count);
+	emitter->pos = pos;
+	emitter->type = type;
+	th_random_seed(&emitter->rng, gs->seed, RandomStreamID_emitters + index);
+	return emitter;
 }
 
-PARTICLE_EMITTER_FUNC(emitter_ambient_screen) {
-	Rng2F32 bounds = camera_get_bounds();
-	particle->pos.x = float_random_range(bounds.min.x, bounds.max.x);
-	particle->pos.y = float_random_range(bounds.min.y, bounds.max.y);
-	particle->vel = Vec2(float_random_range(-1.f, 1.f), float_random_range(2.f, 4.f));
-	particle->col = Vec4(0.7f, 0.7f, 0.7f, 1.0f);
-	particle->start_life = particle->life = 2.f;
-	particle->fade_in = 1;
-	particle->fade_out = 1;
-	particle->size_mult = 1.f;
+// writes count particles straight into the system's buffers, random columns go in one batch each
+static void th_emitter_emit(ParticleSystem* particles, Emitter* emitter, const EmitterParams* params, U32 count) {
+	U32 first = th_particles_reserve(particles, &count);
+	U32 end = first + count;
+	if (params->area == EmitterArea_screen) {
+		Rng2F32 bounds = camera_get_bounds();
+		th_random_fill_f32(&emitter->rng, particles->pos_x + first, count, bounds.min.x, bounds.max.x);
+		th_random_fill_f32(&emitter->rng, particles->pos_y + first, count, bounds.min.y, bounds.max.y);
+	} else {
+		for (U32 i = first; i < end; i++) {
+			particles->pos_x[i] = emitter->pos.x;
+			particles->pos_y[i] = emitter->pos.y;
+		}
+	}
+	th_random_fill_f32(&emitter->rng, particles->vel_x + first, count, params->vel.min.x, params->vel.max.x);
+	th_random_fill_f32(&emitter->rng, particles->vel_y + first, count, params->vel.min.y, params->vel.max.y);
+	U32 flags = 0;
+	if (params->flags & EmitterFlag_fade_in)
+		flags |= ParticleFlag_fade_in;
+	if (params->flags & EmitterFlag_fade_out)
+		flags |= ParticleFlag_fade_out;
+	for (U32 i = first; i < end; i++) {
+		particles->col_r[i] = params->col.r;
+		particles->col_g[i] = params->col.g;
+		particles->col_b[i] = params->col.b;
+		particles->col_a[i] = params->col.a;
+		particles->life[i] = params->life;
+		particles->start_life[i] = params->life;
+		particles->size[i] = params->size;
+		particles->flags[i] = flags;
+	}
 }
 
-// ideally this is just the inverse of the projection matrix, but I don't have the paitence
-// @camera - construct my own 2x3 camera view matrix and pass it down to sokol_gp somehow by pushing it as a transform?
-// or maybe just push n pop properly? idk
 static Vec2 world_pos_to_screen_pos(const Vec2& world_pos, const Camera& cam) {
-	GameState* gs = game_state();
-	Vec2 result = world_pos;
-	result = result - cam.pos;
-	result.x *= cam.scale;
-	result.y *= cam.scale;
-	result += gs->window_size * 0.5f;
-	result.y = gs->window_size.y - result.y;
-	return result;
+	return th_camera_world_to_screen(camera_view(cam), world_pos);
 }
 
 static Vec2 screen_pos_to_world_pos(const Vec2& screen_pos, const Camera& cam) {
-	GameState* gs = game_state();
-	Vec2 result = screen_pos;
-	result.y = gs->window_size.y - result.y;
-	result += gs->window_size * -0.5f;
-	result.x /= cam.scale;
-	result.y /= cam.scale;
-	result += cam.pos;
-	return result;
+	return th_camera_screen_to_world(camera_view(cam), screen_pos);
 }
 
 static Vec2 mouse_pos_in_worldspace() {
@@ -211,54 +678,121 @@ static Vec2 mouse_pos_in_worldspace() {
 	return screen_pos_to_world_pos(gs->mouse_pos, gs->cam);
 }
 
-static U32 c_string_length(const char* string) {
-	const char* cursor = string;
-	while (cursor[0] != '\0') {
-		cursor++;
-	}
-	U32 length = cursor - string;
-	return length;
-}
+// ASSETS
+// Atlases, sprites, archetypes and emitter types are registered by name and the handle is their
+// index + 1. Look them up once at load, gs->archetype_ids has the ones gameplay code needs.
 
-static U32 hash_from_string(const char* string) {
-	U32 result = 5381;
-	U32 string_size = c_string_length(string);
-	for (int i = 0; i < string_size; i++) {
-		result = ((result << 5) + result) + string[i];
-	}
-	return result;
+static TextureAtlas* th_texture_atlas_from_id(AtlasID id) {
+	GameState* gs = game_state();
+	Assert(id && id <= gs->atlas_count); // invalid atlas id
+	return &gs->atlases[id - 1];
 }
 
 static TextureAtlas* th_texture_atlas_get(const char* string) {
 	GameState* gs = game_state();
-	for (int i = 0; i < gs->atlas_count; i++) {
-		TextureAtlas* texture = &gs->atlases[i];
-		if (strcmp(texture->name, string) == 0) {
-			return texture;
-		}
-	}
-	Assert(0); // no texture found :(
-	return 0;
+	AtlasID id = th_names_find(&gs->atlas_names, string);
+	Assert(id); // no texture found :(
+	return th_texture_atlas_from_id(id);
 }
 
-static TextureAtlas* th_texture_atlas_load(const char* name) {
+static TextureAtlas* th_texture_atlas_push(const char* name) {
 	GameState* gs = game_state();
-	int x, y, comp;
-	stbi_set_flip_vertically_on_load(1);
-	U8* data = stbi_load(name, &x, &y, &comp, 0);
-	Assert(data);
-	sg_range range = { data, x * y * 4 * sizeof(U8) };
+	AtlasID id = th_names_intern(&gs->atlas_names, name);
+	Assert(id == gs->atlas_count + 1); // atlas already loaded
+	TextureAtlas* atlas = TH_ARENA_ARRAY_PUSH(&gs->atlas_arena, gs->atlases, gs->atlas_count);
+	atlas->name = th_names_string(&gs->atlas_names, id);
+	return atlas;
+}
+
+static sg_image_desc th_texture_image_desc(S32 width, S32 height, const void* pixels) {
+	sg_range range = { pixels, (size_t)width * height * 4 * sizeof(U8) };
 	sg_image_desc desc = { 0 };
-	desc.width = x;
-	desc.height = y;
+	desc.width = width;
+	desc.height = height;
 	desc.data.subimage[0][0] = range;
-	TextureAtlas* atlas = TH_ARRAY_PUSH(gs->atlases, gs->atlas_count);
-	atlas->image = sg_make_image(desc);
-	strcpy(atlas->name, name);
-	stbi_image_free(data);
+	return desc;
+}
+
+// pixels are RGBA8, bottom row first, and only need to live until this returns
+static TextureAtlas* th_texture_atlas_create(const char* name, S32 width, S32 height, const void* pixels) {
+	TextureAtlas* atlas = th_texture_atlas_push(name);
+	atlas->image = sg_make_image(th_texture_image_desc(width, height, pixels));
+	atlas->width = width;
+	atlas->height = height;
+	atlas->status = AtlasStatus_ready;
+	return atlas;
+}
+
+// ASYNC LOADING
+// th_texture_atlas_load_async hands the decode to gs->image_loader and returns right away, the
+// atlas draws as placeholders until th_texture_uploads_pump gets its pixels onto the GPU.
+
+// runs on the decode threads
+static U8* th_texture_decode(const char* path, S32* width, S32* height) {
+	int comp;
+	stbi_set_flip_vertically_on_load_thread(1);
+	return stbi_load(path, width, height, &comp, 4);
+}
+
+static void th_texture_decode_free(U8* pixels) {
+	stbi_image_free(pixels);
+}
+
+static TextureAtlas* th_texture_atlas_load_async(const char* name) {
+	GameState* gs = game_state();
+	TextureAtlas* atlas = th_texture_atlas_push(name);
+	atlas->image = sg_alloc_image();
+	atlas->status = AtlasStatus_loading;
+	B8 queued = th_loader_submit(&gs->image_loader, atlas->name, gs->atlas_count);
+	Assert(queued); // raise TH_LOADER_QUEUE_SIZE or pump between submits
 	return atlas;
 }
 
+// Uploads finished decodes until budget bytes have gone out this frame. At least one always
+// goes, so an atlas bigger than the budget still gets through. A reload goes into the atlas's
+// existing sg_image, so anything holding the handle or a Sprite* never notices. Whatever the
+// image held before is destroyed first, GPU side included.
+static void th_texture_uploads_pump(U64 budget) {
+	GameState* gs = game_state();
+	U64 uploaded = 0;
+	const ImageLoad* load;
+	while ((load = th_loader_peek(&gs->image_loader))) {
+		U64 size = (U64)load->width * load->height * 4;
+		if (uploaded && uploaded + size > budget)
+			break;
+		TextureAtlas* atlas = th_texture_atlas_from_id(load->user);
+		// by the image, not the status: decodes finish in any order, so this can be a reload
+		// landing before the first load or a second decode of an atlas that already failed
+		B8 reload = sg_query_image_state(atlas->image) != SG_RESOURCESTATE_ALLOC;
+		if (load->pixels) {
+			if (reload)
+				sg_uninit_image(atlas->image); // back to allocated, same handle
+			Assert(sg_query_image_state(atlas->image) == SG_RESOURCESTATE_ALLOC);
+			sg_image_desc desc = th_texture_image_desc(load->width, load->height, load->pixels);
+			sg_init_image(atlas->image, &desc);
+			atlas->width = load->width;
+			atlas->height = load->height;
+			atlas->status = AtlasStatus_ready;
+			uploaded += size;
+		} else if (reload) {
+			LOG("failed to decode %s, keeping what it had", atlas->name); // probably caught mid-save
+		} else {
+			sg_fail_image(atlas->image);
+			atlas->status = AtlasStatus_failed;
+			LOG("failed to decode %s", atlas->name);
+		}
+		th_loader_pop(&gs->image_loader);
+	}
+}
+
+// decodes the source image again in the background, the old pixels stay up until it's done
+static void th_texture_atlas_reload(TextureAtlas* atlas) {
+	GameState* gs = game_state();
+	AtlasID id = (AtlasID)(atlas - gs->atlases) + 1;
+	if (!th_loader_submit(&gs->image_loader, atlas->name, id))
+		LOG("too many loads in flight, skipped reloading %s", atlas->name);
+}
+
 static sgp_rect range2_to_sgp_rect(Rng2F32 range) {
 	sgp_rect result = { 0 };
 	Vec2 size = Dim2F32(range);
@@ -271,25 +805,228 @@ static sgp_rect range2_to_sgp_rect(Rng2F32 range) {
 
 static Sprite* th_texture_sprite_create(TextureAtlas* atlas, const char* name, Rng2F32 sub_rect) {
 	GameState* gs = game_state();
-	Sprite* sprite = TH_ARRAY_PUSH(gs->sprites, gs->sprite_count);
+	SpriteID id = th_names_intern(&gs->sprite_names, name);
+	Assert(id == gs->sprite_count + 1); // sprite names are unique
+	Sprite* sprite = TH_ARENA_ARRAY_PUSH(&gs->sprite_arena, gs->sprites, gs->sprite_count);
 	sprite->atlas = atlas;
 	sprite->sub_rect = sub_rect;
-	strcpy(sprite->name, name);
+	sprite->name = th_names_string(&gs->sprite_names, id);
 	return sprite;
 }
 
+static SpriteID th_sprite_id(const char* name) {
+	GameState* gs = game_state();
+	SpriteID id = th_names_find(&gs->sprite_names, name);
+	Assert(id); // no sprite with that name
+	return id;
+}
+
+static Sprite* th_sprite_from_id(SpriteID id) {
+	GameState* gs = game_state();
+	Assert(id && id <= gs->sprite_count); // invalid sprite id
+	return &gs->sprites[id - 1];
+}
+
 static Sprite* th_texture_sprite_get(const char* name) {
+	return th_sprite_from_id(th_sprite_id(name));
+}
+
+static Archetype* th_archetype_from_id(ArchetypeID id) {
+	GameState* gs = game_state();
+	Assert(id && id <= gs->archetype_count); // invalid archetype id
+	return &gs->archetypes[id - 1];
+}
+
+static ArchetypeID th_archetype_id(const char* name) {
+	GameState* gs = game_state();
+	ArchetypeID id = th_names_find(&gs->archetype_names, name);
+	Assert(id); // no archetype with that name
+	return id;
+}
+
+// redefining an archetype updates it in place, entities already made from it don't change
+static void th_archetype_define(const char* name, SpriteID sprite, const ArchetypeParams* params) {
+	GameState* gs = game_state();
+	ArchetypeID id = th_names_intern(&gs->archetype_names, name);
+	if (id > gs->archetype_count)
+		TH_ARENA_ARRAY_PUSH(&gs->archetype_arena, gs->archetypes, gs->archetype_count);
+	Archetype* archetype = th_archetype_from_id(id);
+	archetype->name = th_names_string(&gs->archetype_names, id);
+	archetype->sprite = sprite;
+	archetype->params = *params;
+}
+
+static EmitterType* th_emitter_type_from_id(EmitterTypeID id) {
+	GameState* gs = game_state();
+	Assert(id && id <= gs->emitter_type_count); // invalid emitter type id
+	return &gs->emitter_types[id - 1];
+}
+
+static EmitterTypeID th_emitter_type_id(const char* name) {
+	GameState* gs = game_state();
+	EmitterTypeID id = th_names_find(&gs->emitter_type_names, name);
+	Assert(id); // no emitter type with that name
+	return id;
+}
+
+static void th_emitter_type_define(const char* name, const EmitterParams* params) {
+	GameState* gs = game_state();
+	EmitterTypeID id = th_names_intern(&gs->emitter_type_names, name);
+	if (id > gs->emitter_type_count)
+		TH_ARENA_ARRAY_PUSH(&gs->emitter_type_arena, gs->emitter_types, gs->emitter_type_count);
+	EmitterType* type = th_emitter_type_from_id(id);
+	type->name = th_names_string(&gs->emitter_type_names, id);
+	type->params = *params;
+}
+
+// one sim step's worth from every emitter. Only touches the particles and the emitters' own
+// streams, so it can run on any thread alongside the rest of the sim
+static void th_emitters_update(ParticleSystem* particles) {
 	GameState* gs = game_state();
-	for (int i = 0; i < gs->sprite_count; i++) {
-		Sprite* sprite = &gs->sprites[i];
-		if (strcmp(sprite->name, name) == 0) {
-			return sprite;
+	for (U32 i = 0; i < gs->emitter_count; i++) {
+		Emitter* emitter = &gs->emitters[i];
+		const EmitterParams* params = &th_emitter_type_from_id(emitter->type)->params;
+		// a fractional frequency emits one more that fraction of the time
+		F32 whole = floorf(params->frequency);
+		U32 amount = (U32)whole + (th_random_f32(&emitter->rng) < params->frequency - whole);
+		th_emitter_emit(particles, emitter, params, amount);
+	}
+}
+
+// Maps the baked pack and uploads every atlas straight from the mapped pages. Returns 0 if
+// there's no usable pack, the caller falls back to the source images.
+static B8 th_assets_load_pack(const char* path) {
+	MappedFile file;
+	if (!th_os_file_map(&file, path))
+		return 0;
+	PackView pack;
+	U32 archetype_count = 0;
+	U32 emitter_count = 0;
+	const PackArchetype* archetypes = 0;
+	const PackEmitter* emitters = 0;
+	B8 valid = th_pack_open(&pack, file.data, file.size);
+	if (valid) {
+		archetypes = (const PackArchetype*)th_pack_table(&pack, ASSET_TABLE_ARCHETYPES, sizeof(PackArchetype), &archetype_count);
+		emitters = (const PackEmitter*)th_pack_table(&pack, ASSET_TABLE_EMITTERS, sizeof(PackEmitter), &emitter_count);
+		valid = archetypes && emitters;
+	}
+	// th_pack_open doesn't know what the game's records mean, check those before using any
+	for (U32 i = 0; i < archetype_count && valid; i++) {
+		const PackArchetype* entry = &archetypes[i];
+		valid = entry->name < pack.header->string_size && entry->sprite <= pack.header->sprite_count &&
+			entry->params.shape < ArrayCount(asset_shape_names) && entry->params.behavior < ArchetypeBehavior_COUNT &&
+			th_archetype_friction_valid(entry->params.friction);
+	}
+	for (U32 i = 0; i < emitter_count && valid; i++)
+		valid = emitters[i].name < pack.header->string_size && emitters[i].params.area < ArrayCount(asset_emitter_area_names);
+	if (!valid) {
+		LOG("%s is out of date or corrupt, rebuild it with thomas_packer", path);
+		th_os_file_unmap(&file);
+		return 0;
+	}
+
+	// atlases may already be loaded, so map pack atlas indices to the ones we made
+	TempArena temp = th_temp_begin(&game_state()->frame_arena);
+	TextureAtlas** atlases = ArenaPushArray(temp.arena, TextureAtlas*, pack.header->atlas_count);
+	for (U32 i = 0; i < pack.header->atlas_count; i++) {
+		const PackAtlas* entry = &pack.atlases[i];
+		atlases[i] = th_texture_atlas_create(th_pack_string(&pack, entry->name), entry->width, entry->height, pack.base + entry->pixel_offset);
+	}
+	for (U32 i = 0; i < pack.header->sprite_count; i++) {
+		const PackSprite* entry = &pack.sprites[i];
+		th_texture_sprite_create(atlases[entry->atlas], th_pack_string(&pack, entry->name), entry->sub_rect);
+	}
+	for (U32 i = 0; i < archetype_count; i++) {
+		const PackArchetype* entry = &archetypes[i];
+		SpriteID sprite = entry->sprite ? th_sprite_id(th_pack_string(&pack, pack.sprites[entry->sprite - 1].name)) : 0;
+		th_archetype_define(th_pack_string(&pack, entry->name), sprite, &entry->params);
+	}
+	for (U32 i = 0; i < emitter_count; i++)
+		th_emitter_type_define(th_pack_string(&pack, emitters[i].name), &emitters[i].params);
+	th_temp_end(temp);
+	th_os_file_unmap(&file); // everything has been uploaded or interned
+	return 1;
+}
+
+// SOURCE ASSETS
+// Dev builds without a pack parse the definitions themselves, shipping builds can't.
+#ifndef TH_SHIP
+
+// Registers anything new and updates existing definitions in place, so Sprite* held by entities
+// stays valid. Anything that's no longer defined is left as it was.
+static void th_assets_apply_defs(const AssetDefs* defs) {
+	GameState* gs = game_state();
+	for (U32 i = 0; i < defs->atlas_count; i++) {
+		if (!th_names_find(&gs->atlas_names, defs->atlases[i]))
+			th_texture_atlas_load_async(defs->atlases[i]);
+	}
+	for (U32 i = 0; i < defs->sprite_count; i++) {
+		const SpriteDef* def = &defs->sprites[i];
+		TextureAtlas* atlas = th_texture_atlas_get(def->atlas);
+		SpriteID id = th_names_find(&gs->sprite_names, def->name);
+		if (!id) {
+			th_texture_sprite_create(atlas, def->name, def->sub_rect);
+			continue;
 		}
+		Sprite* sprite = th_sprite_from_id(id);
+		sprite->atlas = atlas;
+		sprite->sub_rect = def->sub_rect;
+	}
+	for (U32 i = 0; i < defs->archetype_count; i++) {
+		const ArchetypeDef* def = &defs->archetypes[i];
+		th_archetype_define(def->name, def->sprite ? th_sprite_id(def->sprite) : 0, &def->params);
 	}
-	Assert(0);
-	return 0;
+	for (U32 i = 0; i < defs->emitter_count; i++)
+		th_emitter_type_define(defs->emitters[i].name, &defs->emitters[i].params);
 }
 
+// every source image decodes in the background and shows up a few frames in. Returns 0 and
+// applies nothing if the definitions don't parse
+static B8 th_assets_load_sources() {
+	GameState* gs = game_state();
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	AssetDefs defs;
+	B8 ok = th_asset_defs_load(temp.arena, ASSET_DEFS_PATH, &defs);
+	if (ok)
+		th_assets_apply_defs(&defs);
+	th_temp_end(temp);
+	return ok;
+}
+
+// HOT RELOAD
+// Dev builds that loaded from the sources watch them. Changed atlases decode again in the
+// background and go into the same sg_image, changed definitions are applied in place.
+static void th_assets_watch() {
+	GameState* gs = game_state();
+	th_watch_init(&gs->asset_watch);
+	th_watch_add(&gs->asset_watch, ASSET_DEFS_PATH);
+	for (U32 i = 0; i < gs->atlas_count; i++)
+		th_watch_add(&gs->asset_watch, gs->atlases[i].name);
+	gs->hot_reload = 1;
+}
+
+static void th_assets_hot_reload() {
+	GameState* gs = game_state();
+	if (!gs->hot_reload)
+		return;
+	U32 changed[TH_WATCH_MAX_FILES];
+	U32 changed_count = th_watch_poll(&gs->asset_watch, changed, ArrayCount(changed));
+	for (U32 i = 0; i < changed_count; i++) {
+		const char* path = gs->asset_watch.files[changed[i]].path;
+		LOG("reloading %s", path);
+		if (strcmp(path, ASSET_DEFS_PATH) == 0) {
+			U32 atlas_count = gs->atlas_count;
+			th_assets_load_sources();
+			th_tilemap_invalidate(&gs->tilemap); // tiles may have moved in the atlas
+			for (U32 j = atlas_count; j < gs->atlas_count; j++)
+				th_watch_add(&gs->asset_watch, gs->atlases[j].name);
+		} else {
+			th_texture_atlas_reload(th_texture_atlas_get(path));
+		}
+	}
+}
+#endif
+
 // ENTITY HELPERS
 
 static void th_entity_set_bounds_from_sprite(Entity* entity) {
@@ -299,63 +1036,965 @@ static void th_entity_set_bounds_from_sprite(Entity* entity) {
 	entity->render_rect = entity->bounds;
 }
 
-static Entity* th_entity_create_plant() {
+// behaviors spawn entities and archetypes start behaviors, one of them has to come first
+static Entity* th_entity_create(ArchetypeID id);
+
+// BEHAVIORS
+// coroutines on world->behaviors, see th_coro.h. The entity can be destroyed while its behavior
+// sleeps, so look it up again after every wait.
+
+static void behavior_plant(mco_coro* co) {
+	U32 plant_id = th_coro_current()->owner;
+	Entity* plant = EntityFromID(plant_id);
+	if (!plant)
+		return;
+	const ArchetypeIDs* ids = &game_state()->archetype_ids;
+	Sprite* first_sprite = th_sprite_from_id(th_archetype_from_id(ids->plant)->sprite);
+	S8 stage = (S8)ClampTop(floorf(plant->plant_stage), (F32)PLANT_FINAL_STAGE);
+	plant->sprite = first_sprite + stage;
+	if (stage == PLANT_FINAL_STAGE)
+		return; // planted fully grown, nothing left to do
+
+	// plants can start part way through a stage. The schedule lives on the entity, so a
+	// behavior restarted by a snapshot load picks up where the saved one was
+	if (!plant->plant_next_stage_time)
+		plant->plant_next_stage_time = th_coro_current()->wake_time + (1.0f - (plant->plant_stage - stage)) * PLANT_STAGE_SECONDS;
+	while (stage < PLANT_FINAL_STAGE) {
+		th_coro_wait_until(plant->plant_next_stage_time);
+		plant = EntityFromID(plant_id);
+		if (!plant)
+			return;
+		plant->plant_next_stage_time = th_coro_current()->wake_time + PLANT_STAGE_SECONDS;
+		stage++;
+		plant->plant_stage = stage;
+		plant->sprite = first_sprite + stage;
+	}
+
+	// @tooling - some kind of handle information from the sprite? maybe like a red pixel, or create another layer on information on top? Ideally I'd like to have another application running in the background where I can author this data.
+	Entity* res_a = th_entity_create(ids->resource);
+	EntityPos(res_a) = EntityPos(plant) + Vec2(-4.0f, 13.0f);
+	EntitySetComponent(res_a, EntityComponent_rigid_body, 0);
+	EntitySetComponent(res_a, EntityComponent_collider, 0); // hangs off the plant until it's picked
+	Entity* res_b = th_entity_create(ids->resource);
+	EntityPos(res_b) = EntityPos(plant) + Vec2(6.0f, 36.0f);
+	EntitySetComponent(res_b, EntityComponent_rigid_body, 0);
+	EntitySetComponent(res_b, EntityComponent_collider, 0);
+}
+
+// ARCHETYPES
+// Entities are made from the archetypes in the definition files, the names there index these
+
+static const CoroFunc archetype_behaviors[] = { 0, behavior_plant };
+StaticAssert(ArrayCount(archetype_behaviors) == ArchetypeBehavior_COUNT, archetype_behaviors);
+StaticAssert(ArrayCount(asset_component_names) == EntityComponent_COUNT, asset_component_names);
+StaticAssert(ArrayCount(asset_shape_names) == EntityShape_capsule + 1, asset_shape_names);
+
+static Entity* th_entity_create(ArchetypeID id) {
 	WorldState* world = world_state();
+	const Archetype* archetype = th_archetype_from_id(id);
+	const ArchetypeParams* params = &archetype->params;
 	Entity* entity = EntityCreate();
-	entity->sprite = th_texture_sprite_get("plant0"); // first default
-	th_entity_set_bounds_from_sprite(entity);
-	entity->render = 1;
-	entity->plant = 1;
-	entity->col = TH_WHITE;
+	entity->archetype = id;
+	if (archetype->sprite) {
+		entity->sprite = th_sprite_from_id(archetype->sprite);
+		th_entity_set_bounds_from_sprite(entity);
+	} else {
+		entity->bounds = range2_center_bottom(Rng2F32(Vec2(0.0f, 0.0f), params->size));
+		entity->render_rect = entity->bounds;
+	}
+	for (int i = 0; i < EntityComponent_COUNT; i++) {
+		if (params->components & (1u << i))
+			EntitySetComponent(entity, (EntityComponent)i, 1);
+	}
+	entity->shape = (EntityShape)params->shape;
+	EntityFriction(entity) = params->friction; // whole and in a byte's range, defs and packs are checked for it
+	entity->col = params->col;
+	entity->seed = !!(params->flags & ArchetypeFlag_seed);
+	if (archetype_behaviors[params->behavior])
+		th_coro_start(&world->behaviors, archetype_behaviors[params->behavior], entity->id); // runs on the next update, after the caller has placed it
 	return entity;
 }
 
-function Entity* EntityCreateResource() {
-	WorldState* world = world_state();
+static void th_world_init(WorldState* world) {
+	const ArchetypeIDs* ids = &game_state()->archetype_ids;
+	th_random_seed(&world->rng, game_state()->seed, RandomStreamID_world);
+	world->player = th_entity_create(ids->player);
+	EntityPos(world->player).y = 100.0f;
+	th_entity_create(ids->seed); // starter seed
+	Entity* resource = th_entity_create(ids->resource); // test resource
+	EntityPos(resource).x = 100.0f;
+}
+
+// extra load on top of th_world_init, for soak tests and benchmarks
+static void th_world_populate(WorldState* world, U32 plant_count, U32 resource_count) {
+	RandomStream* rng = &world->rng;
+	for (U32 i = 0; i < plant_count; i++) {
+		Entity* plant = th_entity_create(game_state()->archetype_ids.plant);
+		EntityPos(plant).x = roundf(th_random_range(rng, -1000.f, 1000.f));
+		plant->plant_stage = th_random_range(rng, 0.f, 6.f);
+	}
+	for (U32 i = 0; i < resource_count; i++) {
+		Entity* resource = th_entity_create(game_state()->archetype_ids.resource);
+		F32 x = th_random_range(rng, -1000.f, 1000.f);
+		EntityPos(resource) = Vec2(x, th_random_range(rng, 0.f, 200.f));
+	}
+}
+
+// ENTITY RECORDS
+
+static EntityRecord th_entity_record(const Entity* entity) {
+	GameState* gs = game_state();
+	EntityRecord record;
+	MemoryZeroStruct(&record);
+	record.id = entity->id;
+	record.sprite = entity->sprite ? (SpriteID)(entity->sprite - gs->sprites) + 1 : 0;
+	record.archetype = entity->archetype;
+	record.shape = (U8)entity->shape;
+	record.x_dir = (S8)entity->x_dir;
+	record.x_friction_mult = (U8)EntityFriction(entity);
+	record.flags = entity->seed ? EntityRecordFlag_seed : 0;
+	record.pos = EntityPos(entity);
+	record.vel = EntityVel(entity);
+	record.acc = EntityAcc(entity);
+	record.bounds = entity->bounds;
+	record.render_rect = entity->render_rect;
+	record.col = entity->col;
+	record.plant_stage = entity->plant_stage;
+	for (U32 c = 0; c < EntityComponent_COUNT; c++) {
+		if (*EntityComponentFlag((Entity*)entity, (EntityComponent)c))
+			record.components |= 1u << c;
+	}
+	record.plant_next_stage_time = entity->plant_next_stage_time;
+	return record;
+}
+
+// everything but the id and the components, sprite and archetype already resolved by the caller
+static void th_entity_apply_record(Entity* entity, const EntityRecord* record, Sprite* sprite, ArchetypeID archetype) {
+	entity->sprite = sprite;
+	entity->archetype = archetype;
+	entity->shape = (EntityShape)record->shape;
+	entity->x_dir = record->x_dir;
+	EntityFriction(entity) = record->x_friction_mult;
+	entity->seed = !!(record->flags & EntityRecordFlag_seed);
+	EntityPos(entity) = record->pos;
+	entity->prev_pos = record->pos;
+	EntityVel(entity) = record->vel;
+	EntityAcc(entity) = record->acc;
+	entity->bounds = record->bounds;
+	entity->render_rect = record->render_rect;
+	entity->col = record->col;
+	entity->plant_stage = record->plant_stage;
+	entity->plant_next_stage_time = record->plant_next_stage_time;
+}
+
+// STREAMING
+// The world is cut into vertical chunks CHUNK_WIDTH wide. The ones around the camera are live and
+// simulate as usual. Entities anywhere else are destroyed and kept as records, grouped by chunk,
+// and cost nothing per step. When their chunk comes back they're created again, and anything that
+// would have happened in the meantime is worked out from the time that passed: plants jump to
+// the stage they'd have reached and their behaviors restart on the same schedule, so a farm that
+// was stored grows exactly like one that wasn't. Loose bodies stay where they were.
+
+static S32 th_chunk_from_x(F32 x) {
+	return (S32)floorf(x / CHUNK_WIDTH);
+}
+
+// position of the chunk in world->chunks, or where it would go
+static U32 th_world_chunk_search(const WorldState* world, S32 index) {
+	U32 low = 0;
+	U32 high = world->chunk_count;
+	while (low < high) {
+		U32 middle = (low + high) / 2;
+		if (world->chunks[middle].index < index)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// all the live records packed to the front again, in chunk order
+static void th_world_chunk_compact(WorldState* world) {
+	TempArena temp = th_temp_begin(&game_state()->frame_arena);
+	U32 live = world->chunk_record_count - world->chunk_record_dead;
+	EntityRecord* packed = ArenaPushArray(temp.arena, EntityRecord, live);
+	U32 at = 0;
+	for (U32 i = 0; i < world->chunk_count; i++) {
+		WorldChunk* chunk = &world->chunks[i];
+		memcpy(packed + at, world->chunk_records + chunk->first, sizeof(EntityRecord) * chunk->count);
+		chunk->first = at;
+		at += chunk->count;
+	}
+	memcpy(world->chunk_records, packed, sizeof(EntityRecord) * live);
+	th_arena_pop_to(&world->chunk_record_arena, sizeof(EntityRecord) * live);
+	world->chunk_record_count = live;
+	world->chunk_record_dead = 0;
+	th_temp_end(temp);
+}
+
+static void th_world_chunk_store(WorldState* world, const EntityRecord* record) {
+	S32 index = th_chunk_from_x(record->pos.x);
+	U32 at = th_world_chunk_search(world, index);
+	if (at == world->chunk_count || world->chunks[at].index != index) {
+		TH_ARENA_ARRAY_PUSH(&world->chunk_arena, world->chunks, world->chunk_count);
+		memmove(&world->chunks[at + 1], &world->chunks[at], sizeof(WorldChunk) * (world->chunk_count - 1 - at));
+		world->chunks[at].index = index;
+		world->chunks[at].first = world->chunk_record_count;
+		world->chunks[at].count = 0;
+	}
+	WorldChunk* chunk = &world->chunks[at];
+	if (chunk->first + chunk->count != world->chunk_record_count) {
+		// only the last run can grow in place, this one moves to the end and leaves a hole
+		U32 first = world->chunk_record_count;
+		for (U32 i = 0; i < chunk->count; i++) {
+			EntityRecord* moved = TH_ARENA_ARRAY_PUSH(&world->chunk_record_arena, world->chunk_records, world->chunk_record_count);
+			*moved = world->chunk_records[chunk->first + i];
+		}
+		world->chunk_record_dead += chunk->count;
+		chunk->first = first;
+	}
+	EntityRecord* stored = TH_ARENA_ARRAY_PUSH(&world->chunk_record_arena, world->chunk_records, world->chunk_record_count);
+	*stored = *record;
+	stored->id = 0;
+	chunk->count++;
+}
+
+// The stages a plant grew through while it was stored, all at once and on the same schedule its
+// behavior keeps. Stops one short of the last, the behavior still has to be the one that finishes
+// it and drops the resources
+static void th_plant_catch_up(Entity* plant, F64 now) {
+	S32 stage = (S32)floorf(plant->plant_stage);
+	if (!plant->plant_next_stage_time || stage >= PLANT_FINAL_STAGE - 1)
+		return;
+	if (plant->plant_next_stage_time > now)
+		return;
+	while (stage < PLANT_FINAL_STAGE - 1 && plant->plant_next_stage_time <= now) {
+		plant->plant_next_stage_time += PLANT_STAGE_SECONDS;
+		stage++;
+	}
+	plant->plant_stage = (F32)stage;
+	Sprite* first_sprite = th_sprite_from_id(th_archetype_from_id(game_state()->archetype_ids.plant)->sprite);
+	plant->sprite = first_sprite + stage;
+}
+
+static Entity* th_world_chunk_restore(WorldState* world, const EntityRecord* record) {
 	Entity* entity = EntityCreate();
-	entity->sprite = th_texture_sprite_get("resource1");
-	th_entity_set_bounds_from_sprite(entity);
-	entity->render = 1;
-	entity->interactable = 1;
-	entity->rigid_body = 1;
-	entity->x_friction_mult = 4.0f;
-	entity->col = TH_WHITE;
+	th_entity_apply_record(entity, record, record->sprite ? th_sprite_from_id(record->sprite) : 0, record->archetype);
+	for (U32 c = 0; c < EntityComponent_COUNT; c++) {
+		if (record->components & (1u << c))
+			EntitySetComponent(entity, (EntityComponent)c, 1);
+	}
+	if (!entity->archetype)
+		return entity;
+	CoroFunc behavior = archetype_behaviors[th_archetype_from_id(entity->archetype)->params.behavior];
+	if (!behavior)
+		return entity;
+	// a plant's behavior wakes when its next stage is due, like the one that was stopped would have
+	F64 wake_time = world->behaviors.time;
+	if (entity->plant) {
+		th_plant_catch_up(entity, world->behaviors.time);
+		if (entity->plant_next_stage_time)
+			wake_time = entity->plant_next_stage_time;
+	}
+	th_coro_start_at(&world->behaviors, behavior, entity->id, wake_time);
 	return entity;
 }
 
-static void th_world_init(WorldState* world) {
-	{
-		// player
-		Entity* entity = EntityCreate();
-		world->player = entity;
-		entity->sprite = th_texture_sprite_get("arcane_player");
-		th_entity_set_bounds_from_sprite(entity);
-		entity->pos.y = 100.0f;
-		entity->rigid_body = 1;
-		entity->render = 1;
-		entity->x_friction_mult = 15.0f;
-		entity->col = TH_WHITE;
+static void th_world_chunk_load(WorldState* world, S32 index) {
+	U32 at = th_world_chunk_search(world, index);
+	if (at == world->chunk_count || world->chunks[at].index != index)
+		return;
+	WorldChunk chunk = world->chunks[at];
+	memmove(&world->chunks[at], &world->chunks[at + 1], sizeof(WorldChunk) * (world->chunk_count - 1 - at));
+	world->chunk_count--;
+	th_arena_pop_to(&world->chunk_arena, sizeof(WorldChunk) * world->chunk_count);
+	for (U32 i = 0; i < chunk.count; i++)
+		th_world_chunk_restore(world, &world->chunk_records[chunk.first + i]);
+	if (chunk.first + chunk.count == world->chunk_record_count) {
+		world->chunk_record_count = chunk.first;
+		th_arena_pop_to(&world->chunk_record_arena, sizeof(EntityRecord) * world->chunk_record_count);
+	} else {
+		world->chunk_record_dead += chunk.count;
 	}
-	{
-		// starter seed
-		Entity* entity = EntityCreate();
-		entity->bounds.max = Vec2(2.0f, 2.0f);
-		entity->bounds = range2_center_bottom(entity->bounds);
-		entity->render = 1;
-		entity->interactable = 1;
-		entity->seed = 1;
-		//entity->rigid_body = 1;
-		entity->render_rect = entity->bounds;
-		entity->col = TH_WHITE;
-		// world->held_seed = entity;
+	if (world->chunk_record_dead > world->chunk_record_count / 2)
+		th_world_chunk_compact(world);
+}
+
+struct ChunkLeaver {
+	S32 chunk;
+	U32 dense; // ties keep the dense order, so storing is the same on every run
+	Entity* entity;
+};
+
+static int th_chunk_leaver_compare(const void* a, const void* b) {
+	const ChunkLeaver* x = (const ChunkLeaver*)a;
+	const ChunkLeaver* y = (const ChunkLeaver*)b;
+	if (x->chunk != y->chunk)
+		return x->chunk < y->chunk ? -1 : 1;
+	return x->dense < y->dense ? -1 : x->dense > y->dense;
+}
+
+static int th_entity_id_compare(const void* a, const void* b) {
+	U32 x = *(const U32*)a;
+	U32 y = *(const U32*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Keeps the chunks around center_x live and stores the rest. Chunks go live within
+// CHUNK_LOAD_RADIUS of center_x's and are only stored again once they're one further out, so
+// walking back and forth over a chunk edge doesn't churn. The player and whatever it's holding
+// are never stored. Anything that wanders out of the resident chunks is stored where it ends up.
+static void th_world_stream(WorldState* world, F32 center_x) {
+	TH_PROFILE_ZONE("stream");
+	S32 center = th_chunk_from_x(center_x);
+	S32 load_min = center - CHUNK_LOAD_RADIUS;
+	S32 load_max = center + CHUNK_LOAD_RADIUS;
+	S32 resident_min = load_min;
+	S32 resident_max = load_max;
+	B8 overlap = world->streaming && world->resident_max >= load_min - 1 && world->resident_min <= load_max + 1;
+	if (overlap) {
+		resident_min = Min(load_min, Max(world->resident_min, load_min - 1));
+		resident_max = Max(load_max, Min(world->resident_max, load_max + 1));
 	}
-	{
-		// test resource
-		Entity* entity = EntityCreateResource();
-		entity->pos.x = 100.0f;
+
+	GameState* gs = game_state();
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	ChunkLeaver* leavers = ArenaPushArray(temp.arena, ChunkLeaver, world->entity_dense_count);
+	U32 leaver_count = 0;
+	ForEachEntity(entity, world) {
+		S32 chunk = th_chunk_from_x(EntityPos(entity).x);
+		if (chunk >= resident_min && chunk <= resident_max)
+			continue;
+		if (entity == world->player || entity->id == world->held_entity_id)
+			continue;
+		leavers[leaver_count++] = { chunk, entity_dense_i, entity };
+	}
+	// one chunk after another, so each one's records go in as a single run
+	qsort(leavers, leaver_count, sizeof(ChunkLeaver), th_chunk_leaver_compare);
+	// their behaviors go with them, they'd only wake up to find the entity gone
+	U32* ids = ArenaPushArray(temp.arena, U32, leaver_count);
+	for (U32 i = 0; i < leaver_count; i++)
+		ids[i] = leavers[i].entity->id;
+	qsort(ids, leaver_count, sizeof(U32), th_entity_id_compare);
+	th_coro_cancel_owners(&world->behaviors, ids, leaver_count);
+	for (U32 i = 0; i < leaver_count; i++) {
+		Entity* entity = leavers[i].entity;
+		EntityRecord record = th_entity_record(entity);
+		if (entity->plant && !record.plant_next_stage_time && record.plant_stage < PLANT_FINAL_STAGE) {
+			// its behavior hasn't run yet, start the schedule it would have
+			F32 stage = floorf(record.plant_stage);
+			record.plant_next_stage_time = world->behaviors.time + (1.0f - (record.plant_stage - stage)) * PLANT_STAGE_SECONDS;
+		}
+		th_world_chunk_store(world, &record);
+		EntityDestroy(entity);
+	}
+	th_temp_end(temp);
+
+	for (S32 chunk = resident_min; chunk <= resident_max; chunk++) {
+		if (overlap && chunk >= world->resident_min && chunk <= world->resident_max)
+			continue; // was live already
+		th_world_chunk_load(world, chunk);
+	}
+	world->resident_min = resident_min;
+	world->resident_max = resident_max;
+	world->streaming = 1;
+}
+
+// TERRAIN
+// The ground under the world, drawn through gs->tilemap. It's only ever looked at, so it's not
+// part of the world or its snapshots: columns are generated from the seed the first time the
+// world streams in over them, and come out the same every time.
+
+static void th_terrain_init() {
+	GameState* gs = game_state();
+	th_tilemap_init(&gs->tilemap, &gs->permanent_arena, TERRAIN_TILE_SIZE);
+	gs->terrain_tiles.grass = th_tilemap_tile_add(&gs->tilemap, th_texture_sprite_get("ground_grass"));
+	gs->terrain_tiles.dirt = th_tilemap_tile_add(&gs->tilemap, th_texture_sprite_get("ground_dirt"));
+	gs->terrain_tiles.rocks = th_tilemap_tile_add(&gs->tilemap, th_texture_sprite_get("ground_rocks"));
+}
+
+static void th_terrain_generate_column(S32 column) {
+	GameState* gs = game_state();
+	RandomStream rng;
+	th_random_seed(&rng, gs->seed + (U64)(S64)column, RandomStreamID_terrain);
+	th_tilemap_set(&gs->tilemap, column, -1, gs->terrain_tiles.grass);
+	for (S32 row = -TERRAIN_DEPTH; row < -1; row++) {
+		B8 rocky = th_random_below(&rng, 8) == 0;
+		th_tilemap_set(&gs->tilemap, column, row, rocky ? gs->terrain_tiles.rocks : gs->terrain_tiles.dirt);
+	}
+}
+
+// the ground under every live chunk. Generates a tilemap chunk's worth of columns at a time,
+// one whose grass row has no chunk yet hasn't been generated
+static void th_terrain_update(const WorldState* world) {
+	GameState* gs = game_state();
+	if (!world->streaming)
+		return;
+	const F32 chunk_size = TERRAIN_TILE_SIZE * TH_TILEMAP_CHUNK_TILES;
+	S32 min = (S32)floorf(world->resident_min * CHUNK_WIDTH / chunk_size);
+	S32 max = (S32)floorf(((world->resident_max + 1) * CHUNK_WIDTH - 1.0f) / chunk_size);
+	for (S32 chunk_x = min; chunk_x <= max; chunk_x++) {
+		if (th_tilemap_chunk(&gs->tilemap, chunk_x, -1, 0))
+			continue;
+		for (S32 column = 0; column < TH_TILEMAP_CHUNK_TILES; column++)
+			th_terrain_generate_column(chunk_x * TH_TILEMAP_CHUNK_TILES + column);
+	}
+}
+
+// WORLD SNAPSHOTS
+// The world as a flat payload for th_snapshot.h. Sprites and archetypes are written by name and
+// looked up again on load, so a snapshot survives assets being added or reordered. Entity ids,
+// slot generations, the free list and every component list keep their order, so a loaded world
+// steps exactly like the one that was saved. Coroutine stacks can't be saved, only who was
+// sleeping until when: load restarts the owner's archetype behavior at that time, in the same
+// order, and a behavior keeps whatever else it needs to resume on its entity. Stored chunks go in
+// as they are, their records were made to outlive the entities.
+// Bump WORLD_SNAPSHOT_VERSION on any layout change, older snapshots are refused.
+//   header, sprite names, archetype names, slot generations, slot nexts, component lists,
+//   entity records in dense order, behaviors in resume order, stored chunks, their records
+
+#define WORLD_SNAPSHOT_VERSION 2
+
+struct WorldSnapshotHeader {
+	U32 version;
+	U32 record_size; // catches a record change that forgot the version
+	U32 sprite_name_count;
+	U32 archetype_name_count;
+	U32 slot_count;
+	U32 entity_count; // live ones, one record each
+	U32 free_head;
+	U32 player_id;
+	U32 held_entity_id;
+	U32 component_counts[EntityComponent_COUNT];
+	U32 behavior_count;
+	U32 streaming;
+	U32 chunk_count;
+	U32 chunk_record_count; // live ones, the holes aren't saved
+	S32 resident_min;
+	S32 resident_max;
+	F64 behavior_time;
+	RandomStream rng;
+};
+
+struct ChunkSnapshotRecord {
+	S32 index;
+	U32 count;
+};
+
+struct BehaviorRecord {
+	U32 owner;
+	U32 reserved;
+	F64 wake_time;
+};
+
+// names are null terminated and padded to 4 bytes, so the U32 tables after them stay aligned
+#define WORLD_SNAPSHOT_NAME_SIZE(length) (((U64)(length) + 4) & ~3ull)
+
+static void th_snapshot_write_name(Arena* arena, const char* name) {
+	U32 length = c_string_length(name);
+	th_snapshot_write_struct(arena, &length);
+	U64 size = WORLD_SNAPSHOT_NAME_SIZE(length);
+	U8* dest = (U8*)th_arena_push(arena, size, 1);
+	memcpy(dest, name, length);
+	memset(dest + length, 0, size - length);
+}
+
+// 0 if it's not a string this snapshot could have written
+static const char* th_snapshot_read_name(SnapshotReader* reader) {
+	U32 length = 0;
+	th_snapshot_read_struct(reader, &length);
+	const char* name = (const char*)th_snapshot_read_in_place(reader, WORLD_SNAPSHOT_NAME_SIZE(length));
+	return name && name[length] == 0 ? name : 0;
+}
+
+struct SnapshotNames {
+	U32* sprite_remap; // snapshot name index + 1 for every sprite and archetype in use
+	U32* archetype_remap;
+	SpriteID* sprites; // in first use order
+	ArchetypeID* archetypes;
+	U32 sprite_count;
+	U32 archetype_count;
+};
+
+static void th_snapshot_names_note(SnapshotNames* names, SpriteID sprite, ArchetypeID archetype) {
+	if (sprite && !names->sprite_remap[sprite]) {
+		names->sprites[names->sprite_count++] = sprite;
+		names->sprite_remap[sprite] = names->sprite_count;
+	}
+	if (archetype && !names->archetype_remap[archetype]) {
+		names->archetypes[names->archetype_count++] = archetype;
+		names->archetype_remap[archetype] = names->archetype_count;
 	}
 }
 
+// Appends the world to arena and returns the payload size. Scratch comes from the frame arena
+static U64 th_world_save(WorldState* world, Arena* arena) {
+	TH_PROFILE_ZONE("world save");
+	GameState* gs = game_state();
+	Assert(arena != &gs->frame_arena); // the scratch would be popped out from under the payload
+	U64 start = arena->pos;
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	SnapshotNames names;
+	MemoryZeroStruct(&names);
+	names.sprite_remap = ArenaPushArrayZero(temp.arena, U32, gs->sprite_count + 1);
+	names.archetype_remap = ArenaPushArrayZero(temp.arena, U32, gs->archetype_count + 1);
+	names.sprites = ArenaPushArray(temp.arena, SpriteID, gs->sprite_count);
+	names.archetypes = ArenaPushArray(temp.arena, ArchetypeID, gs->archetype_count);
+	ForEachEntity(entity, world)
+		th_snapshot_names_note(&names, entity->sprite ? (SpriteID)(entity->sprite - gs->sprites) + 1 : 0, entity->archetype);
+	for (U32 i = 0; i < world->chunk_count; i++) {
+		const WorldChunk* chunk = &world->chunks[i];
+		for (U32 r = chunk->first; r < chunk->first + chunk->count; r++)
+			th_snapshot_names_note(&names, world->chunk_records[r].sprite, world->chunk_records[r].archetype);
+	}
+
+	WorldSnapshotHeader header;
+	MemoryZeroStruct(&header);
+	header.version = WORLD_SNAPSHOT_VERSION;
+	header.record_size = sizeof(EntityRecord);
+	header.sprite_name_count = names.sprite_count;
+	header.archetype_name_count = names.archetype_count;
+	header.slot_count = world->entity_slot_count;
+	header.entity_count = world->entity_dense_count;
+	header.free_head = world->entity_free_head;
+	header.player_id = world->player ? world->player->id : 0;
+	header.held_entity_id = world->held_entity_id;
+	for (U32 c = 0; c < EntityComponent_COUNT; c++)
+		header.component_counts[c] = world->components[c].count;
+	Coro** coros;
+	U32 coro_count = th_coro_list(&world->behaviors, temp.arena, &coros);
+	header.behavior_count = coro_count;
+	header.streaming = world->streaming;
+	header.chunk_count = world->chunk_count;
+	header.chunk_record_count = world->chunk_record_count - world->chunk_record_dead;
+	header.resident_min = world->resident_min;
+	header.resident_max = world->resident_max;
+	header.behavior_time = world->behaviors.time;
+	header.rng = world->rng;
+	th_snapshot_write_struct(arena, &header);
+
+	for (U32 i = 0; i < names.sprite_count; i++)
+		th_snapshot_write_name(arena, th_sprite_from_id(names.sprites[i])->name);
+	for (U32 i = 0; i < names.archetype_count; i++)
+		th_snapshot_write_name(arena, th_archetype_from_id(names.archetypes[i])->name);
+
+	// slots as two columns, generations hardly ever change and delta to nothing
+	U32* generations = (U32*)th_arena_push(arena, sizeof(U32) * header.slot_count, 1);
+	U32* nexts = (U32*)th_arena_push(arena, sizeof(U32) * header.slot_count, 1);
+	for (U32 i = 0; i < header.slot_count; i++) {
+		memcpy(&generations[i], &world->entity_slots[i].generation, sizeof(U32));
+		memcpy(&nexts[i], &world->entity_slots[i].next, sizeof(U32));
+	}
+	for (U32 c = 0; c < EntityComponent_COUNT; c++)
+		th_snapshot_write(arena, world->components[c].slots, sizeof(U32) * world->components[c].count);
+
+	U8* records = (U8*)th_arena_push(arena, sizeof(EntityRecord) * header.entity_count, 1);
+	ForEachEntity(entity, world) {
+		EntityRecord record = th_entity_record(entity);
+		record.sprite = names.sprite_remap[record.sprite];
+		record.archetype = names.archetype_remap[record.archetype];
+		memcpy(records + sizeof(EntityRecord) * entity_dense_i, &record, sizeof(record));
+	}
+
+	U8* behaviors = (U8*)th_arena_push(arena, sizeof(BehaviorRecord) * coro_count, 1);
+	for (U32 i = 0; i < coro_count; i++) {
+		BehaviorRecord record;
+		MemoryZeroStruct(&record);
+		record.owner = coros[i]->owner;
+		record.wake_time = coros[i]->wake_time;
+		memcpy(behaviors + sizeof(BehaviorRecord) * i, &record, sizeof(record));
+	}
+
+	U8* chunks = (U8*)th_arena_push(arena, sizeof(ChunkSnapshotRecord) * header.chunk_count, 1);
+	U8* chunk_records = (U8*)th_arena_push(arena, sizeof(EntityRecord) * header.chunk_record_count, 1);
+	U32 at = 0;
+	for (U32 i = 0; i < world->chunk_count; i++) {
+		const WorldChunk* chunk = &world->chunks[i];
+		ChunkSnapshotRecord chunk_record = { chunk->index, chunk->count };
+		memcpy(chunks + sizeof(ChunkSnapshotRecord) * i, &chunk_record, sizeof(chunk_record));
+		for (U32 r = chunk->first; r < chunk->first + chunk->count; r++) {
+			EntityRecord record = world->chunk_records[r];
+			record.sprite = names.sprite_remap[record.sprite];
+			record.archetype = names.archetype_remap[record.archetype];
+			memcpy(chunk_records + sizeof(EntityRecord) * at++, &record, sizeof(record));
+		}
+	}
+	th_temp_end(temp);
+	return arena->pos - start;
+}
+
+// Replaces the world with the snapshot. Everything is checked before the world is touched, a
+// damaged or foreign payload returns 0 and leaves the current world running. Sprites and
+// archetypes that are gone now are dropped from the entities that used them.
+static B8 th_world_load(WorldState* world, const U8* data, U64 size) {
+	TH_PROFILE_ZONE("world load");
+	GameState* gs = game_state();
+	Assert(((U64)data & 3) == 0); // the slot and component tables are read in place
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	SnapshotReader reader = th_snapshot_reader(data, size);
+	WorldSnapshotHeader header;
+	th_snapshot_read_struct(&reader, &header);
+	// counts can't ask for more than the payload holds, scratch is sized from them before the reads
+	// that would have caught it
+	B8 sane = !reader.failed && header.version == WORLD_SNAPSHOT_VERSION && header.record_size == sizeof(EntityRecord);
+	sane = sane && header.slot_count <= ENTITY_INDEX_MASK && header.entity_count <= header.slot_count;
+	sane = sane && (U64)header.sprite_name_count + header.archetype_name_count <= size / 8;
+	sane = sane && (U64)header.slot_count <= size / 8;
+	sane = sane && header.streaming <= 1 && header.resident_min <= header.resident_max;
+	sane = sane && (U64)header.chunk_count <= size / 8;
+	if (!sane) {
+		th_temp_end(temp);
+		return 0;
+	}
+
+	SpriteID* sprites = ArenaPushArrayZero(temp.arena, SpriteID, header.sprite_name_count + 1);
+	for (U32 i = 0; i < header.sprite_name_count && !reader.failed; i++) {
+		const char* name = th_snapshot_read_name(&reader);
+		if (!name)
+			reader.failed = 1;
+		else if (!(sprites[i + 1] = th_names_find(&gs->sprite_names, name)))
+			LOG("snapshot sprite %s is gone", name);
+	}
+	ArchetypeID* archetypes = ArenaPushArrayZero(temp.arena, ArchetypeID, header.archetype_name_count + 1);
+	for (U32 i = 0; i < header.archetype_name_count && !reader.failed; i++) {
+		const char* name = th_snapshot_read_name(&reader);
+		if (!name)
+			reader.failed = 1;
+		else if (!(archetypes[i + 1] = th_names_find(&gs->archetype_names, name)))
+			LOG("snapshot archetype %s is gone", name);
+	}
+	const U32* generations = (const U32*)th_snapshot_read_in_place(&reader, sizeof(U32) * header.slot_count);
+	const U32* nexts = (const U32*)th_snapshot_read_in_place(&reader, sizeof(U32) * header.slot_count);
+	const U32* component_slots[EntityComponent_COUNT];
+	for (U32 c = 0; c < EntityComponent_COUNT; c++)
+		component_slots[c] = (const U32*)th_snapshot_read_in_place(&reader, sizeof(U32) * header.component_counts[c]);
+	const U8* records = (const U8*)th_snapshot_read_in_place(&reader, sizeof(EntityRecord) * header.entity_count);
+	const U8* behaviors = (const U8*)th_snapshot_read_in_place(&reader, sizeof(BehaviorRecord) * (U64)header.behavior_count);
+	const U8* chunks = (const U8*)th_snapshot_read_in_place(&reader, sizeof(ChunkSnapshotRecord) * (U64)header.chunk_count);
+	const U8* chunk_records = (const U8*)th_snapshot_read_in_place(&reader, sizeof(EntityRecord) * (U64)header.chunk_record_count);
+	B8 ok = !reader.failed && reader.at == size;
+
+	// the tables have to describe a world EntityCreate could have made
+	U32* dense_of_slot = ArenaPushArray(temp.arena, U32, header.slot_count);
+	for (U32 i = 0; ok && i < header.slot_count; i++)
+		dense_of_slot[i] = ENTITY_NIL_INDEX;
+	for (U32 d = 0; ok && d < header.entity_count; d++) {
+		EntityRecord record;
+		memcpy(&record, records + sizeof(EntityRecord) * d, sizeof(record));
+		U32 index = EntityIndexFromID(record.id);
+		ok = index < header.slot_count && dense_of_slot[index] == ENTITY_NIL_INDEX;
+		ok = ok && (record.id >> ENTITY_INDEX_BITS) == generations[index] && generations[index];
+		ok = ok && record.sprite <= header.sprite_name_count && record.archetype <= header.archetype_name_count;
+		ok = ok && record.shape <= EntityShape_capsule;
+		if (ok)
+			dense_of_slot[index] = d;
+	}
+	U32 free_count = 0;
+	for (U32 index = header.free_head; ok && index != ENTITY_NIL_INDEX; index = nexts[index]) {
+		// dead slots only, and each of them once, so the walk can't loop
+		ok = index < header.slot_count && dense_of_slot[index] == ENTITY_NIL_INDEX && free_count++ < header.slot_count;
+		if (ok)
+			dense_of_slot[index] = ENTITY_NIL_INDEX - 1;
+	}
+	ok = ok && free_count + header.entity_count == header.slot_count;
+	// stored chunks sorted, none of them empty or resident, and their records have to fill them exactly
+	U64 chunk_record_total = 0;
+	for (U32 i = 0; ok && i < header.chunk_count; i++) {
+		ChunkSnapshotRecord chunk;
+		memcpy(&chunk, chunks + sizeof(ChunkSnapshotRecord) * i, sizeof(chunk));
+		ChunkSnapshotRecord previous = { 0, 0 };
+		if (i)
+			memcpy(&previous, chunks + sizeof(ChunkSnapshotRecord) * (i - 1), sizeof(previous));
+		ok = chunk.count && (!i || previous.index < chunk.index);
+		ok = ok && (!header.streaming || chunk.index < header.resident_min || chunk.index > header.resident_max);
+		chunk_record_total += chunk.count;
+	}
+	ok = ok && chunk_record_total == header.chunk_record_count;
+	for (U32 r = 0; ok && r < header.chunk_record_count; r++) {
+		EntityRecord record;
+		memcpy(&record, chunk_records + sizeof(EntityRecord) * r, sizeof(record));
+		ok = record.sprite <= header.sprite_name_count && record.archetype <= header.archetype_name_count;
+		ok = ok && record.shape <= EntityShape_capsule && record.components < (1u << EntityComponent_COUNT);
+	}
+	for (U32 c = 0; ok && c < EntityComponent_COUNT; c++) {
+		for (U32 i = 0; ok && i < header.component_counts[c]; i++) {
+			U32 index = component_slots[c][i];
+			ok = index < header.slot_count && dense_of_slot[index] < header.entity_count;
+		}
+	}
+	if (!ok) {
+		th_temp_end(temp);
+		return 0;
+	}
+
+	// the arrays own their arenas, so after the clear each one goes in with a single push
+	th_world_clear(world);
+	th_arena_push_zero(&world->entity_arena, sizeof(Entity) * header.slot_count, 1);
+	th_arena_push(&world->entity_slot_arena, sizeof(EntitySlot) * header.slot_count, 1);
+	th_arena_push(&world->entity_dense_arena, sizeof(U32) * header.entity_count, 1);
+	world->entity_count = header.slot_count;
+	world->entity_slot_count = header.slot_count;
+	world->entity_dense_count = header.entity_count;
+	for (U32 i = 0; i < header.slot_count; i++) {
+		EntitySlot* slot = &world->entity_slots[i];
+		memcpy(&slot->generation, &generations[i], sizeof(U32));
+		memcpy(&slot->next, &nexts[i], sizeof(U32));
+		for (U32 c = 0; c < EntityComponent_COUNT; c++)
+			slot->component_index[c] = ENTITY_NIL_INDEX;
+	}
+	world->entity_free_head = header.free_head;
+	for (U32 d = 0; d < header.entity_count; d++) {
+		EntityRecord record;
+		memcpy(&record, records + sizeof(EntityRecord) * d, sizeof(record));
+		U32 index = EntityIndexFromID(record.id);
+		world->entity_dense[d] = index;
+		world->entity_slots[index].next = d;
+		Entity* entity = &world->entities[index];
+		entity->id = record.id;
+		th_entity_apply_record(entity, &record, sprites[record.sprite] ? th_sprite_from_id(sprites[record.sprite]) : 0, archetypes[record.archetype]);
+	}
+	for (U32 c = 0; c < EntityComponent_COUNT; c++) {
+		ComponentList* list = &world->components[c];
+		list->count = header.component_counts[c];
+		th_arena_push(&list->arena, sizeof(U32) * list->count, 1);
+		memcpy(list->slots, component_slots[c], sizeof(U32) * list->count);
+		for (U32 i = 0; i < list->count; i++) {
+			U32 index = list->slots[i];
+			world->entity_slots[index].component_index[c] = i;
+			if (c == EntityComponent_rigid_body)
+				th_rigid_body_push(&world->bodies, i, &world->entities[index]);
+			*EntityComponentFlag(&world->entities[index], (EntityComponent)c) = 1;
+		}
+	}
+	world->player = EntityFromID(header.player_id);
+	world->held_entity_id = header.held_entity_id;
+	world->rng = header.rng;
+	world->behaviors.time = header.behavior_time;
+	for (U32 i = 0; i < header.behavior_count; i++) {
+		BehaviorRecord record;
+		memcpy(&record, behaviors + sizeof(BehaviorRecord) * i, sizeof(record));
+		Entity* owner = EntityFromID(record.owner);
+		if (!owner || !owner->archetype)
+			continue; // its entity is gone, the behavior would have found that out and ended
+		CoroFunc behavior = archetype_behaviors[th_archetype_from_id(owner->archetype)->params.behavior];
+		if (behavior)
+			th_coro_start_at(&world->behaviors, behavior, owner->id, record.wake_time);
+	}
+	th_arena_push(&world->chunk_arena, sizeof(WorldChunk) * header.chunk_count, 1);
+	th_arena_push(&world->chunk_record_arena, sizeof(EntityRecord) * header.chunk_record_count, 1);
+	world->chunk_count = header.chunk_count;
+	world->chunk_record_count = header.chunk_record_count;
+	U32 first = 0;
+	for (U32 i = 0; i < header.chunk_count; i++) {
+		ChunkSnapshotRecord chunk;
+		memcpy(&chunk, chunks + sizeof(ChunkSnapshotRecord) * i, sizeof(chunk));
+		world->chunks[i].index = chunk.index;
+		world->chunks[i].first = first;
+		world->chunks[i].count = chunk.count;
+		first += chunk.count;
+	}
+	for (U32 r = 0; r < header.chunk_record_count; r++) {
+		EntityRecord* record = &world->chunk_records[r];
+		memcpy(record, chunk_records + sizeof(EntityRecord) * r, sizeof(*record));
+		record->sprite = sprites[record->sprite];
+		record->archetype = archetypes[record->archetype];
+	}
+	world->streaming = (B8)header.streaming;
+	world->resident_min = header.resident_min;
+	world->resident_max = header.resident_max;
+	th_temp_end(temp);
+	return 1;
+}
+
+// the newest autosave, keyframe plus delta. 0 if there isn't a usable one
+static B8 th_world_load_file(WorldState* world, const char* path) {
+	GameState* gs = game_state();
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	U64 size;
+	U8* payload = th_snapshot_load(temp.arena, path, &size);
+	B8 ok = payload && th_world_load(world, payload, size);
+	th_temp_end(temp);
+	return ok;
+}
+
+// Copies the world into the autosave's staging and hands it to the saver thread. Skipped, and
+// 0, if the last one is still being written
+static B8 th_world_autosave(WorldState* world, B8 keyframe = 0) {
+	GameState* gs = game_state();
+	Arena* staging = th_snapshot_saver_begin(&gs->autosave);
+	if (!staging)
+		return 0;
+	th_world_save(world, staging);
+	th_snapshot_saver_submit(&gs->autosave, keyframe);
+	return 1;
+}
+
+// SESSIONS
+// The world snapshot plus the rest of GameState the sim reads: a replay starts from one of these
+// and has to end in the same one it was recorded into. Bump SESSION_VERSION on any layout change.
+//   header, emitters (type name, then the record), particle columns, world snapshot
+
+#define SESSION_VERSION 2
+#define SESSION_PARTICLE_COLUMNS 12
+
+struct SessionHeader {
+	U32 version;
+	U32 emitter_count;
+	U32 particle_count;
+	U32 reserved;
+	U64 seed;
+	U64 sim_tick;
+	F64 sim_accumulator;
+	Camera cam;
+};
+
+struct EmitterRecord {
+	Vec2 pos;
+	RandomStream rng;
+};
+
+// every column is 4 bytes a particle
+static void th_session_particle_columns(ParticleSystem* particles, void** columns) {
+	void* all[SESSION_PARTICLE_COLUMNS] = {
+		particles->pos_x, particles->pos_y, particles->vel_x, particles->vel_y,
+		particles->col_r, particles->col_g, particles->col_b, particles->col_a,
+		particles->life, particles->start_life, particles->size, particles->flags,
+	};
+	memcpy(columns, all, sizeof(all));
+}
+
+// appends the session to arena and returns its size, same rules as th_world_save
+static U64 th_session_save(Arena* arena) {
+	GameState* gs = game_state();
+	U64 start = arena->pos;
+	SessionHeader header;
+	MemoryZeroStruct(&header);
+	header.version = SESSION_VERSION;
+	header.emitter_count = gs->emitter_count;
+	header.particle_count = gs->particles.count;
+	header.seed = gs->seed;
+	header.sim_tick = gs->sim_tick;
+	header.sim_accumulator = gs->sim_accumulator;
+	header.cam = gs->cam;
+	th_snapshot_write_struct(arena, &header);
+	for (U32 i = 0; i < gs->emitter_count; i++) {
+		const Emitter* emitter = &gs->emitters[i];
+		th_snapshot_write_name(arena, th_emitter_type_from_id(emitter->type)->name);
+		EmitterRecord record;
+		MemoryZeroStruct(&record);
+		record.pos = emitter->pos;
+		record.rng = emitter->rng;
+		th_snapshot_write_struct(arena, &record);
+	}
+	void* columns[SESSION_PARTICLE_COLUMNS];
+	th_session_particle_columns(&gs->particles, columns);
+	for (U32 c = 0; c < SESSION_PARTICLE_COLUMNS; c++)
+		th_snapshot_write(arena, columns[c], sizeof(F32) * gs->particles.count);
+	th_world_save(world_state(), arena);
+	return arena->pos - start;
+}
+
+// 0, with nothing changed, if it's not a session this build could have saved
+static B8 th_session_load(const U8* data, U64 size) {
+	GameState* gs = game_state();
+	SnapshotReader reader = th_snapshot_reader(data, size);
+	SessionHeader header;
+	th_snapshot_read_struct(&reader, &header);
+	B8 ok = !reader.failed && header.version == SESSION_VERSION;
+	ok = ok && header.emitter_count + 1 < ArrayCount(gs->emitters) && header.particle_count <= gs->particles.capacity;
+	if (!ok)
+		return 0;
+	EmitterTypeID types[ArrayCount(gs->emitters)];
+	EmitterRecord emitters[ArrayCount(gs->emitters)];
+	for (U32 i = 0; i < header.emitter_count && !reader.failed; i++) {
+		const char* name = th_snapshot_read_name(&reader);
+		if (!name || !(types[i] = th_names_find(&gs->emitter_type_names, name)))
+			reader.failed = 1;
+		th_snapshot_read_struct(&reader, &emitters[i]);
+	}
+	const U8* particles = (const U8*)th_snapshot_read_in_place(&reader, sizeof(F32) * header.particle_count * SESSION_PARTICLE_COLUMNS);
+	if (reader.failed || !th_world_load(world_state(), reader.data + reader.at, reader.size - reader.at))
+		return 0;
+
+	gs->emitter_count = header.emitter_count;
+	for (U32 i = 0; i < header.emitter_count; i++) {
+		gs->emitters[i].type = types[i];
+		gs->emitters[i].pos = emitters[i].pos;
+		gs->emitters[i].rng = emitters[i].rng;
+	}
+	gs->particles.count = header.particle_count;
+	void* columns[SESSION_PARTICLE_COLUMNS];
+	th_session_particle_columns(&gs->particles, columns);
+	for (U32 c = 0; c < SESSION_PARTICLE_COLUMNS; c++)
+		memcpy(columns[c], particles + sizeof(F32) * header.particle_count * c, sizeof(F32) * header.particle_count);
+	gs->seed = header.seed;
+	gs->sim_tick = header.sim_tick;
+	gs->sim_accumulator = header.sim_accumulator;
+	gs->sim_alpha = (F32)(gs->sim_accumulator / SIM_DT);
+	gs->cam = header.cam;
+	return 1;
+}
+
+// INPUT
+// What event() leaves in GameState for the next frame, in one place so a replay can record it
+// and put it back. Scrolling zooms the camera right in the event, so the scale counts as input.
+
+struct InputState {
+	B8 key_down[SAPP_KEYCODE_MENU];
+	B8 key_pressed[SAPP_KEYCODE_MENU];
+	B8 key_released[SAPP_KEYCODE_MENU];
+	B8 mouse_down[SAPP_MOUSEBUTTON_MIDDLE];
+	B8 mouse_pressed[SAPP_MOUSEBUTTON_MIDDLE];
+	B8 mouse_released[SAPP_MOUSEBUTTON_MIDDLE];
+	Vec2 mouse_pos;
+	Vec2 window_size;
+	F32 cam_scale;
+};
+
+static void th_input_capture(InputState* input) {
+	GameState* gs = game_state();
+	MemoryZeroStruct(input); // padding too, the recorder diffs the bytes
+	memcpy(input->key_down, gs->key_down, sizeof(input->key_down));
+	memcpy(input->key_pressed, gs->key_pressed, sizeof(input->key_pressed));
+	memcpy(input->key_released, gs->key_released, sizeof(input->key_released));
+	memcpy(input->mouse_down, gs->mouse_down, sizeof(input->mouse_down));
+	memcpy(input->mouse_pressed, gs->mouse_pressed, sizeof(input->mouse_pressed));
+	memcpy(input->mouse_released, gs->mouse_released, sizeof(input->mouse_released));
+	input->mouse_pos = gs->mouse_pos;
+	input->window_size = gs->window_size;
+	input->cam_scale = gs->cam.scale;
+}
+
+static void th_input_apply(const InputState* input) {
+	GameState* gs = game_state();
+	memcpy(gs->key_down, input->key_down, sizeof(input->key_down));
+	memcpy(gs->key_pressed, input->key_pressed, sizeof(input->key_pressed));
+	memcpy(gs->key_released, input->key_released, sizeof(input->key_released));
+	memcpy(gs->mouse_down, input->mouse_down, sizeof(input->mouse_down));
+	memcpy(gs->mouse_pressed, input->mouse_pressed, sizeof(input->mouse_pressed));
+	memcpy(gs->mouse_released, input->mouse_released, sizeof(input->mouse_released));
+	gs->mouse_pos = input->mouse_pos;
+	gs->window_size = input->window_size;
+	gs->cam.scale = input->cam_scale;
+}
+
+// RECORDING
+// Starts from the session as it is now, tick() adds a frame each time it runs until the stop
+
+// 0 if the path is too long to record to
+static B8 th_recording_start(const char* path) {
+	GameState* gs = game_state();
+	th_session_save(th_replay_payload(&gs->recorder));
+	return th_replay_record_begin(&gs->recorder, path, sizeof(InputState));
+}
+
+// 0 if the replay didn't make it to disk
+static B8 th_recording_stop() {
+	GameState* gs = game_state();
+	th_session_save(th_replay_payload(&gs->recorder));
+	return th_replay_record_end(&gs->recorder);
+}
+
 static void sgp_draw_debug_rect_lines(Rng2F32 rect) {
 	sgp_draw_line(rect.min.x, rect.min.y, rect.min.x, rect.max.y);
 	sgp_draw_line(rect.min.x, rect.min.y, rect.max.x, rect.min.y);
@@ -365,8 +2004,423 @@ static void sgp_draw_debug_rect_lines(Rng2F32 rect) {
 
 static Rng2F32 EntityBoundsInWorld(const Entity* entity) {
 	Rng2F32 result = entity->bounds;
-	result = Shift2F32(result, entity->pos);
+	result = Shift2F32(result, EntityPos(entity));
 	return result;
 }
 
-#endif
\ No newline at end of file
+// where to draw the entity this frame, between its last two sim states
+static Vec2 th_entity_render_pos(const Entity* entity, F32 alpha) {
+	Vec2 pos = EntityPos(entity);
+	if (!entity->frame.interpolate)
+		return pos;
+	return entity->prev_pos + (pos - entity->prev_pos) * alpha;
+}
+
+// the area in front of the player that can pick things up, shared by the sim and the debug draw
+static Rng2F32 th_player_interact_rect(const Entity* player) {
+	Rng2F32 interact_rect = { 0 };
+	interact_rect.max = Vec2(20, 20);
+	if (player->x_dir == -1)
+		interact_rect = Flip2F32(interact_rect);
+	//interact_rect = range2_center_left(interact_rect);
+	interact_rect = Shift2F32(interact_rect, EntityPos(player));
+	return interact_rect;
+}
+
+// BROADPHASE
+
+struct EntityArray {
+	Entity** entities;
+	U32 count;
+};
+
+static void th_broadphase_build(WorldState* world) {
+	th_arena_clear(&world->broadphase_arena);
+	th_spatial_begin(&world->broadphase, &world->broadphase_arena, BROADPHASE_CELL_SIZE, world->entity_dense_count);
+	ForEachEntity(entity, world) {
+		th_spatial_insert(&world->broadphase, entity->id, EntityBoundsInWorld(entity));
+	}
+	th_spatial_finish(&world->broadphase, &world->broadphase_arena);
+}
+
+// every entity whose bounds overlapped region as of the last broadphase build.
+// Entities destroyed since then are skipped, ones that moved are reported where they were.
+static EntityArray th_world_query_region(WorldState* world, Rng2F32 region, Arena* arena) {
+	EntityArray result = { 0 };
+	U32 id_count = 0;
+	U32* ids = th_spatial_query(&world->broadphase, region, arena, &id_count);
+	result.entities = ArenaPushArray(arena, Entity*, id_count);
+	for (U32 i = 0; i < id_count; i++) {
+		Entity* entity = EntityFromID(ids[i]);
+		if (entity)
+			result.entities[result.count++] = entity;
+	}
+	return result;
+}
+
+// PHYSICS
+
+// branch-free so the compiler can vectorise it, over the packed bodies in place
+static void th_rigid_body_integrate_range(RigidBodies* bodies, U32 begin, U32 end, F32 delta_t) {
+	Vec2* __restrict pos = bodies->pos;
+	Vec2* __restrict vel = bodies->vel;
+	Vec2* __restrict acc = bodies->acc;
+	const F32* __restrict friction = bodies->friction;
+	const F32 half_dt_sq = 0.5f * SQUARE(delta_t);
+
+	for (U32 i = begin; i < end; i++) {
+		F32 ax = acc[i].x - friction[i] * vel[i].x;
+		F32 ay = acc[i].y - (vel[i].y < 0.f ? 2.f * GRAVITY : GRAVITY);
+
+		F32 next_x = ax * half_dt_sq + vel[i].x * delta_t + pos[i].x;
+		F32 next_y = ay * half_dt_sq + vel[i].y * delta_t + pos[i].y;
+		F32 next_vel_y = vel[i].y + ay * delta_t;
+
+		B8 grounded = next_y < 0.f;
+		pos[i].x = next_x;
+		pos[i].y = grounded ? 0.f : next_y;
+		vel[i].x += ax * delta_t;
+		vel[i].y = grounded ? 0.f : next_vel_y;
+		acc[i].x = 0.f;
+		acc[i].y = 0.f;
+	}
+}
+
+struct RigidBodyJob {
+	RigidBodies* bodies;
+	F32 delta_t;
+};
+
+static void th_rigid_body_integrate_job(void* data, U32 begin, U32 end) {
+	RigidBodyJob* job = (RigidBodyJob*)data;
+	th_rigid_body_integrate_range(job->bodies, begin, end, job->delta_t);
+}
+
+static void th_physics_step(WorldState* world, F32 delta_t) {
+	RigidBodyJob job = { &world->bodies, delta_t };
+	U32 count = world->components[EntityComponent_rigid_body].count;
+	th_jobs_parallel_for_wait("rigid bodies", count, PHYSICS_JOB_GRAIN, th_rigid_body_integrate_job, &job);
+}
+
+// COLLISION
+// Colliders are found through the broadphase, narrowphase is cute_c2. Overlaps are pushed
+// apart along the manifold normal, split by mass, and the closing velocity is removed.
+// A few passes over the pair list let stacks settle. Entities without a rigid body are static.
+
+struct ColliderShape {
+	C2_TYPE type;
+	union {
+		c2AABB aabb;
+		c2Capsule capsule;
+	};
+};
+
+// A collider as the step sees it. pos and vel point at the live state (EntityPos / EntityVel),
+// looked up once per step, nothing gets added or removed while collisions resolve.
+struct CollisionBody {
+	Entity* entity;
+	Vec2* pos;
+	Vec2* vel;
+	F32 inv_mass;
+};
+
+// indices into the step's CollisionBody array
+struct CollisionPair {
+	U32 a;
+	U32 b;
+};
+
+static ColliderShape th_entity_collider_shape(const Entity* entity, Vec2 pos) {
+	ColliderShape result;
+	Rng2F32 bounds = Shift2F32(entity->bounds, pos);
+	if (entity->shape == EntityShape_capsule) {
+		Vec2 dim = Dim2F32(bounds);
+		Vec2 center = Center2F32(bounds);
+		result.type = C2_TYPE_CAPSULE;
+		if (dim.y >= dim.x) {
+			F32 r = dim.x * 0.5f;
+			result.capsule.a = c2V(center.x, bounds.min.y + r);
+			result.capsule.b = c2V(center.x, bounds.max.y - r);
+			result.capsule.r = r;
+		} else {
+			F32 r = dim.y * 0.5f;
+			result.capsule.a = c2V(bounds.min.x + r, center.y);
+			result.capsule.b = c2V(bounds.max.x - r, center.y);
+			result.capsule.r = r;
+		}
+	} else {
+		result.type = C2_TYPE_AABB;
+		result.aabb.min = c2V(bounds.min.x, bounds.min.y);
+		result.aabb.max = c2V(bounds.max.x, bounds.max.y);
+	}
+	return result;
+}
+
+// bigger things are heavier, so the player shoves resources around and not the other way
+static F32 th_entity_inv_mass(const Entity* entity) {
+	if (!entity->rigid_body)
+		return 0.f;
+	Vec2 dim = Dim2F32(entity->bounds);
+	return 1.f / Max(dim.x * dim.y, 1.f);
+}
+
+static void th_collision_resolve_pair(CollisionBody* a, CollisionBody* b, U32* contact_count) {
+	ColliderShape shape_a = th_entity_collider_shape(a->entity, *a->pos);
+	ColliderShape shape_b = th_entity_collider_shape(b->entity, *b->pos);
+	c2Manifold manifold;
+	// aabb and capsule share an address in the union, c2Collide picks by type
+	c2Collide(&shape_a.aabb, 0, shape_a.type, &shape_b.aabb, 0, shape_b.type, &manifold);
+	if (manifold.count == 0)
+		return;
+	if (contact_count)
+		*contact_count += manifold.count;
+
+	F32 depth = manifold.depths[0];
+	if (manifold.count > 1)
+		depth = Max(depth, manifold.depths[1]);
+	Vec2 n = Vec2(manifold.n.x, manifold.n.y); // points from a to b
+	F32 inv_mass_sum = a->inv_mass + b->inv_mass;
+	if (inv_mass_sum <= 0.f)
+		return;
+
+	F32 push = Max(depth - COLLISION_SLOP, 0.f) / inv_mass_sum;
+	*a->pos = *a->pos - n * (push * a->inv_mass);
+	*b->pos = *b->pos + n * (push * b->inv_mass);
+
+	// inelastic, only the approaching part of the velocity goes
+	Vec2 relative_vel = *b->vel - *a->vel;
+	F32 closing = relative_vel.x * n.x + relative_vel.y * n.y;
+	if (closing < 0.f) {
+		F32 impulse = -closing / inv_mass_sum;
+		*a->vel = *a->vel - n * (impulse * a->inv_mass);
+		*b->vel = *b->vel + n * (impulse * b->inv_mass);
+	}
+}
+
+static void th_collision_step(WorldState* world) {
+	GameState* gs = game_state();
+	ComponentList* list = &world->components[EntityComponent_collider];
+	CollisionStats* stats = &world->collision_stats;
+	MemoryZeroStruct(stats);
+
+	// Colliders get a hash of their own. The world broadphase holds every entity, and a tall
+	// plant sitting over a pile would otherwise come back from every query in it.
+	// Bodies and pairs live in the frame arena, the collider hash and its queries in the broadphase arena.
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	CollisionBody* bodies = (CollisionBody*)th_arena_push(temp.arena, sizeof(CollisionBody) * list->count, alignof(CollisionBody));
+	TempArena hash_temp = th_temp_begin(&world->broadphase_arena);
+	SpatialHash colliders;
+	th_spatial_begin(&colliders, hash_temp.arena, BROADPHASE_CELL_SIZE, list->count);
+	for (U32 i = 0; i < list->count; i++) {
+		CollisionBody* body = &bodies[i];
+		body->entity = &world->entities[list->slots[i]];
+		body->pos = &EntityPos(body->entity);
+		body->vel = &EntityVel(body->entity);
+		body->inv_mass = th_entity_inv_mass(body->entity);
+		if (body->entity->id != world->held_entity_id)
+			th_spatial_insert(&colliders, i, Shift2F32(body->entity->bounds, *body->pos));
+	}
+	th_spatial_finish(&colliders, hash_temp.arena);
+
+	CollisionPair* pairs = (CollisionPair*)th_arena_push(temp.arena, 0, alignof(CollisionPair));
+	for (U32 i = 0; i < list->count; i++) {
+		CollisionBody* a = &bodies[i];
+		if (a->entity->id == world->held_entity_id)
+			continue;
+		TempArena query_temp = th_temp_begin(hash_temp.arena);
+		U32 nearby_count = 0;
+		U32* nearby = th_spatial_query(&colliders, Shift2F32(a->entity->bounds, *a->pos), query_temp.arena, &nearby_count);
+		for (U32 j = 0; j < nearby_count; j++) {
+			// each pair once, and something in it has to be able to move
+			if (nearby[j] <= i)
+				continue;
+			CollisionBody* b = &bodies[nearby[j]];
+			if (!a->entity->rigid_body && !b->entity->rigid_body)
+				continue;
+			CollisionPair* pair = (CollisionPair*)th_arena_push(temp.arena, sizeof(CollisionPair), alignof(CollisionPair));
+			pair->a = i;
+			pair->b = nearby[j];
+			stats->pair_count++;
+		}
+		th_temp_end(query_temp);
+	}
+	th_temp_end(hash_temp);
+
+	for (U32 it = 0; it < COLLISION_ITERATIONS; it++) {
+		for (U32 i = 0; i < stats->pair_count; i++) {
+			th_collision_resolve_pair(&bodies[pairs[i].a], &bodies[pairs[i].b], it == 0 ? &stats->contact_count : 0);
+		}
+		// the ground always wins
+		for (U32 i = 0; i < stats->pair_count; i++) {
+			U32 pair_bodies[2] = { pairs[i].a, pairs[i].b };
+			for (U32 k = 0; k < 2; k++) {
+				CollisionBody* body = &bodies[pair_bodies[k]];
+				if (body->pos->y < 0.f) {
+					body->pos->y = 0.f;
+					body->vel->y = Max(body->vel->y, 0.f);
+				}
+			}
+		}
+	}
+	th_temp_end(temp);
+}
+
+// SYSTEM JOBS
+
+struct SimulateJob {
+	WorldState* world;
+	F32 delta_t;
+};
+
+static void job_physics(void* data, U32 begin, U32 end) {
+	SimulateJob* job = (SimulateJob*)data;
+	th_physics_step(job->world, job->delta_t);
+}
+
+static void job_collision(void* data, U32 begin, U32 end) {
+	SimulateJob* job = (SimulateJob*)data;
+	th_broadphase_build(job->world);
+	th_collision_step(job->world);
+}
+
+// ranges are in lane blocks so every range starts on a SIMD boundary
+static void job_particles_integrate(void* data, U32 begin, U32 end) {
+	SimulateJob* job = (SimulateJob*)data;
+	GameState* gs = game_state();
+	U32 count = gs->particles.count;
+	th_particles_integrate_range(&gs->particles, begin * TH_PARTICLE_LANES, Min(end * TH_PARTICLE_LANES, count), job->delta_t);
+}
+
+static void job_particles(void* data, U32 begin, U32 end) {
+	GameState* gs = game_state();
+	{
+		// every emitter rolls from its own stream, so this comes out the same on any worker
+		TH_PROFILE_ZONE("emit");
+		th_emitters_update(&gs->particles);
+	}
+	U32 blocks = (gs->particles.count + TH_PARTICLE_LANES - 1) / TH_PARTICLE_LANES;
+	th_jobs_parallel_for_wait("particle integrate", blocks, PARTICLE_JOB_GRAIN / TH_PARTICLE_LANES, job_particles_integrate, data);
+	th_particles_compact(&gs->particles);
+}
+
+// SIMULATE
+// everything that moves the world forward, no sokol_gfx/sokol_gp calls in here so it runs headless.
+// Always called with SIM_DT from tick(), never with the frame time.
+
+static void simulate(F32 delta_t) {
+	TH_PROFILE_ZONE("simulate");
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+
+	// remember where everything was so render can interpolate from here
+	ForEachEntity(entity, world) {
+		MemoryZeroStruct(&entity->frame);
+		entity->prev_pos = EntityPos(entity);
+		entity->frame.interpolate = 1;
+	}
+	gs->cam.prev_pos = gs->cam.pos;
+
+	Entity*& player = world->player;
+	const Vec2 world_mouse = mouse_pos_in_worldspace();
+
+	// PLAYER INPUT
+	if (world->player) {
+		TH_PROFILE_ZONE("player input");
+		if (gs->key_pressed[SAPP_KEYCODE_SPACE]) {
+			EntityVel(player).y = 300.0f;
+		}
+		Vec2 axis_input = { 0 };
+		if (gs->key_down[SAPP_KEYCODE_A]) {
+			axis_input.x -= 1.0f;
+			world->player->x_dir = -1;
+		}
+		if (gs->key_down[SAPP_KEYCODE_D]) {
+			axis_input.x += 1.0f;
+			world->player->x_dir = 1;
+		}
+		EntityAcc(player) = axis_input * MOVE_SPEED;
+	}
+
+	// SYSTEM JOBS
+	// physics -> collision in one chain, particle emit -> integrate alongside it
+	{
+		TH_PROFILE_ZONE("systems");
+		SimulateJob sim_job = { world, delta_t };
+		Job* systems = th_job_create("systems", 0, 0);
+		Job* physics = th_job_create("physics", job_physics, &sim_job, systems);
+		Job* collision = th_job_create("collision", job_collision, &sim_job, systems);
+		Job* particles = th_job_create("particles", job_particles, &sim_job, systems);
+		th_job_depends_on(collision, physics);
+		th_job_submit(collision);
+		th_job_submit(physics);
+		th_job_submit(particles);
+		th_job_finish(systems);
+		th_job_wait(systems);
+	}
+
+	if (world->player) {
+		TH_PROFILE_ZONE("player interact");
+		// camera update
+		gs->cam.pos.x = EntityPos(player).x;
+		gs->cam.pos.y = 20.0f;
+
+		// player interact
+		Rng2F32 interact_rect = th_player_interact_rect(player);
+
+		// does interact_rect overlap with any interactable entities?
+		Entity* selected_entity = 0;
+		TempArena temp = th_temp_begin(&gs->frame_arena);
+		EntityArray nearby = th_world_query_region(world, interact_rect, temp.arena);
+		for (U32 i = 0; i < nearby.count; i++) {
+			Entity* entity = nearby.entities[i];
+			if (!entity->interactable || entity->id == world->held_entity_id)
+				continue;
+			selected_entity = entity;
+		}
+		th_temp_end(temp);
+
+		if (selected_entity && !EntityFromID(world->held_entity_id)) {
+			selected_entity->frame.render_highlight = 1; // can pick up feedback
+
+			if (gs->key_pressed[SAPP_KEYCODE_E]) { // PICKUP
+				world->held_entity_id = selected_entity->id;
+				gs->key_pressed[SAPP_KEYCODE_E] = 0;
+			}
+		}
+
+		Entity* held_entity = EntityFromID(world->held_entity_id);
+		if (held_entity) {
+			if (held_entity->seed) { // SEED PLACEMENT
+				EntityPos(held_entity) = Vec2(roundf(world_mouse.x), 0.0f);
+
+				if (gs->mouse_pressed[SAPP_MOUSEBUTTON_LEFT]) {
+					Entity* plant = th_entity_create(gs->archetype_ids.plant);
+					EntityPos(plant) = EntityPos(held_entity);
+					EntityDestroy(held_entity);
+				}
+			} else {
+				EntityVel(held_entity) = EntityVel(player);
+				EntityPos(held_entity) = EntityPos(player) + Vec2(7.0f * player->x_dir, 10.0f);
+				if (gs->key_pressed[SAPP_KEYCODE_E]) { // THROW
+					world->held_entity_id = 0;
+					EntityVel(held_entity).x += player->x_dir * 100.0f;
+					EntitySetComponent(held_entity, EntityComponent_rigid_body, 1);
+					EntitySetComponent(held_entity, EntityComponent_collider, 1);
+				}
+			}
+		}
+	}
+
+	// BEHAVIORS
+	// after the jobs, behaviors create and destroy entities
+	{
+		TH_PROFILE_ZONE("behaviors");
+		th_coro_update(&world->behaviors, delta_t);
+	}
+
+	// STREAMING
+	// last, so whatever the step created or moved is stored with the rest of its chunk
+	th_world_stream(world, gs->cam.pos.x);
+}
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef ANVIL_ASSETS_H
+#define ANVIL_ASSETS_H
+
+// Everything the game loads. Sprites, entity archetypes and particle emitters are defined in
+// ASSET_DEFS_PATH, a Metadesk file. Dev builds parse it and decode the atlases it names straight
+// from the source images, th_packer bakes the same thing into ASSET_PACK_PATH so shipping builds
+// never parse any text. Paths are relative to data/.
+
+#define ASSET_PACK_PATH "assets.pack"
+#define ASSET_DEFS_PATH "defs.mdesk"
+
+// pack tables, see th_pack_table
+#define ASSET_TABLE_ARCHETYPES "archetypes"
+#define ASSET_TABLE_EMITTERS "emitters"
+
+enum ArchetypeBehavior {
+	ArchetypeBehavior_none,
+	ArchetypeBehavior_plant,
+	ArchetypeBehavior_COUNT,
+};
+
+enum ArchetypeFlag {
+	ArchetypeFlag_seed = 1 << 0,
+};
+
+enum EmitterArea {
+	EmitterArea_screen, // anywhere the camera can see
+	EmitterArea_point, // at the emitter
+};
+
+enum EmitterFlag {
+	EmitterFlag_fade_in = 1 << 0,
+	EmitterFlag_fade_out = 1 << 1,
+};
+
+// the words definition files use, a name's index is its enum value (or bit) in the game
+static const char* asset_component_names[] = { "rigid_body", "render", "plant", "interactable", "collider" }; // EntityComponent
+static const char* asset_shape_names[] = { "aabb", "capsule" }; // EntityShape
+static const char* asset_behavior_names[] = { "none", "plant" };
+static const char* asset_archetype_flag_names[] = { "seed" };
+static const char* asset_emitter_area_names[] = { "screen", "point" };
+static const char* asset_emitter_flag_names[] = { "fade_in", "fade_out" };
+
+// everything but the names, these go into the pack as they are
+struct ArchetypeParams {
+	Vec2 size; // without a sprite, otherwise the sprite sizes the entity
+	U32 components; // bit per EntityComponent
+	U32 shape; // EntityShape
+	U32 behavior; // ArchetypeBehavior
+	U32 flags; // ArchetypeFlag
+	F32 friction; // whole numbers up to ARCHETYPE_FRICTION_MAX, see th_archetype_friction_valid
+	Vec4 col;
+};
+
+// entity records keep friction in a byte
+#define ARCHETYPE_FRICTION_MAX 255.0f
+
+static B8 th_archetype_friction_valid(F32 friction) {
+	return friction >= 0.0f && friction <= ARCHETYPE_FRICTION_MAX && friction == floorf(friction);
+}
+
+struct EmitterParams {
+	U32 area; // EmitterArea
+	U32 flags; // EmitterFlag
+	F32 frequency; // particles per sim step, the fraction is a chance of one more
+	F32 life; // seconds
+	F32 size;
+	Rng2F32 vel; // each particle picks a velocity in here
+	Vec4 col;
+};
+
+struct PackArchetype {
+	U32 name; // string table offset
+	U32 sprite; // sprite table index + 1, 0 for none
+	ArchetypeParams params;
+};
+
+struct PackEmitter {
+	U32 name;
+	EmitterParams params;
+};
+
+// DEFINITIONS
+
+struct SpriteDef {
+	const char* name;
+	const char* atlas;
+	Rng2F32 sub_rect;
+};
+
+struct ArchetypeDef {
+	const char* name;
+	const char* sprite; // 0 for none, otherwise one of the sprite defs' names
+	ArchetypeParams params;
+};
+
+struct EmitterDef {
+	const char* name;
+	EmitterParams params;
+};
+
+struct AssetDefs {
+	SpriteDef* sprites;
+	U32 sprite_count;
+	const char** atlases; // every atlas the sprites use, once each
+	U32 atlas_count;
+	ArchetypeDef* archetypes;
+	U32 archetype_count;
+	EmitterDef* emitters;
+	U32 emitter_count;
+};
+
+// PARSING
+// Metadesk has to be included before this. Every top level node is tagged with what it defines:
+//   @sprite plant0: { atlas: "dump.png", rect: (0 0 16 64) }
+//   @archetype resource: { sprite: resource1, components: (render collider), friction: 4 }
+//   @emitter ambient: { area: screen, frequency: 10, velocity_y: (2 4), flags: (fade_in) }
+// data/defs.mdesk uses every field. Shipping builds only ever load the pack.
+#ifndef TH_SHIP
+
+struct DefsParser {
+	Arena* arena;
+	const char* path;
+	B8 ok;
+};
+
+static void th_defs_error(DefsParser* parser, MD_Node* node, const char* message) {
+	MD_CodeLoc loc = MD_CodeLocFromNode(node);
+	LOG("%s:%d:%d: %s \"%.*s\"", parser->path, loc.line, loc.column, message, (int)Min(node->string.size, (MD_u64)64), node->string.str);
+	parser->ok = 0;
+}
+
+// for problems found after parsing, when there's no node left to point at
+static void th_defs_fail(DefsParser* parser, const char* message, const char* name) {
+	LOG("%s: %s \"%.64s\"", parser->path, message, name);
+	parser->ok = 0;
+}
+
+static const char* th_defs_string(DefsParser* parser, MD_Node* node) {
+	char* string = (char*)th_arena_push(parser->arena, node->string.size + 1, 1);
+	memcpy(string, node->string.str, node->string.size);
+	string[node->string.size] = 0;
+	return string;
+}
+
+// "key: (a b c)", Metadesk hands a minus sign over as its own node
+static void th_defs_floats(DefsParser* parser, MD_Node* key, F32* out, U32 count) {
+	U32 found = 0;
+	F32 sign = 1.0f;
+	for (MD_EachNode(value, key->first_child)) {
+		if (MD_S8Match(value->string, MD_S8Lit("-"), 0)) {
+			sign = -sign;
+			continue;
+		}
+		if (!(value->flags & MD_NodeFlag_Numeric) || found == count) {
+			th_defs_error(parser, value, "expected a number at");
+			return;
+		}
+		out[found++] = sign * (F32)MD_F64FromString(value->string);
+		sign = 1.0f;
+	}
+	if (found != count)
+		th_defs_error(parser, key, "wrong number of values for");
+}
+
+static Vec4 th_defs_color(DefsParser* parser, MD_Node* key) {
+	F32 col[4] = { 0 };
+	th_defs_floats(parser, key, col, 4);
+	return Vec4(col[0], col[1], col[2], col[3]);
+}
+
+static S32 th_defs_name_index(MD_Node* value, const char** names, U32 count) {
+	for (U32 i = 0; i < count; i++) {
+		if (MD_S8Match(value->string, MD_S8CString((char*)names[i]), 0))
+			return i;
+	}
+	return -1;
+}
+
+// "key: value", one of names
+static U32 th_defs_enum(DefsParser* parser, MD_Node* key, const char** names, U32 count) {
+	S32 index = th_defs_name_index(key->first_child, names, count);
+	if (index < 0 || MD_ChildCountFromNode(key) != 1) {
+		th_defs_error(parser, key, "unknown value for");
+		return 0;
+	}
+	return index;
+}
+
+// "key: (a b)", any of names, bit per name
+static U32 th_defs_flags(DefsParser* parser, MD_Node* key, const char** names, U32 count) {
+	U32 flags = 0;
+	for (MD_EachNode(value, key->first_child)) {
+		S32 index = th_defs_name_index(value, names, count);
+		if (index < 0)
+			th_defs_error(parser, value, "unknown flag");
+		else
+			flags |= 1u << index;
+	}
+	return flags;
+}
+
+static B8 th_defs_key(MD_Node* key, const char* name) {
+	return MD_S8Match(key->string, MD_S8CString((char*)name), 0);
+}
+
+static void th_defs_parse_sprite(DefsParser* parser, MD_Node* node, AssetDefs* out) {
+	SpriteDef* def = &out->sprites[out->sprite_count++];
+	def->name = th_defs_string(parser, node);
+	for (MD_EachNode(key, node->first_child)) {
+		if (th_defs_key(key, "atlas") && MD_ChildCountFromNode(key) == 1) {
+			const char* atlas = th_defs_string(parser, key->first_child);
+			for (U32 i = 0; i < out->atlas_count && !def->atlas; i++) {
+				if (strcmp(out->atlases[i], atlas) == 0)
+					def->atlas = out->atlases[i];
+			}
+			if (!def->atlas) {
+				def->atlas = atlas;
+				out->atlases[out->atlas_count++] = atlas;
+			}
+		} else if (th_defs_key(key, "rect")) {
+			F32 rect[4] = { 0 };
+			th_defs_floats(parser, key, rect, 4);
+			def->sub_rect = Rng2F32(rect[0], rect[1], rect[2], rect[3]);
+		} else {
+			th_defs_error(parser, key, "unknown sprite field");
+		}
+	}
+	if (!def->atlas)
+		th_defs_error(parser, node, "no atlas for sprite");
+}
+
+static void th_defs_parse_archetype(DefsParser* parser, MD_Node* node, AssetDefs* out) {
+	ArchetypeDef* def = &out->archetypes[out->archetype_count++];
+	def->name = th_defs_string(parser, node);
+	def->params.col = Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	for (MD_EachNode(key, node->first_child)) {
+		ArchetypeParams* params = &def->params;
+		if (th_defs_key(key, "sprite") && MD_ChildCountFromNode(key) == 1)
+			def->sprite = th_defs_string(parser, key->first_child);
+		else if (th_defs_key(key, "size"))
+			th_defs_floats(parser, key, params->size.v, 2);
+		else if (th_defs_key(key, "components"))
+			params->components = th_defs_flags(parser, key, asset_component_names, ArrayCount(asset_component_names));
+		else if (th_defs_key(key, "shape"))
+			params->shape = th_defs_enum(parser, key, asset_shape_names, ArrayCount(asset_shape_names));
+		else if (th_defs_key(key, "behavior"))
+			params->behavior = th_defs_enum(parser, key, asset_behavior_names, ArrayCount(asset_behavior_names));
+		else if (th_defs_key(key, "flags"))
+			params->flags = th_defs_flags(parser, key, asset_archetype_flag_names, ArrayCount(asset_archetype_flag_names));
+		else if (th_defs_key(key, "friction")) {
+			th_defs_floats(parser, key, &params->friction, 1);
+			if (!th_archetype_friction_valid(params->friction))
+				th_defs_error(parser, key, "expected a whole number from 0 to 255 for");
+		}
+		else if (th_defs_key(key, "color"))
+			params->col = th_defs_color(parser, key);
+		else
+			th_defs_error(parser, key, "unknown archetype field");
+	}
+}
+
+static void th_defs_parse_emitter(DefsParser* parser, MD_Node* node, AssetDefs* out) {
+	EmitterDef* def = &out->emitters[out->emitter_count++];
+	def->name = th_defs_string(parser, node);
+	EmitterParams* params = &def->params;
+	params->col = Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	params->life = 1.0f;
+	params->size = 1.0f;
+	for (MD_EachNode(key, node->first_child)) {
+		if (th_defs_key(key, "area"))
+			params->area = th_defs_enum(parser, key, asset_emitter_area_names, ArrayCount(asset_emitter_area_names));
+		else if (th_defs_key(key, "flags"))
+			params->flags = th_defs_flags(parser, key, asset_emitter_flag_names, ArrayCount(asset_emitter_flag_names));
+		else if (th_defs_key(key, "frequency"))
+			th_defs_floats(parser, key, &params->frequency, 1);
+		else if (th_defs_key(key, "life"))
+			th_defs_floats(parser, key, &params->life, 1);
+		else if (th_defs_key(key, "size"))
+			th_defs_floats(parser, key, &params->size, 1);
+		else if (th_defs_key(key, "velocity_x")) {
+			F32 range[2];
+			th_defs_floats(parser, key, range, 2);
+			params->vel.min.x = range[0];
+			params->vel.max.x = range[1];
+		} else if (th_defs_key(key, "velocity_y")) {
+			F32 range[2];
+			th_defs_floats(parser, key, range, 2);
+			params->vel.min.y = range[0];
+			params->vel.max.y = range[1];
+		} else if (th_defs_key(key, "color"))
+			params->col = th_defs_color(parser, key);
+		else
+			th_defs_error(parser, key, "unknown emitter field");
+	}
+}
+
+// Parses everything into arena, names included. Logs every problem it finds with its line and
+// returns 0 if there were any, out is only usable when it returns 1.
+static B8 th_asset_defs_load(Arena* arena, const char* path, AssetDefs* out) {
+	MemoryZeroStruct(out);
+	DefsParser parser = { arena, path, 1 };
+	MD_Arena* md_arena = MD_ArenaAlloc();
+	MD_ParseResult parse = MD_ParseWholeFile(md_arena, MD_S8CString((char*)path));
+	for (MD_Message* message = parse.errors.first; message; message = message->next) {
+		if (message->kind < MD_MessageKind_Error)
+			continue;
+		MD_CodeLoc loc = MD_CodeLocFromNode(message->node);
+		LOG("%s:%d:%d: %.*s", path, loc.line, loc.column, (int)Min(message->string.size, (MD_u64)128), message->string.str);
+		parser.ok = 0;
+	}
+
+	U32 node_count = (U32)MD_ChildCountFromNode(parse.node);
+	out->sprites = ArenaPushArrayZero(arena, SpriteDef, node_count);
+	out->atlases = ArenaPushArrayZero(arena, const char*, node_count);
+	out->archetypes = ArenaPushArrayZero(arena, ArchetypeDef, node_count);
+	out->emitters = ArenaPushArrayZero(arena, EmitterDef, node_count);
+	for (MD_EachNode(node, parse.node->first_child)) {
+		if (MD_NodeHasTag(node, MD_S8Lit("sprite"), 0))
+			th_defs_parse_sprite(&parser, node, out);
+		else if (MD_NodeHasTag(node, MD_S8Lit("archetype"), 0))
+			th_defs_parse_archetype(&parser, node, out);
+		else if (MD_NodeHasTag(node, MD_S8Lit("emitter"), 0))
+			th_defs_parse_emitter(&parser, node, out);
+		else
+			th_defs_error(&parser, node, "expected @sprite, @archetype or @emitter on");
+	}
+
+	// names are unique per kind and sprites have to exist, then nothing downstream has to check.
+	// Every problem gets reported, each later copy of a name once
+	for (U32 i = 0; i < out->sprite_count; i++) {
+		for (U32 j = 0; j < i; j++) {
+			if (strcmp(out->sprites[i].name, out->sprites[j].name) == 0) {
+				th_defs_fail(&parser, "sprite is defined twice", out->sprites[i].name);
+				break;
+			}
+		}
+	}
+	for (U32 i = 0; i < out->archetype_count; i++) {
+		ArchetypeDef* def = &out->archetypes[i];
+		for (U32 j = 0; j < i; j++) {
+			if (strcmp(def->name, out->archetypes[j].name) == 0) {
+				th_defs_fail(&parser, "archetype is defined twice", def->name);
+				break;
+			}
+		}
+		if (!def->sprite)
+			continue;
+		const char* sprite = 0;
+		for (U32 j = 0; j < out->sprite_count && !sprite; j++) {
+			if (strcmp(out->sprites[j].name, def->sprite) == 0)
+				sprite = out->sprites[j].name;
+		}
+		if (!sprite)
+			th_defs_fail(&parser, "no sprite defined for archetype", def->name);
+		def->sprite = sprite;
+	}
+	for (U32 i = 0; i < out->emitter_count; i++) {
+		for (U32 j = 0; j < i; j++) {
+			if (strcmp(out->emitters[i].name, out->emitters[j].name) == 0) {
+				th_defs_fail(&parser, "emitter is defined twice", out->emitters[i].name);
+				break;
+			}
+		}
+	}
+	MD_ArenaRelease(md_arena);
+	return parser.ok;
+}
+
+#endif
+
+#endif
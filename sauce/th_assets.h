@@ -0,0 +1,133 @@
+#ifndef TH_ASSETS_H
+#define TH_ASSETS_H
+
+// Asset names. Every name is interned once when its asset is registered and hands out a
+// handle, index + 1 in registration order, so 0 is never valid. Look names up at load and keep
+// the handle, per-frame code shouldn't be touching strings.
+// The lookup is an open addressing table with linear probing, it doubles when half full.
+
+#define TH_NAME_TABLE_MIN_SLOTS 64
+
+struct AssetName {
+	const char* string; // interned, null terminated
+	U32 length;
+	U32 hash;
+};
+
+struct NameSlot {
+	U32 hash;
+	U32 handle; // 0 is an empty slot
+};
+
+struct NameTable {
+	Arena string_arena;
+	Arena name_arena;
+	AssetName* names; // handle - 1 indexes this
+	U32 count;
+	Arena slot_arena;
+	NameSlot* slots;
+	U32 slot_mask;
+};
+
+static U32 c_string_length(const char* string) {
+	const char* cursor = string;
+	while (cursor[0] != '\0') {
+		cursor++;
+	}
+	U32 length = cursor - string;
+	return length;
+}
+
+static U32 hash_from_string(const char* string) {
+	U32 result = 5381;
+	U32 string_size = c_string_length(string);
+	for (int i = 0; i < string_size; i++) {
+		result = ((result << 5) + result) + string[i];
+	}
+	return result;
+}
+
+static char* th_arena_push_string(Arena* arena, const char* string) {
+	U32 length = c_string_length(string);
+	char* result = (char*)th_arena_push(arena, length + 1, 1);
+	memcpy(result, string, length + 1);
+	return result;
+}
+
+static void th_names_rehash(NameTable* table, U32 slot_count) {
+	th_arena_clear(&table->slot_arena);
+	table->slots = ArenaPushArrayZero(&table->slot_arena, NameSlot, slot_count);
+	table->slot_mask = slot_count - 1;
+	for (U32 i = 0; i < table->count; i++) {
+		U32 hash = table->names[i].hash;
+		U32 slot = hash & table->slot_mask;
+		while (table->slots[slot].handle)
+			slot = (slot + 1) & table->slot_mask;
+		table->slots[slot].hash = hash;
+		table->slots[slot].handle = i + 1;
+	}
+}
+
+static void th_names_init(NameTable* table, const char* name) {
+	MemoryZeroStruct(table);
+	th_arena_init(&table->string_arena, name, Megabytes(64));
+	th_arena_init(&table->name_arena, "asset names", Megabytes(64));
+	th_arena_init(&table->slot_arena, "name slots", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&table->name_arena, table->names);
+	th_names_rehash(table, TH_NAME_TABLE_MIN_SLOTS);
+}
+
+// returns the slot holding string, or the empty slot it would go in
+static NameSlot* th_names_slot(const NameTable* table, const char* string, U32 length, U32 hash) {
+	U32 slot = hash & table->slot_mask;
+	for (;;) {
+		NameSlot* result = &table->slots[slot];
+		if (!result->handle)
+			return result;
+		if (result->hash == hash) {
+			const AssetName* name = &table->names[result->handle - 1];
+			if (name->length == length && memcmp(name->string, string, length) == 0)
+				return result;
+		}
+		slot = (slot + 1) & table->slot_mask;
+	}
+}
+
+// 0 if the name was never interned
+static U32 th_names_find(const NameTable* table, const char* string) {
+	return th_names_slot(table, string, c_string_length(string), hash_from_string(string))->handle;
+}
+
+// the existing handle if the name is already in, otherwise the next one
+static U32 th_names_intern(NameTable* table, const char* string) {
+	U32 length = c_string_length(string);
+	U32 hash = hash_from_string(string);
+	NameSlot* slot = th_names_slot(table, string, length, hash);
+	if (slot->handle)
+		return slot->handle;
+
+	char* interned = th_arena_push_string(&table->string_arena, string);
+	AssetName* name = TH_ARENA_ARRAY_PUSH(&table->name_arena, table->names, table->count);
+	name->string = interned;
+	name->length = length;
+	name->hash = hash;
+	slot->hash = hash;
+	slot->handle = table->count;
+
+	if (table->count * 2 > table->slot_mask + 1)
+		th_names_rehash(table, (table->slot_mask + 1) * 2);
+	return table->count;
+}
+
+static const char* th_names_string(const NameTable* table, U32 handle) {
+	Assert(handle && handle <= table->count); // invalid handle
+	return table->names[handle - 1].string;
+}
+
+static void th_names_log_stats(const NameTable* table) {
+	th_arena_log_stats(&table->string_arena);
+	th_arena_log_stats(&table->name_arena);
+	th_arena_log_stats(&table->slot_arena);
+}
+
+#endif
@@ -0,0 +1,937 @@
+// Standalone benchmarks for engine systems. Doesn't open a window, sokol_gfx runs on its dummy
+// backend so asset loading goes through the game's own paths. Every scenario seeds its own
+// random streams from BENCH_SEED, so two runs of the same build do the same work.
+// Run from data/, or from the build dir which has a copy, so the asset scenarios find their files:
+//   thomas_bench [--filter name] [--json] [--out results.jsonl] [--baseline results.jsonl] [--threshold percent]
+//                [--results results.jsonl] [--threads N]
+// --json prints one result per line instead of the table, --out writes the same lines to a file
+// alongside it. Keep the results of a known good commit and hand them to --baseline later, every
+// metric gets compared and the exit code is 1 if any of them got worse by more than the threshold.
+// --results skips the scenarios and takes its results from a file instead, the frame times
+// thomas_headless --replay --out wrote for example, so they get the same comparison.
+// --threads sizes the job system the way it does for the game, 0 (the default) is one per core
+// and 1 runs every job inline. Only compare results from runs with the same count.
+#define SOKOL_DUMMY_BACKEND
+#define SOKOL_GFX_IMPL
+#define MINICORO_IMPL
+#include "thomas.h"
+
+#undef function
+#include "third_party/sokol_gfx.h"
+#include "third_party/sokol_gp.h"
+#include "third_party/sokol_app.h"
+#define SOKOL_TIME_IMPL
+#include "third_party/sokol_time.h"
+#define function static
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "third_party/stb_image.h"
+#ifndef TH_SHIP
+#include "th_metadesk.h"
+#endif
+#define CUTE_C2_IMPLEMENTATION
+#include "third_party/cute_c2.h"
+
+#include "th_render.h"
+
+#include "anvil.h"
+
+#define BENCH_SEED 1337
+#define BENCH_STEP 0.016f
+#define BENCH_MAX_RESULTS 1024 // --results can bring a whole replay corpus
+#define BENCH_DEFAULT_THRESHOLD 10.0 // percent
+#define BENCH_STREAM_SCENARIO 0x100 // scenario streams, well clear of the game's RandomStreamIDs
+
+// RESULTS
+
+enum BenchBetter {
+	BenchBetter_lower,
+	BenchBetter_higher,
+	BenchBetter_same, // workload checks, a change means the scenario isn't doing the same work anymore
+};
+
+struct BenchResult {
+	char bench[32];
+	U32 n;
+	char metric[32];
+	F64 value;
+	char unit[16];
+	U32 better;
+};
+
+struct Bench {
+	const char* filter;
+	B8 json;
+	FILE* out;
+	BenchResult results[BENCH_MAX_RESULTS];
+	U32 result_count;
+	#ifndef TH_SHIP
+	ArenaCounters counters; // at the start of the current measurement
+	#endif
+};
+
+static Bench bench;
+static volatile U64 bench_sink; // keeps results the compiler would otherwise throw away
+
+static B8 bench_enabled(const char* name) {
+	return !bench.filter || strstr(name, bench.filter);
+}
+
+static void bench_report(const char* name, U32 n, const char* metric, F64 value, const char* unit, BenchBetter better = BenchBetter_lower) {
+	BenchResult* result = TH_ARRAY_PUSH(bench.results, bench.result_count);
+	snprintf(result->bench, sizeof(result->bench), "%s", name);
+	result->n = n;
+	snprintf(result->metric, sizeof(result->metric), "%s", metric);
+	result->value = value;
+	snprintf(result->unit, sizeof(result->unit), "%s", unit);
+	result->better = better;
+	char line[256];
+	snprintf(line, sizeof(line), "{\"bench\":\"%s\",\"n\":%u,\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\",\"better\":%u}\n",
+		result->bench, n, result->metric, value, result->unit, better);
+	if (bench.json)
+		fputs(line, stdout);
+	else
+		printf("%-12s %8u  %-16s %14.3f %s\n", result->bench, n, result->metric, value, result->unit);
+	if (bench.out)
+		fputs(line, bench.out);
+}
+
+// arena traffic between here and bench_allocs_report, the calling thread's only. Shipping
+// builds don't count it, they report nothing
+static void bench_allocs_begin() {
+	#ifndef TH_SHIP
+	bench.counters = th_arena_counters;
+	#endif
+}
+
+static void bench_allocs_report(const char* name, U32 n, F64 ops, const char* per) {
+	#ifndef TH_SHIP
+	char unit[16];
+	snprintf(unit, sizeof(unit), "/%s", per);
+	bench_report(name, n, "arena pushes", (th_arena_counters.push_count - bench.counters.push_count) / ops, unit);
+	snprintf(unit, sizeof(unit), "B/%s", per);
+	bench_report(name, n, "arena bytes", (th_arena_counters.push_bytes - bench.counters.push_bytes) / ops, unit);
+	bench_report(name, n, "os commits", (F64)(th_arena_counters.commit_count - bench.counters.commit_count), "total");
+	#endif
+}
+
+// BASELINE
+// reads back what --json wrote, anything it can't parse is skipped
+
+static B8 bench_parse(const char* line, BenchResult* result) {
+	MemoryZeroStruct(result);
+	return sscanf(line, "{\"bench\":\"%31[^\"]\",\"n\":%u,\"metric\":\"%31[^\"]\",\"value\":%lf,\"unit\":\"%15[^\"]\",\"better\":%u}",
+		result->bench, &result->n, result->metric, &result->value, result->unit, &result->better) == 6;
+}
+
+// results somebody else measured, thomas_headless --replay --out, in place of running the scenarios
+static B8 bench_load_results(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "thomas_bench: can't open %s\n", path);
+		return 0;
+	}
+	char line[512];
+	while (fgets(line, sizeof(line), file)) {
+		BenchResult result;
+		if (bench_parse(line, &result))
+			bench_report(result.bench, result.n, result.metric, result.value, result.unit, (BenchBetter)result.better);
+	}
+	fclose(file);
+	return 1;
+}
+
+static int bench_compare(const char* path, F64 threshold) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "thomas_bench: can't open %s\n", path);
+		return 1;
+	}
+	U32 regressions = 0;
+	U32 compared = 0;
+	char line[512];
+	printf("\nagainst %s, threshold %.1f%%\n", path, threshold);
+	while (fgets(line, sizeof(line), file)) {
+		BenchResult old;
+		if (!bench_parse(line, &old))
+			continue;
+		for (U32 i = 0; i < bench.result_count; i++) {
+			const BenchResult* now = &bench.results[i];
+			if (now->n != old.n || strcmp(now->bench, old.bench) || strcmp(now->metric, old.metric))
+				continue;
+			F64 change = old.value != 0.0 ? (now->value - old.value) / fabs(old.value) * 100.0 : (now->value != 0.0 ? 100.0 : 0.0);
+			const char* verdict = "";
+			if (now->better == BenchBetter_lower && change > threshold)
+				verdict = "REGRESSION";
+			else if (now->better == BenchBetter_higher && change < -threshold)
+				verdict = "REGRESSION";
+			else if (now->better == BenchBetter_same && change != 0.0)
+				verdict = "DIFFERENT WORK";
+			regressions += verdict[0] == 'R';
+			compared++;
+			printf("%-12s %8u  %-16s %14.3f -> %14.3f %-10s %+7.1f%%  %s\n", now->bench, now->n, now->metric, old.value,
+				now->value, now->unit, change, verdict);
+		}
+	}
+	fclose(file);
+	printf("%u compared, %u regressed\n", compared, regressions);
+	return regressions ? 1 : 0;
+}
+
+// ENTITY LAYOUT
+// Half of the entities are rigid bodies, the other half only render, like a farm full of
+// plants with some resources rolling around.
+
+static void bench_layout_populate(WorldState* world, U32 entity_count) {
+	th_world_clear(world);
+	th_random_seed(&world->rng, BENCH_SEED, BENCH_STREAM_SCENARIO);
+	RandomStream* rng = &world->rng;
+	for (U32 i = 0; i < entity_count; i++) {
+		Entity* entity = EntityCreate();
+		// set before the body is added, so the entity's own copies (what the AoS run integrates)
+		// and the packed ones start out the same
+		EntityPos(entity).x = th_random_range(rng, -1000.f, 1000.f);
+		EntityPos(entity).y = th_random_range(rng, 0.f, 200.f);
+		EntityVel(entity).x = th_random_range(rng, -50.f, 50.f);
+		EntityVel(entity).y = th_random_range(rng, -50.f, 50.f);
+		EntityFriction(entity) = 4;
+		EntitySetComponent(entity, EntityComponent_render, 1);
+		if (i % 2 == 0)
+			EntitySetComponent(entity, EntityComponent_rigid_body, 1);
+	}
+}
+
+// The integrator the way it was before bodies were packed, straight over the entity's own
+// fields. Those are stale in the game once a body is added, here they're the AoS copy
+// bench_layout_populate sets up for it.
+static void bench_integrate_aos(Entity* entity, F32 delta_t) {
+	// acc counter force with existing velocity
+	entity->acc.x += -entity->x_friction_mult * entity->vel.x;
+
+	// gravity
+	B8 falling = entity->vel.y < 0.f;
+	entity->acc.y -= (falling ? 2.f : 1.f) * GRAVITY;
+
+	// integrate acceleration and velocity into position
+	Vec2 next_pos = 0.5f * entity->acc * SQUARE(delta_t) + entity->vel * delta_t + entity->pos;
+
+	// integrate acceleration into velocity
+	entity->vel += entity->acc * delta_t;
+	entity->acc.x = 0;
+	entity->acc.y = 0;
+
+	if (next_pos.y < 0.0f) {
+		next_pos.y = 0.0f;
+		entity->vel.y = 0.0f;
+	}
+
+	entity->pos = next_pos;
+}
+
+static void bench_layout(U32 entity_count, U32 iterations) {
+	WorldState* world = world_state();
+	F64 aos_ns, soa_ns, kernel_ns;
+
+	// AoS - every entity, flag test, the way frame() used to do it
+	bench_layout_populate(world, entity_count);
+	U64 start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		ForEachEntity(entity, world) {
+			if (!entity->rigid_body)
+				continue;
+			bench_integrate_aos(entity, BENCH_STEP);
+		}
+	}
+	aos_ns = stm_ns(stm_since(start));
+
+	// SoA - the physics step, over the packed bodies in place
+	bench_layout_populate(world, entity_count);
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_physics_step(world, BENCH_STEP);
+	}
+	soa_ns = stm_ns(stm_since(start));
+
+	// SoA kernel alone, without the job system around it
+	bench_layout_populate(world, entity_count);
+	U32 body_count = world->components[EntityComponent_rigid_body].count;
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_rigid_body_integrate_range(&world->bodies, 0, body_count, BENCH_STEP);
+	}
+	kernel_ns = stm_ns(stm_since(start));
+
+	F64 ops = (F64)entity_count * iterations;
+	bench_report("layout", entity_count, "aos", aos_ns / ops, "ns/entity");
+	bench_report("layout", entity_count, "soa", soa_ns / ops, "ns/entity");
+	bench_report("layout", entity_count, "soa kernel", kernel_ns / ops, "ns/entity");
+}
+
+// BROADPHASE
+// Region queries the size of the player's interact rect, brute force over every interactable
+// versus the spatial hash. The hash rebuild, paid once per sim step, is timed on its own.
+
+static void bench_broadphase(U32 entity_count, U32 iterations) {
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	const U32 query_count = 64;
+	bench_layout_populate(world, entity_count);
+	ForEachEntity(entity, world) {
+		entity->bounds = Rng2F32(Vec2(-2.f, 0.f), Vec2(2.f, 4.f));
+		EntitySetComponent(entity, EntityComponent_interactable, 1);
+	}
+
+	Rng2F32 queries[query_count];
+	for (U32 i = 0; i < query_count; i++) {
+		Vec2 pos;
+		pos.x = th_random_range(&world->rng, -1000.f, 1000.f);
+		pos.y = th_random_range(&world->rng, 0.f, 200.f);
+		queries[i] = Rng2F32(pos, pos + Vec2(20.f, 20.f));
+	}
+
+	U64 brute_hits = 0;
+	U64 start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		for (U32 q = 0; q < query_count; q++) {
+			ForEachComponent(entity, world, EntityComponent_interactable) {
+				if (Overlap2F32(EntityBoundsInWorld(entity), queries[q]))
+					brute_hits++;
+			}
+		}
+	}
+	F64 brute_ns = stm_ns(stm_since(start));
+
+	U64 hash_hits = 0;
+	U64 build_ticks = 0;
+	U64 query_ticks = 0;
+	bench_allocs_begin();
+	for (U32 it = 0; it < iterations; it++) {
+		start = stm_now();
+		th_broadphase_build(world);
+		build_ticks += stm_since(start);
+		start = stm_now();
+		for (U32 q = 0; q < query_count; q++) {
+			TempArena temp = th_temp_begin(&gs->frame_arena);
+			EntityArray nearby = th_world_query_region(world, queries[q], temp.arena);
+			for (U32 i = 0; i < nearby.count; i++)
+				hash_hits += nearby.entities[i]->interactable;
+			th_temp_end(temp);
+		}
+		query_ticks += stm_since(start);
+	}
+	Assert(brute_hits == hash_hits);
+
+	F64 ops = (F64)query_count * iterations;
+	bench_report("broadphase", entity_count, "brute", brute_ns / ops, "ns/query");
+	bench_report("broadphase", entity_count, "hash", stm_ns(query_ticks) / ops, "ns/query");
+	bench_report("broadphase", entity_count, "rebuild", stm_ns(build_ticks) / ((F64)entity_count * iterations), "ns/entity");
+	bench_report("broadphase", entity_count, "hits", (F64)hash_hits / iterations, "/iteration", BenchBetter_same);
+	bench_allocs_report("broadphase", entity_count, iterations, "rebuild");
+}
+
+// COLLISION
+// A pile of thrown resources landing on each other. Physics, broadphase rebuild and collision
+// resolution together, the same order simulate() runs them in.
+
+static void bench_collision(U32 resource_count, U32 steps) {
+	WorldState* world = world_state();
+	th_world_clear(world);
+	th_random_seed(&world->rng, BENCH_SEED, BENCH_STREAM_SCENARIO);
+	RandomStream* rng = &world->rng;
+	F32 spread = resource_count * 0.1f;
+	for (U32 i = 0; i < resource_count; i++) {
+		Entity* entity = EntityCreate();
+		EntityPos(entity).x = th_random_range(rng, -spread, spread);
+		EntityPos(entity).y = th_random_range(rng, 0.f, 400.f);
+		EntityVel(entity).x = th_random_range(rng, -100.f, 100.f);
+		EntityVel(entity).y = th_random_range(rng, 0.f, 100.f);
+		entity->bounds = range2_center_bottom(Rng2F32(Vec2(), Vec2(4.f, 4.f)));
+		EntityFriction(entity) = 4;
+		EntitySetComponent(entity, EntityComponent_rigid_body, 1);
+		EntitySetComponent(entity, EntityComponent_collider, 1);
+	}
+
+	U64 contacts = 0;
+	U64 pairs = 0;
+	bench_allocs_begin();
+	U64 start = stm_now();
+	for (U32 step = 0; step < steps; step++) {
+		th_physics_step(world, SIM_DT);
+		th_broadphase_build(world);
+		th_collision_step(world);
+		contacts += world->collision_stats.contact_count;
+		pairs += world->collision_stats.pair_count;
+	}
+	F64 seconds = stm_sec(stm_since(start));
+
+	bench_report("collision", resource_count, "step", seconds * 1000.0 / steps, "ms/step");
+	bench_report("collision", resource_count, "contacts/s", contacts / seconds / 1000000.0, "M/s", BenchBetter_higher);
+	bench_report("collision", resource_count, "pairs", (F64)pairs / steps, "/step", BenchBetter_same);
+	bench_report("collision", resource_count, "contacts", (F64)contacts / steps, "/step", BenchBetter_same);
+	bench_allocs_report("collision", resource_count, steps, "step");
+}
+
+// RANDOM
+// count floats in [0, 1) three ways: libc rand() the way the game used to roll, one pcg32 stream
+// a value at a time, and batched fills.
+
+static void bench_random(U32 count, U32 iterations) {
+	Arena arena;
+	th_arena_init(&arena, "bench random");
+	F32* values = ArenaPushArray(&arena, F32, count);
+	RandomStream rng;
+	th_random_seed(&rng, BENCH_SEED, BENCH_STREAM_SCENARIO);
+	F32 sum = 0.0f;
+
+	srand(BENCH_SEED);
+	U64 start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		for (U32 i = 0; i < count; i++)
+			values[i] = (F32)rand() / (F32)RAND_MAX;
+		sum += values[it % count];
+	}
+	U64 libc_ticks = stm_since(start);
+
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		for (U32 i = 0; i < count; i++)
+			values[i] = th_random_f32(&rng);
+		sum += values[it % count];
+	}
+	U64 single_ticks = stm_since(start);
+
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_random_fill_f32(&rng, values, count, 0.0f, 1.0f);
+		sum += values[it % count];
+	}
+	U64 fill_ticks = stm_since(start);
+	bench_sink = (U64)sum;
+
+	F64 total = (F64)count * iterations;
+	bench_report("random", count, "libc", stm_ns(libc_ticks) / total, "ns/value");
+	bench_report("random", count, "single", stm_ns(single_ticks) / total, "ns/value");
+	bench_report("random", count, "fill", stm_ns(fill_ticks) / total, "ns/value");
+	th_arena_release(&arena);
+}
+
+// PARTICLES
+// A system held at count live particles from the ambient emitter. Whatever dies in a step is
+// emitted again before the next, so the kernel always runs over a full system.
+
+static void bench_particles(U32 count, U32 steps) {
+	Arena arena;
+	th_arena_init(&arena, "bench particles");
+	ParticleSystem system;
+	th_particles_init(&system, &arena, count);
+	Emitter emitter = { Vec2(0.0f, 0.0f), th_emitter_type_id("ambient") };
+	th_random_seed(&emitter.rng, BENCH_SEED, RandomStreamID_emitters);
+	const EmitterParams* params = &th_emitter_type_from_id(emitter.type)->params;
+
+	U64 emitted = 0;
+	U64 emit_ticks = 0;
+	U64 simulate_ticks = 0;
+	bench_allocs_begin();
+	for (U32 step = 0; step < steps; step++) {
+		U64 start = stm_now();
+		U32 refill = count - system.count;
+		th_emitter_emit(&system, &emitter, params, refill);
+		emitted += refill;
+		emit_ticks += stm_since(start);
+		start = stm_now();
+		th_particles_simulate(&system, SIM_DT);
+		simulate_ticks += stm_since(start);
+	}
+
+	bench_report("particles", count, "simulate", stm_ns(simulate_ticks) / ((F64)count * steps), "ns/particle");
+	bench_report("particles", count, "emit", stm_ns(emit_ticks) / Max((F64)emitted, 1.0), "ns/particle");
+	bench_report("particles", count, "emitted", (F64)emitted / steps, "/step", BenchBetter_same);
+	bench_allocs_report("particles", count, steps, "step");
+	th_arena_release(&arena);
+}
+
+// PLANTS
+// count plants planted at random stages, growing on their behavior coroutines until all of them
+// have fruited. Only the coroutine update is timed, that's all a plant costs per step.
+
+static void bench_plants(U32 count, U32 steps) {
+	WorldState* world = world_state();
+	th_world_clear(world);
+	th_random_seed(&world->rng, BENCH_SEED, RandomStreamID_world);
+	th_world_populate(world, count, 0);
+
+	bench_allocs_begin();
+	U64 start = stm_now();
+	for (U32 step = 0; step < steps; step++)
+		th_coro_update(&world->behaviors, SIM_DT);
+	F64 seconds = stm_sec(stm_since(start));
+
+	bench_report("plants", count, "grow", seconds * 1000000000.0 / ((F64)count * steps), "ns/plant");
+	bench_report("plants", count, "steps/s", steps / seconds, "steps/s", BenchBetter_higher);
+	bench_report("plants", count, "entities", (F64)world->entity_dense_count, "at end", BenchBetter_same);
+	bench_allocs_report("plants", count, steps, "step");
+}
+
+// SPRITES
+// Name lookups, the way definitions and tools find sprites. The names are copied first so
+// nothing can get away with comparing pointers.
+
+static void bench_sprites(U32 lookups) {
+	GameState* gs = game_state();
+	Arena arena;
+	th_arena_init(&arena, "bench sprites", Megabytes(16));
+	U32 name_count = gs->sprite_count;
+	char** names = ArenaPushArray(&arena, char*, name_count);
+	char** missing = ArenaPushArray(&arena, char*, name_count);
+	for (U32 i = 0; i < name_count; i++) {
+		names[i] = th_arena_push_string(&arena, gs->sprites[i].name);
+		missing[i] = (char*)th_arena_push(&arena, 64, 1);
+		snprintf(missing[i], 64, "%s_missing", gs->sprites[i].name);
+	}
+
+	U64 sum = 0;
+	U64 start = stm_now();
+	for (U32 i = 0; i < lookups; i++)
+		sum += th_sprite_id(names[i % name_count]);
+	F64 hit_ns = stm_ns(stm_since(start));
+	start = stm_now();
+	for (U32 i = 0; i < lookups; i++)
+		sum += th_names_find(&gs->sprite_names, missing[i % name_count]);
+	F64 miss_ns = stm_ns(stm_since(start));
+	start = stm_now();
+	for (U32 i = 0; i < lookups; i++)
+		sum += (U64)th_sprite_from_id(1 + i % name_count)->atlas;
+	F64 from_id_ns = stm_ns(stm_since(start));
+	bench_sink = sum;
+
+	bench_report("sprites", name_count, "find by name", hit_ns / lookups, "ns/lookup");
+	bench_report("sprites", name_count, "find missing", miss_ns / lookups, "ns/lookup");
+	bench_report("sprites", name_count, "from id", from_id_ns / lookups, "ns/lookup");
+	th_arena_release(&arena);
+}
+
+// ASSETS
+// The pieces of loading, each timed on its own: parsing the definitions, decoding every source
+// atlas, and mapping and validating the baked pack. Uploads are left out, the dummy backend
+// doesn't do any. Shipping builds have no sources, only the pack.
+
+static void bench_assets(U32 iterations) {
+	GameState* gs = game_state();
+	TempArena temp = th_temp_begin(&gs->frame_arena);
+	U64 start;
+
+	#ifndef TH_SHIP
+	AssetDefs defs;
+	bench_allocs_begin();
+	start = stm_now();
+	for (U32 i = 0; i < iterations; i++) {
+		TempArena parse = th_temp_begin(temp.arena);
+		B8 ok = th_asset_defs_load(parse.arena, ASSET_DEFS_PATH, &defs);
+		Assert(ok); // run from data/
+		th_temp_end(parse);
+	}
+	F64 parse_ns = stm_ns(stm_since(start));
+	bench_report("assets", iterations, "parse defs", parse_ns / iterations / 1000.0, "us/load");
+	bench_allocs_report("assets", iterations, iterations, "parse");
+
+	th_asset_defs_load(temp.arena, ASSET_DEFS_PATH, &defs);
+	U64 pixel_bytes = 0;
+	start = stm_now();
+	for (U32 i = 0; i < iterations; i++) {
+		for (U32 a = 0; a < defs.atlas_count; a++) {
+			S32 width, height;
+			U8* pixels = th_texture_decode(defs.atlases[a], &width, &height);
+			Assert(pixels);
+			pixel_bytes += (U64)width * height * 4;
+			th_texture_decode_free(pixels);
+		}
+	}
+	F64 decode_seconds = stm_sec(stm_since(start));
+	bench_report("assets", iterations, "decode", decode_seconds * 1000.0 / ((F64)iterations * defs.atlas_count), "ms/atlas");
+	bench_report("assets", iterations, "decode rate", pixel_bytes / decode_seconds / Megabytes(1), "MB/s", BenchBetter_higher);
+	#endif
+
+	MappedFile file;
+	if (th_os_file_map(&file, ASSET_PACK_PATH)) {
+		th_os_file_unmap(&file);
+		U64 sum = 0;
+		start = stm_now();
+		for (U32 i = 0; i < iterations; i++) {
+			PackView pack;
+			U32 count;
+			B8 ok = th_os_file_map(&file, ASSET_PACK_PATH) && th_pack_open(&pack, file.data, file.size);
+			Assert(ok); // stale pack, rebuild it with thomas_packer
+			sum += (U64)th_pack_table(&pack, ASSET_TABLE_ARCHETYPES, sizeof(PackArchetype), &count) + count;
+			for (U32 a = 0; a < pack.header->atlas_count; a++)
+				sum += pack.base[pack.atlases[a].pixel_offset]; // touch the first page, like the upload would
+			th_os_file_unmap(&file);
+		}
+		F64 pack_ns = stm_ns(stm_since(start));
+		bench_sink = sum;
+		bench_report("assets", iterations, "open pack", pack_ns / iterations / 1000.0, "us/load");
+	}
+	th_temp_end(temp);
+}
+
+// WORLD
+// The sim side of a frame with nobody at the keyboard, simulate() itself over a farm of plants
+// and loose resources, with the ambient particles and streaming around a camera that stays put.
+
+static void bench_world(U32 plant_count, U32 resource_count, U32 frames) {
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	th_world_clear(world);
+	gs->particles.count = 0;
+	gs->emitter_count = 0;
+	th_emitter_create(th_emitter_type_id("ambient"), Vec2(0.0f, 0.0f));
+	th_world_init(world);
+	th_world_populate(world, plant_count, resource_count);
+	gs->cam.pos = Vec2(0.0f, 0.0f);
+
+	bench_allocs_begin();
+	U64 start = stm_now();
+	for (U32 frame = 0; frame < frames; frame++) {
+		th_arena_clear(&gs->frame_arena);
+		simulate(SIM_DT);
+	}
+	F64 seconds = stm_sec(stm_since(start));
+
+	bench_report("world", plant_count, "frame", seconds * 1000.0 / frames, "ms/frame");
+	bench_report("world", plant_count, "frames/s", frames / seconds, "frames/s", BenchBetter_higher);
+	bench_report("world", plant_count, "entities", (F64)world->entity_dense_count, "at end", BenchBetter_same);
+	bench_allocs_report("world", plant_count, frames, "frame");
+}
+
+// STREAM
+// A farm chunk_count chunks wide with the camera walking across it, two chunks a second, and
+// simulate() streaming around it every step. The density is the same for every size, so frame
+// cost and the live entity count should stay flat however big the map gets.
+
+static void bench_stream(U32 chunk_count, U32 frames) {
+	GameState* gs = game_state();
+	WorldState* world = world_state();
+	th_world_clear(world);
+	th_random_seed(&world->rng, BENCH_SEED, BENCH_STREAM_SCENARIO);
+	RandomStream* rng = &world->rng;
+	U32 plant_count = chunk_count * 250;
+	F32 half_width = chunk_count * CHUNK_WIDTH * 0.5f;
+	for (U32 i = 0; i < plant_count; i++) {
+		Entity* plant = th_entity_create(gs->archetype_ids.plant);
+		EntityPos(plant).x = roundf(th_random_range(rng, -half_width, half_width));
+		plant->plant_stage = th_random_range(rng, 0.f, 6.f);
+	}
+	gs->particles.count = 0;
+	gs->emitter_count = 0;
+	gs->cam.pos = Vec2(-CHUNK_WIDTH * 10.0f, 0.0f);
+	th_world_stream(world, gs->cam.pos.x); // the first pass stores nearly the whole map, not timed
+
+	U32 live_max = 0;
+	bench_allocs_begin();
+	U64 start = stm_now();
+	for (U32 frame = 0; frame < frames; frame++) {
+		th_arena_clear(&gs->frame_arena);
+		gs->cam.pos.x += CHUNK_WIDTH * 2.0f * SIM_DT;
+		simulate(SIM_DT);
+		live_max = Max(live_max, world->entity_dense_count);
+	}
+	F64 seconds = stm_sec(stm_since(start));
+
+	bench_report("stream", plant_count, "frame", seconds * 1000.0 / frames, "ms/frame");
+	bench_report("stream", plant_count, "frames/s", frames / seconds, "frames/s", BenchBetter_higher);
+	bench_report("stream", plant_count, "live", (F64)live_max, "peak", BenchBetter_same);
+	bench_report("stream", plant_count, "stored", (F64)(world->chunk_record_count - world->chunk_record_dead), "at end", BenchBetter_same);
+	bench_allocs_report("stream", plant_count, frames, "frame");
+}
+
+// TILEMAP
+// A map side chunks square, filled with the ground tiles and looked at zoomed out, so a screen
+// holds thousands of tiles. still is the steady state, everything on screen baked; pan walks the
+// camera across it a screen a second, baking what scrolls in. per tile is the same screen
+// pushed through the sprite batch every frame, what terrain would cost without the cache.
+
+static void bench_tilemap(U32 side, U32 frames) {
+	GameState* gs = game_state();
+	Arena arena;
+	th_arena_init(&arena, "bench tilemap", Megabytes(64));
+	Tilemap map;
+	th_tilemap_init(&map, &arena, TERRAIN_TILE_SIZE);
+	TileID tiles[3];
+	tiles[0] = th_tilemap_tile_add(&map, th_texture_sprite_get("ground_grass"));
+	tiles[1] = th_tilemap_tile_add(&map, th_texture_sprite_get("ground_dirt"));
+	tiles[2] = th_tilemap_tile_add(&map, th_texture_sprite_get("ground_rocks"));
+	RandomStream rng;
+	th_random_seed(&rng, BENCH_SEED, BENCH_STREAM_SCENARIO);
+	S32 tile_side = (S32)(side * TH_TILEMAP_CHUNK_TILES);
+	for (S32 y = 0; y < tile_side; y++) {
+		for (S32 x = 0; x < tile_side; x++)
+			th_tilemap_set(&map, x, y, tiles[th_random_below(&rng, 3)]);
+	}
+	SpriteBatch batch;
+	th_sprite_batch_init(&batch, &arena, SPRITE_BATCH_CAPACITY);
+	const F32 scale = 0.5f;
+	const F32 map_size = tile_side * TERRAIN_TILE_SIZE;
+	Vec2 center = Vec2(gs->window_size.x * 0.5f / scale, map_size * 0.5f);
+	sg_pass_action pass_action = { 0 };
+
+	CameraView view = th_camera_view(center, scale, gs->window_size);
+	sg_begin_default_pass(&pass_action, (int)gs->window_size.x, (int)gs->window_size.y);
+	th_tilemap_draw(&map, view, &gs->frame_arena); // bakes the first screen, not timed
+	sg_end_pass();
+	sg_commit();
+	U64 start = stm_now();
+	for (U32 frame = 0; frame < frames; frame++) {
+		th_arena_clear(&gs->frame_arena);
+		sg_begin_default_pass(&pass_action, (int)gs->window_size.x, (int)gs->window_size.y);
+		th_tilemap_draw(&map, view, &gs->frame_arena);
+		sg_end_pass();
+		sg_commit();
+	}
+	F64 still_ms = stm_ms(stm_since(start)) / frames;
+	U32 draw_calls = map.draw_calls;
+	U32 tile_count = map.quad_count;
+
+	U32 bakes = 0;
+	start = stm_now();
+	for (U32 frame = 0; frame < frames; frame++) {
+		th_arena_clear(&gs->frame_arena);
+		center.x = Min(center.x + gs->window_size.x / scale * SIM_DT, map_size);
+		view = th_camera_view(center, scale, gs->window_size);
+		sg_begin_default_pass(&pass_action, (int)gs->window_size.x, (int)gs->window_size.y);
+		th_tilemap_draw(&map, view, &gs->frame_arena);
+		sg_end_pass();
+		sg_commit();
+		bakes += map.bake_count;
+	}
+	F64 pan_ms = stm_ms(stm_since(start)) / frames;
+
+	view = th_camera_view(Vec2(gs->window_size.x * 0.5f / scale, map_size * 0.5f), scale, gs->window_size);
+	S32 min_x = Max(0, (S32)floorf(view.bounds.min.x / TERRAIN_TILE_SIZE));
+	S32 max_x = Min(tile_side - 1, (S32)floorf(view.bounds.max.x / TERRAIN_TILE_SIZE));
+	S32 min_y = Max(0, (S32)floorf(view.bounds.min.y / TERRAIN_TILE_SIZE));
+	S32 max_y = Min(tile_side - 1, (S32)floorf(view.bounds.max.y / TERRAIN_TILE_SIZE));
+	start = stm_now();
+	for (U32 frame = 0; frame < frames; frame++) {
+		sg_begin_default_pass(&pass_action, (int)gs->window_size.x, (int)gs->window_size.y);
+		for (S32 y = min_y; y <= max_y; y++) {
+			for (S32 x = min_x; x <= max_x; x++) {
+				RenderRect* rect = th_sprite_batch_push(&batch);
+				rect->rect = Rng2F32(Vec2(x * TERRAIN_TILE_SIZE, y * TERRAIN_TILE_SIZE), Vec2((x + 1) * TERRAIN_TILE_SIZE, (y + 1) * TERRAIN_TILE_SIZE));
+				rect->sprite = map.tiles[th_tilemap_get(&map, x, y) - 1];
+				rect->col = TH_WHITE;
+			}
+		}
+		th_sprite_batch_draw(&batch, view.world_to_clip);
+		sg_end_pass();
+		sg_commit();
+	}
+	F64 per_tile_ms = stm_ms(stm_since(start)) / frames;
+
+	U32 n = side * side;
+	bench_report("tilemap", n, "still", still_ms, "ms/frame");
+	bench_report("tilemap", n, "pan", pan_ms, "ms/frame");
+	bench_report("tilemap", n, "per tile", per_tile_ms, "ms/frame");
+	bench_report("tilemap", n, "tiles", (F64)tile_count, "on screen", BenchBetter_same);
+	bench_report("tilemap", n, "draws", (F64)draw_calls, "per frame", BenchBetter_same);
+	bench_report("tilemap", n, "bakes", (F64)bakes, "while panning", BenchBetter_same);
+	th_tilemap_release(&map);
+	th_arena_release(&arena);
+}
+
+// SNAPSHOTS
+// A grown farm saved the way autosave does it. save is the main thread's share, copying the
+// world out; the keyframe and delta encodes are what the saver thread does with it, the delta
+// against the keyframe after one more sim step. load decodes nothing, it's the payload to world.
+
+static void bench_snapshot(U32 plant_count, U32 resource_count, U32 iterations) {
+	WorldState* world = world_state();
+	th_world_clear(world);
+	th_world_init(world);
+	th_world_populate(world, plant_count, resource_count);
+	for (U32 step = 0; step < 120; step++) { // past the last plant stage, the farm is at full size
+		th_physics_step(world, SIM_DT);
+		th_broadphase_build(world);
+		th_collision_step(world);
+		th_coro_update(&world->behaviors, SIM_DT);
+	}
+	U32 n = plant_count;
+	Arena keyframe;
+	Arena payload;
+	Arena scratch;
+	th_arena_init(&keyframe, "bench keyframe");
+	th_arena_init(&payload, "bench payload");
+	th_arena_init(&scratch, "bench scratch");
+	U64 size = th_world_save(world, &keyframe);
+
+	U64 start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_arena_clear(&payload);
+		th_world_save(world, &payload);
+	}
+	bench_report("snapshot", n, "save", stm_ms(stm_since(start)) / iterations, "ms");
+
+	U64 keyframe_size = 0;
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_arena_clear(&scratch);
+		th_snapshot_delta_encode(&scratch, 0, 0, keyframe.base, size, &keyframe_size);
+	}
+	bench_report("snapshot", n, "encode keyframe", stm_ms(stm_since(start)) / iterations, "ms");
+
+	th_physics_step(world, SIM_DT);
+	th_broadphase_build(world);
+	th_collision_step(world);
+	th_coro_update(&world->behaviors, SIM_DT);
+	th_arena_clear(&payload);
+	U64 payload_size = th_world_save(world, &payload);
+	U64 delta_size = 0;
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		th_arena_clear(&scratch);
+		th_snapshot_delta_encode(&scratch, keyframe.base, size, payload.base, payload_size, &delta_size);
+	}
+	bench_report("snapshot", n, "encode delta", stm_ms(stm_since(start)) / iterations, "ms");
+
+	start = stm_now();
+	for (U32 it = 0; it < iterations; it++) {
+		B8 ok = th_world_load(world, keyframe.base, size);
+		Assert(ok);
+	}
+	bench_report("snapshot", n, "load", stm_ms(stm_since(start)) / iterations, "ms");
+	bench_report("snapshot", n, "payload", size / 1024.0, "KB", BenchBetter_same);
+	bench_report("snapshot", n, "keyframe", keyframe_size / 1024.0, "KB");
+	bench_report("snapshot", n, "delta", delta_size / 1024.0, "KB");
+	th_arena_release(&keyframe);
+	th_arena_release(&payload);
+	th_arena_release(&scratch);
+}
+
+// SETUP
+// Assets load the way the game loads them, the pack if there is one and the sources if not.
+// The loader gets no threads, so every atlas is decoded by the time loading returns. The job
+// system gets the --threads count, the same as the game's.
+
+static void bench_setup() {
+	GameState* gs = game_state();
+	sg_desc desc = { 0 };
+	sg_setup(&desc);
+	gs->seed = BENCH_SEED;
+	gs->window_size = Vec2(1280.0f, 720.0f); // screen area emitters fill the camera's view
+	gs->cam.scale = DEFAULT_CAMERA_SCALE;
+	th_memory_init();
+	th_jobs_init(&gs->permanent_arena, gs->job_threads);
+	th_loader_init(&gs->image_loader, 0, th_texture_decode, th_texture_decode_free);
+	B8 from_pack = th_assets_load_pack(ASSET_PACK_PATH);
+	#ifdef TH_SHIP
+	Assert(from_pack); // shipping only reads the pack, bake it with thomas_packer
+	#else
+	if (!from_pack) {
+		B8 ok = th_assets_load_sources();
+		Assert(ok); // run from data/
+		th_texture_uploads_pump(~0ull);
+	}
+	#endif
+	gs->archetype_ids.player = th_archetype_id("player");
+	gs->archetype_ids.seed = th_archetype_id("seed");
+	gs->archetype_ids.resource = th_archetype_id("resource");
+	gs->archetype_ids.plant = th_archetype_id("plant");
+	bench_report("jobs", th_job_system.worker_count, "threads", th_job_system.worker_count, "workers", BenchBetter_same);
+}
+
+int main(int argc, char* argv[]) {
+	const char* baseline = 0;
+	const char* out_path = 0;
+	const char* results_path = 0;
+	F64 threshold = BENCH_DEFAULT_THRESHOLD;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : 0;
+		if (!strcmp(arg, "--json")) {
+			bench.json = 1;
+			continue;
+		}
+		if (!value) {
+			fprintf(stderr, "thomas_bench: %s needs a value\n", arg);
+			return 1;
+		}
+		if (!strcmp(arg, "--filter")) bench.filter = value;
+		else if (!strcmp(arg, "--out")) out_path = value;
+		else if (!strcmp(arg, "--baseline")) baseline = value;
+		else if (!strcmp(arg, "--threshold")) threshold = strtod(value, 0);
+		else if (!strcmp(arg, "--results")) results_path = value;
+		else if (!strcmp(arg, "--threads")) game_state()->job_threads = strtoul(value, 0, 10);
+		else {
+			fprintf(stderr, "thomas_bench: unknown argument %s\n", arg);
+			return 1;
+		}
+		i++;
+	}
+
+	if (out_path && !(bench.out = fopen(out_path, "wb"))) {
+		fprintf(stderr, "thomas_bench: can't open %s\n", out_path);
+		return 1;
+	}
+	if (results_path) {
+		int result = bench_load_results(results_path) ? 0 : 1;
+		if (bench.out)
+			fclose(bench.out);
+		return baseline && !result ? bench_compare(baseline, threshold) : result;
+	}
+	stm_setup();
+	bench_setup();
+
+	if (bench_enabled("layout")) {
+		bench_layout(1000, 500);
+		bench_layout(10000, 50);
+		bench_layout(100000, 5);
+	}
+	if (bench_enabled("broadphase")) {
+		bench_broadphase(1000, 100);
+		bench_broadphase(10000, 20);
+		bench_broadphase(100000, 5);
+	}
+	if (bench_enabled("collision")) {
+		bench_collision(1000, 300);
+		bench_collision(5000, 300);
+		bench_collision(20000, 100);
+	}
+	if (bench_enabled("random")) {
+		bench_random(16, 100000);
+		bench_random(65536, 50);
+	}
+	if (bench_enabled("particles")) {
+		bench_particles(10000, 300);
+		bench_particles(PARTICLE_CAPACITY, 60);
+	}
+	if (bench_enabled("plants")) {
+		bench_plants(1000, 120);
+		bench_plants(10000, 120);
+	}
+	if (bench_enabled("sprites"))
+		bench_sprites(1000000);
+	if (bench_enabled("assets"))
+		bench_assets(20);
+	if (bench_enabled("snapshot")) {
+		bench_snapshot(2000, 500, 20);
+		bench_snapshot(20000, 5000, 5);
+	}
+	if (bench_enabled("world")) {
+		bench_world(500, 100, 600);
+		bench_world(2000, 500, 600);
+	}
+	if (bench_enabled("stream")) {
+		bench_stream(40, 600);
+		bench_stream(400, 600);
+	}
+	if (bench_enabled("tilemap")) {
+		bench_tilemap(4, 300);
+		bench_tilemap(32, 300);
+	}
+
+	if (bench.out)
+		fclose(bench.out);
+	int result = baseline ? bench_compare(baseline, threshold) : 0;
+	th_loader_shutdown(&game_state()->image_loader);
+	th_jobs_shutdown();
+	sg_shutdown();
+	return result;
+}
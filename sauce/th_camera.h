@@ -0,0 +1,66 @@
+#ifndef TH_CAMERA_H
+#define TH_CAMERA_H
+
+// 2D camera views. A view is a world position centered in a viewport of pixels, zoomed by scale
+// pixels per world unit, y up in the world and down on screen. Everything that maps between
+// world and screen reads the matrices here, so the mouse, the renderer and culling can't
+// disagree about what's on screen.
+
+// affine, rows of [x y translation], laid out like sgp_mat2x3
+struct Mat2x3 {
+	F32 v[2][3];
+};
+
+struct CameraView {
+	Vec2 center;
+	F32 scale;
+	Vec2 viewport; // pixels
+	Rng2F32 bounds; // world space, exactly what's on screen
+	Mat2x3 world_to_clip; // for the batches, the same transform sgp_project(bounds) gives sokol_gp
+	Mat2x3 world_to_screen; // pixels from the top left
+	Mat2x3 screen_to_world;
+};
+
+static Vec2 th_mat2x3_apply(const Mat2x3& m, Vec2 p) {
+	return Vec2(m.v[0][0] * p.x + m.v[0][1] * p.y + m.v[0][2], m.v[1][0] * p.x + m.v[1][1] * p.y + m.v[1][2]);
+}
+
+static CameraView th_camera_view(Vec2 center, F32 scale, Vec2 viewport) {
+	Assert(scale > 0.0f); // a view of nothing, or of everything upside down
+	CameraView view;
+	MemoryZeroStruct(&view);
+	view.center = center;
+	view.scale = scale;
+	view.viewport = viewport;
+	Vec2 half = viewport * (0.5f / scale);
+	view.bounds.min = center - half;
+	view.bounds.max = center + half;
+
+	F32 clip_x = viewport.x > 0.0f ? 2.0f * scale / viewport.x : 0.0f;
+	F32 clip_y = viewport.y > 0.0f ? 2.0f * scale / viewport.y : 0.0f;
+	view.world_to_clip = { { { clip_x, 0.0f, -center.x * clip_x }, { 0.0f, clip_y, -center.y * clip_y } } };
+	view.world_to_screen = { { { scale, 0.0f, viewport.x * 0.5f - center.x * scale },
+		{ 0.0f, -scale, viewport.y * 0.5f + center.y * scale } } };
+	F32 inv_scale = 1.0f / scale;
+	view.screen_to_world = { { { inv_scale, 0.0f, center.x - viewport.x * 0.5f * inv_scale },
+		{ 0.0f, -inv_scale, center.y + viewport.y * 0.5f * inv_scale } } };
+	return view;
+}
+
+static Vec2 th_camera_world_to_screen(const CameraView& view, Vec2 world_pos) {
+	return th_mat2x3_apply(view.world_to_screen, world_pos);
+}
+
+static Vec2 th_camera_screen_to_world(const CameraView& view, Vec2 screen_pos) {
+	return th_mat2x3_apply(view.screen_to_world, screen_pos);
+}
+
+// any part of rect on screen. rect can be flipped on x, the way sprites are mirrored
+static B8 th_camera_sees(const CameraView& view, Rng2F32 rect) {
+	F32 min_x = Min(rect.min.x, rect.max.x);
+	F32 max_x = Max(rect.min.x, rect.max.x);
+	return min_x <= view.bounds.max.x && max_x >= view.bounds.min.x
+		&& rect.min.y <= view.bounds.max.y && rect.max.y >= view.bounds.min.y;
+}
+
+#endif
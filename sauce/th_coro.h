@@ -0,0 +1,265 @@
+#ifndef TH_CORO_H
+#define TH_CORO_H
+
+// Coroutine behaviors on minicoro. Each coroutine runs on its own small stack and sleeps with
+// th_coro_wait. The scheduler keeps them in a min heap on wake time and an update only resumes
+// the ones that are due, a sleeping coroutine costs nothing per step.
+// Blocks (mco_coro + stack) come out of one arena at a fixed size and go back on a free list
+// when the coroutine finishes, so starting one never mallocs.
+// Not thread safe, resume only from the thread that calls th_coro_update.
+
+#ifndef MCO_MIN_STACK_SIZE
+#define MCO_MIN_STACK_SIZE Kilobytes(16) // behaviors are shallow, minicoro's default is 32K
+#endif
+#define MCO_NO_DEFAULT_ALLOCATORS // stacks come from the pool, nothing goes through malloc
+#include "third_party/minicoro.h"
+
+#define TH_CORO_STACK_SIZE MCO_MIN_STACK_SIZE
+#define TH_CORO_BLOCK_ALIGN 64
+#define TH_CORO_ALIGN(size) (((U64)(size) + TH_CORO_BLOCK_ALIGN - 1) & ~(U64)(TH_CORO_BLOCK_ALIGN - 1))
+
+typedef void (*CoroFunc)(mco_coro* co);
+
+struct CoroScheduler;
+
+// sits at the front of the coroutine's block, the mco_coro follows it
+struct Coro {
+	CoroScheduler* scheduler;
+	mco_coro* co;
+	F64 wake_time;
+	U64 order; // breaks wake_time ties, first scheduled resumes first
+	U32 owner; // whatever the behavior acts on, usually an entity id
+	Coro* next_free;
+};
+
+struct CoroScheduler {
+	F64 time;
+	U64 next_order;
+	// block pool
+	Arena block_arena;
+	U64 block_size;
+	U64 coro_offset;
+	Coro* free_list;
+	U32 live_count;
+	// min heap of sleeping coroutines, arrays only ever grow
+	Arena heap_arena;
+	Coro** heap;
+	U32 heap_count;
+	U32 heap_capacity;
+	Arena due_arena;
+	Coro** due;
+	U32 due_capacity;
+	U32 resumed_count; // last update
+};
+
+static void th_coro_init(CoroScheduler* sched) {
+	MemoryZeroStruct(sched);
+	th_arena_init(&sched->block_arena, "coro stacks", Gigabytes(4));
+	th_arena_init(&sched->heap_arena, "coro heap", Megabytes(64));
+	th_arena_init(&sched->due_arena, "coro due", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&sched->heap_arena, sched->heap);
+	TH_ARENA_ARRAY_INIT(&sched->due_arena, sched->due);
+
+	// coro_size only depends on the stack size, so every block is the same size
+	mco_desc desc = mco_desc_init(0, TH_CORO_STACK_SIZE);
+	sched->coro_offset = TH_CORO_ALIGN(sizeof(Coro));
+	sched->block_size = sched->coro_offset + TH_CORO_ALIGN(desc.coro_size);
+}
+
+static B8 th_coro_before(const Coro* a, const Coro* b) {
+	if (a->wake_time != b->wake_time)
+		return a->wake_time < b->wake_time;
+	return a->order < b->order;
+}
+
+static void th_coro_heap_push(CoroScheduler* sched, Coro* coro) {
+	coro->order = sched->next_order++;
+	if (sched->heap_count == sched->heap_capacity)
+		TH_ARENA_ARRAY_PUSH(&sched->heap_arena, sched->heap, sched->heap_capacity);
+	U32 i = sched->heap_count++;
+	while (i > 0) {
+		U32 parent = (i - 1) / 2;
+		if (!th_coro_before(coro, sched->heap[parent]))
+			break;
+		sched->heap[i] = sched->heap[parent];
+		i = parent;
+	}
+	sched->heap[i] = coro;
+}
+
+// puts coro at i or below it, the heap under i has to be valid already
+static void th_coro_heap_sift_down(CoroScheduler* sched, U32 i, Coro* coro) {
+	U32 count = sched->heap_count;
+	for (;;) {
+		U32 child = i * 2 + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && th_coro_before(sched->heap[child + 1], sched->heap[child]))
+			child++;
+		if (!th_coro_before(sched->heap[child], coro))
+			break;
+		sched->heap[i] = sched->heap[child];
+		i = child;
+	}
+	sched->heap[i] = coro;
+}
+
+static Coro* th_coro_heap_pop(CoroScheduler* sched) {
+	Assert(sched->heap_count);
+	Coro* top = sched->heap[0];
+	Coro* last = sched->heap[--sched->heap_count];
+	if (sched->heap_count)
+		th_coro_heap_sift_down(sched, 0, last);
+	return top;
+}
+
+static void th_coro_release(CoroScheduler* sched, Coro* coro) {
+	mco_result res = mco_uninit(coro->co);
+	Assert(res == MCO_SUCCESS);
+	coro->next_free = sched->free_list;
+	sched->free_list = coro;
+	sched->live_count--;
+}
+
+// first resume is on the first update at or after wake_time
+static Coro* th_coro_start_at(CoroScheduler* sched, CoroFunc func, U32 owner, F64 wake_time) {
+	Coro* coro = sched->free_list;
+	if (coro)
+		sched->free_list = coro->next_free;
+	else
+		coro = (Coro*)th_arena_push(&sched->block_arena, sched->block_size, TH_CORO_BLOCK_ALIGN);
+	MemoryZeroStruct(coro);
+	coro->scheduler = sched;
+	coro->co = (mco_coro*)((U8*)coro + sched->coro_offset);
+	coro->owner = owner;
+	coro->wake_time = wake_time;
+
+	mco_desc desc = mco_desc_init(func, TH_CORO_STACK_SIZE);
+	desc.user_data = coro;
+	mco_result res = mco_init(coro->co, &desc);
+	Assert(res == MCO_SUCCESS);
+	sched->live_count++;
+	th_coro_heap_push(sched, coro);
+	return coro;
+}
+
+// first resume is on the first update at least delay seconds from now
+static Coro* th_coro_start(CoroScheduler* sched, CoroFunc func, U32 owner, F64 delay = 0.0) {
+	return th_coro_start_at(sched, func, owner, sched->time + delay);
+}
+
+static int th_coro_compare(const void* a, const void* b) {
+	const Coro* x = *(const Coro* const*)a;
+	const Coro* y = *(const Coro* const*)b;
+	return th_coro_before(x, y) ? -1 : th_coro_before(y, x) ? 1 : 0;
+}
+
+// sleeping coroutines in the order they'll resume, for saving them. Returns the count
+static U32 th_coro_list(const CoroScheduler* sched, Arena* arena, Coro*** out) {
+	Coro** list = ArenaPushArray(arena, Coro*, sched->heap_count);
+	memcpy(list, sched->heap, sizeof(Coro*) * sched->heap_count);
+	qsort(list, sched->heap_count, sizeof(Coro*), th_coro_compare);
+	*out = list;
+	return sched->heap_count;
+}
+
+// Every coroutine that was due when the update started gets resumed exactly once. Anything it
+// starts or reschedules runs next update at the earliest, so th_coro_wait(0) means next step.
+static void th_coro_update(CoroScheduler* sched, F64 delta_t) {
+	sched->time += delta_t;
+	U32 due_count = 0;
+	while (sched->heap_count && sched->heap[0]->wake_time <= sched->time) {
+		if (due_count == sched->due_capacity)
+			TH_ARENA_ARRAY_PUSH(&sched->due_arena, sched->due, sched->due_capacity);
+		sched->due[due_count++] = th_coro_heap_pop(sched);
+	}
+
+	for (U32 i = 0; i < due_count; i++) {
+		Coro* coro = sched->due[i];
+		mco_result res = mco_resume(coro->co);
+		Assert(res == MCO_SUCCESS);
+		if (mco_status(coro->co) == MCO_DEAD)
+			th_coro_release(sched, coro);
+		else
+			th_coro_heap_push(sched, coro);
+	}
+	sched->resumed_count = due_count;
+}
+
+// Drops the sleeping coroutines of owners, sorted ascending, without resuming them again. The
+// rest keep their wake times and order, so they resume exactly as they would have.
+// Not from inside a coroutine, the one running isn't in the heap to find.
+static void th_coro_cancel_owners(CoroScheduler* sched, const U32* owners, U32 owner_count) {
+	if (!owner_count)
+		return;
+	U32 kept = 0;
+	for (U32 i = 0; i < sched->heap_count; i++) {
+		Coro* coro = sched->heap[i];
+		U32 low = 0;
+		U32 high = owner_count;
+		while (low < high) {
+			U32 middle = (low + high) / 2;
+			if (owners[middle] < coro->owner)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		if (low < owner_count && owners[low] == coro->owner)
+			th_coro_release(sched, coro);
+		else
+			sched->heap[kept++] = coro;
+	}
+	sched->heap_count = kept;
+	for (U32 i = kept / 2; i-- > 0;)
+		th_coro_heap_sift_down(sched, i, sched->heap[i]);
+}
+
+// drops every coroutine without resuming it again, their stacks are simply abandoned
+static void th_coro_clear(CoroScheduler* sched) {
+	for (U32 i = 0; i < sched->heap_count; i++)
+		th_coro_release(sched, sched->heap[i]);
+	sched->heap_count = 0;
+	Assert(sched->live_count == 0);
+	sched->time = 0.0;
+}
+
+static void th_coro_log_stats(const CoroScheduler* sched) {
+	th_arena_log_stats(&sched->block_arena);
+	th_arena_log_stats(&sched->heap_arena);
+	th_arena_log_stats(&sched->due_arena);
+}
+
+// INSIDE A COROUTINE
+
+static Coro* th_coro_current() {
+	mco_coro* co = mco_running();
+	Assert(co); // only callable from inside a coroutine
+	return (Coro*)mco_get_user_data(co);
+}
+
+// Sleeps until seconds after this coroutine was due, not after whenever it actually ran, so
+// repeated waits don't drift. A wait that is already in the past resumes next update.
+static void th_coro_wait(F64 seconds) {
+	Coro* coro = th_coro_current();
+	coro->wake_time = Max(coro->wake_time + seconds, coro->scheduler->time);
+	mco_result res = mco_yield(coro->co);
+	Assert(res == MCO_SUCCESS);
+}
+
+// Sleeps until a time on the scheduler's clock. If this coroutine was due at or after it
+// already, it carries on without yielding, so a behavior restarted at the time it was waiting
+// for doesn't lose a step.
+static void th_coro_wait_until(F64 time) {
+	Coro* coro = th_coro_current();
+	if (time <= coro->wake_time)
+		return;
+	coro->wake_time = Max(time, coro->scheduler->time);
+	mco_result res = mco_yield(coro->co);
+	Assert(res == MCO_SUCCESS);
+}
+
+static void th_coro_yield() {
+	th_coro_wait(0.0);
+}
+
+#endif
@@ -65,16 +65,6 @@ static F32 float_alpha_ease(const F32& alpha, const TH_Ease type) {
 	}
 }
 
-static F32 float_random_alpha() {
-	return (F32)rand() / (F32)RAND_MAX;
-}
-
-static F32 float_random_range(const F32& min, const F32& max) {
-	F32 result = float_random_alpha();
-	result = float_lerp(result, min, max);
-	return result;
-}
-
 static F32 float_alpha_sin_mid(const F32& alpha)
 {
 	F32 sin = alpha;
@@ -0,0 +1,442 @@
+#ifndef TH_JOBS_H
+#define TH_JOBS_H
+
+// Job system. One worker thread per spare core, each with its own work-stealing deque. The
+// thread that calls th_jobs_init is worker 0 and only runs jobs while it waits on one.
+//
+// A job finishes once its function and every child it spawned have finished. Dependencies are
+// continuations: wire them up with th_job_depends_on before submitting either job, and the
+// dependent gets pushed when its last dependency finishes. Waiting never blocks, the waiting
+// thread runs other jobs until the one it wants is done.
+//
+// Jobs come from a per-thread ring, there is no free. Only TH_JOB_POOL_SIZE jobs per thread can
+// be in flight at once, which is plenty for a frame's worth of work.
+
+#include <atomic>
+
+#if OS_WINDOWS
+#include <process.h>
+#elif OS_LINUX || OS_MAC
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define TH_JOB_MAX_THREADS 32
+#define TH_JOB_POOL_SIZE 4096
+#define TH_JOB_DEQUE_SIZE 4096
+#define TH_JOB_MAX_CONTINUATIONS 8
+#define TH_JOB_MAX_TIMINGS 4096
+#define TH_JOB_SPIN_COUNT 256
+
+typedef void (*JobFunc)(void* data, U32 begin, U32 end);
+
+struct Job {
+	const char* name;
+	JobFunc func;
+	void* data;
+	U32 begin;
+	U32 end;
+	Job* parent;
+	std::atomic<S32> unfinished; // this job plus its unfinished children
+	std::atomic<S32> blockers; // unfinished dependencies, plus one until submitted
+	Job* continuations[TH_JOB_MAX_CONTINUATIONS];
+	U32 continuation_count;
+};
+
+struct JobTiming {
+	const char* name;
+	U32 begin;
+	U32 end;
+	U64 start_ns;
+	U64 end_ns;
+};
+
+// lock free Chase-Lev deque. The owner pushes and pops the bottom, thieves take from the top
+struct JobDeque {
+	std::atomic<S64> top;
+	std::atomic<S64> bottom;
+	std::atomic<Job*> jobs[TH_JOB_DEQUE_SIZE];
+};
+
+struct JobWorker {
+	U32 index;
+	JobDeque deque;
+	Job* pool;
+	U32 pool_next;
+	JobTiming timings[TH_JOB_MAX_TIMINGS];
+	U32 timing_count;
+	U64 rng; // victim selection
+#if OS_WINDOWS
+	HANDLE thread;
+#elif OS_LINUX || OS_MAC
+	pthread_t thread;
+#endif
+};
+
+struct JobSystem {
+	U32 worker_count; // including the main thread
+	JobWorker* workers;
+	std::atomic<B32> running;
+	std::atomic<U32> sleeping;
+#if OS_WINDOWS
+	HANDLE wake;
+#elif OS_LINUX || OS_MAC
+	sem_t wake;
+#endif
+};
+
+static JobSystem th_job_system;
+static thread_local JobWorker* th_job_worker_local;
+
+// OS
+
+static U32 th_os_core_count() {
+#if OS_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif OS_LINUX || OS_MAC
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (U32)count : 1;
+#else
+	return 1;
+#endif
+}
+
+static void th_os_thread_yield() {
+#if OS_WINDOWS
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+// DEQUE
+
+static void th_job_deque_push(JobDeque* deque, Job* job) {
+	S64 bottom = deque->bottom.load(std::memory_order_relaxed);
+	S64 top = deque->top.load(std::memory_order_acquire);
+	Assert(bottom - top < TH_JOB_DEQUE_SIZE); // too many jobs queued on one thread
+	deque->jobs[bottom & (TH_JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_release);
+	deque->bottom.store(bottom + 1, std::memory_order_release);
+}
+
+static Job* th_job_deque_pop(JobDeque* deque) {
+	S64 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+	deque->bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	S64 top = deque->top.load(std::memory_order_relaxed);
+	if (top > bottom) {
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+		return 0;
+	}
+	Job* job = deque->jobs[bottom & (TH_JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (top == bottom) {
+		// last one, race the thieves for it
+		if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = 0;
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+static Job* th_job_deque_steal(JobDeque* deque) {
+	S64 top = deque->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	S64 bottom = deque->bottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return 0;
+	Job* job = deque->jobs[top & (TH_JOB_DEQUE_SIZE - 1)].load(std::memory_order_acquire);
+	if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return 0;
+	return job;
+}
+
+// JOBS
+
+static JobWorker* th_job_worker() {
+	JobWorker* worker = th_job_worker_local;
+	Assert(worker); // jobs can only be made from the main thread or from inside a job
+	return worker;
+}
+
+// parent can be 0. The parent won't finish until this job has
+static Job* th_job_create(const char* name, JobFunc func, void* data, Job* parent = 0) {
+	JobWorker* worker = th_job_worker();
+	Job* job = &worker->pool[worker->pool_next++ & (TH_JOB_POOL_SIZE - 1)];
+	Assert(!job->unfinished.load(std::memory_order_relaxed)); // pool wrapped onto a job still in flight
+	job->name = name;
+	job->func = func;
+	job->data = data;
+	job->begin = 0;
+	job->end = 0;
+	job->parent = parent;
+	job->continuation_count = 0;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->blockers.store(1, std::memory_order_relaxed);
+	if (parent)
+		parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	return job;
+}
+
+// job won't start until dependency has finished. Call before submitting either of them
+static void th_job_depends_on(Job* job, Job* dependency) {
+	Assert(dependency->continuation_count < TH_JOB_MAX_CONTINUATIONS);
+	dependency->continuations[dependency->continuation_count++] = job;
+	job->blockers.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void th_job_push(Job* job) {
+	th_job_deque_push(&th_job_worker()->deque, job);
+	// the push's release store to bottom could otherwise be ordered after the sleeping load, and
+	// a worker going to sleep right then would miss both the job and the wake. Pairs with the
+	// fence in th_job_worker_loop
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (th_job_system.sleeping.load(std::memory_order_seq_cst) > 0) {
+#if OS_WINDOWS
+		ReleaseSemaphore(th_job_system.wake, 1, 0);
+#elif OS_LINUX || OS_MAC
+		sem_post(&th_job_system.wake);
+#endif
+	}
+}
+
+static void th_job_unblock(Job* job) {
+	if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		th_job_push(job);
+}
+
+static void th_job_submit(Job* job) {
+	th_job_unblock(job); // drops the "not submitted yet" blocker
+}
+
+static void th_job_finish(Job* job) {
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+	for (U32 i = 0; i < job->continuation_count; i++)
+		th_job_unblock(job->continuations[i]);
+	if (job->parent)
+		th_job_finish(job->parent);
+}
+
+static B8 th_job_is_finished(const Job* job) {
+	return job->unfinished.load(std::memory_order_acquire) == 0;
+}
+
+static Job* th_job_get(JobWorker* worker) {
+	Job* job = th_job_deque_pop(&worker->deque);
+	if (job)
+		return job;
+	U32 count = th_job_system.worker_count;
+	if (count <= 1)
+		return 0;
+	// xorshift, start stealing from a random victim so thieves don't all pile onto worker 0
+	worker->rng ^= worker->rng << 13;
+	worker->rng ^= worker->rng >> 7;
+	worker->rng ^= worker->rng << 17;
+	U32 start = (U32)(worker->rng % count);
+	for (U32 i = 0; i < count; i++) {
+		JobWorker* victim = &th_job_system.workers[(start + i) % count];
+		if (victim == worker)
+			continue;
+		job = th_job_deque_steal(&victim->deque);
+		if (job)
+			return job;
+	}
+	return 0;
+}
+
+static void th_job_execute(JobWorker* worker, Job* job) {
+	U64 start_ns = th_os_time_ns();
+	if (job->func) {
+		TH_PROFILE_ZONE(job->name);
+		job->func(job->data, job->begin, job->end);
+	}
+	U64 end_ns = th_os_time_ns();
+	if (worker->timing_count < TH_JOB_MAX_TIMINGS) {
+		JobTiming* timing = &worker->timings[worker->timing_count++];
+		timing->name = job->name;
+		timing->begin = job->begin;
+		timing->end = job->end;
+		timing->start_ns = start_ns;
+		timing->end_ns = end_ns;
+	}
+	th_job_finish(job);
+}
+
+// runs other jobs until this one is done
+static void th_job_wait(Job* job) {
+	JobWorker* worker = th_job_worker();
+	while (!th_job_is_finished(job)) {
+		Job* next = th_job_get(worker);
+		if (next)
+			th_job_execute(worker, next);
+		else
+			th_os_thread_yield();
+	}
+}
+
+// PARALLEL FOR
+// Splits [0, count) into ranges of at least grain and runs func on each, from any thread.
+// The returned job finishes once every range has. Submitted already, so it can't be given
+// dependencies, put the parallel for inside a job that has them instead.
+
+static Job* th_jobs_parallel_for(const char* name, U32 count, U32 grain, JobFunc func, void* data) {
+	Job* root = th_job_create(name, 0, 0);
+	grain = Max(grain, 1u);
+	// a few ranges per worker so stealing can even out uneven work
+	U32 target_ranges = th_job_system.worker_count * 4;
+	U32 range_size = Max(grain, (count + target_ranges - 1) / Max(target_ranges, 1u));
+	for (U32 begin = 0; begin < count; begin += range_size) {
+		Job* job = th_job_create(name, func, data, root);
+		job->begin = begin;
+		job->end = Min(begin + range_size, count);
+		th_job_submit(job);
+	}
+	th_job_finish(root); // its own (empty) share of the work
+	return root;
+}
+
+static void th_jobs_parallel_for_wait(const char* name, U32 count, U32 grain, JobFunc func, void* data) {
+	if (count == 0)
+		return;
+	if (count <= grain || th_job_system.worker_count <= 1) {
+		func(data, 0, count); // not worth splitting, or nobody to split it with
+		return;
+	}
+	th_job_wait(th_jobs_parallel_for(name, count, grain, func, data));
+}
+
+// WORKERS
+
+static void th_job_worker_loop(JobWorker* worker) {
+	th_job_worker_local = worker;
+	th_profile_thread_name("job worker");
+	while (th_job_system.running.load(std::memory_order_acquire)) {
+		Job* job = 0;
+		for (U32 spin = 0; spin < TH_JOB_SPIN_COUNT && !job; spin++) {
+			job = th_job_get(worker);
+			if (!job)
+				th_os_thread_yield();
+		}
+		if (job) {
+			th_job_execute(worker, job);
+			continue;
+		}
+		// nothing to do, sleep until someone pushes. Check again after announcing ourselves so a
+		// push that raced us still gets seen
+		th_job_system.sleeping.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the one in th_job_push
+		job = th_job_get(worker);
+		if (!job && th_job_system.running.load(std::memory_order_acquire)) {
+#if OS_WINDOWS
+			WaitForSingleObject(th_job_system.wake, INFINITE);
+#elif OS_LINUX || OS_MAC
+			sem_wait(&th_job_system.wake);
+#endif
+		}
+		th_job_system.sleeping.fetch_sub(1, std::memory_order_seq_cst);
+		if (job)
+			th_job_execute(worker, job);
+	}
+}
+
+#if OS_WINDOWS
+static unsigned __stdcall th_job_thread_proc(void* param) {
+	th_job_worker_loop((JobWorker*)param);
+	return 0;
+}
+#elif OS_LINUX || OS_MAC
+static void* th_job_thread_proc(void* param) {
+	th_job_worker_loop((JobWorker*)param);
+	return 0;
+}
+#endif
+
+// thread_count 0 picks one per core. 1 runs every job on the calling thread
+static void th_jobs_init(Arena* arena, U32 thread_count) {
+	JobSystem* system = &th_job_system;
+	if (thread_count == 0)
+		thread_count = th_os_core_count();
+	thread_count = Clamp(1u, thread_count, (U32)TH_JOB_MAX_THREADS);
+#if !(OS_WINDOWS || OS_LINUX || OS_MAC)
+	thread_count = 1;
+#endif
+	system->worker_count = thread_count;
+	system->workers = ArenaPushArray(arena, JobWorker, thread_count);
+	system->running.store(1);
+	system->sleeping.store(0);
+#if OS_WINDOWS
+	system->wake = CreateSemaphoreA(0, 0, TH_JOB_MAX_THREADS, 0);
+#elif OS_LINUX || OS_MAC
+	sem_init(&system->wake, 0, 0);
+#endif
+
+	for (U32 i = 0; i < thread_count; i++) {
+		JobWorker* worker = &system->workers[i];
+		memset((void*)worker, 0, sizeof(*worker));
+		worker->index = i;
+		worker->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+		worker->pool = ArenaPushArray(arena, Job, TH_JOB_POOL_SIZE);
+		memset((void*)worker->pool, 0, sizeof(Job) * TH_JOB_POOL_SIZE);
+	}
+	th_job_worker_local = &system->workers[0];
+	for (U32 i = 1; i < thread_count; i++) {
+		JobWorker* worker = &system->workers[i];
+#if OS_WINDOWS
+		worker->thread = (HANDLE)_beginthreadex(0, 0, th_job_thread_proc, worker, 0, 0);
+#elif OS_LINUX || OS_MAC
+		pthread_create(&worker->thread, 0, th_job_thread_proc, worker);
+#endif
+	}
+}
+
+static void th_jobs_shutdown() {
+	JobSystem* system = &th_job_system;
+	system->running.store(0);
+	for (U32 i = 1; i < system->worker_count; i++) {
+#if OS_WINDOWS
+		ReleaseSemaphore(system->wake, 1, 0);
+#elif OS_LINUX || OS_MAC
+		sem_post(&system->wake);
+#endif
+	}
+	for (U32 i = 1; i < system->worker_count; i++) {
+#if OS_WINDOWS
+		WaitForSingleObject(system->workers[i].thread, INFINITE);
+		CloseHandle(system->workers[i].thread);
+#elif OS_LINUX || OS_MAC
+		pthread_join(system->workers[i].thread, 0);
+#endif
+	}
+#if OS_WINDOWS
+	CloseHandle(system->wake);
+#elif OS_LINUX || OS_MAC
+	sem_destroy(&system->wake);
+#endif
+	system->worker_count = 0;
+}
+
+// TIMING
+// Every executed job leaves a JobTiming on the thread that ran it. Clear at the top of the frame,
+// read them back once nothing is in flight.
+
+static void th_jobs_timings_clear() {
+	for (U32 i = 0; i < th_job_system.worker_count; i++)
+		th_job_system.workers[i].timing_count = 0;
+}
+
+static void th_jobs_log_timings() {
+	for (U32 i = 0; i < th_job_system.worker_count; i++) {
+		JobWorker* worker = &th_job_system.workers[i];
+		for (U32 t = 0; t < worker->timing_count; t++) {
+			JobTiming* timing = &worker->timings[t];
+			LOG("job thread %2u  %-16s [%6u, %6u)  %8.3fms", i, timing->name ? timing->name : "?",
+				timing->begin, timing->end, (timing->end_ns - timing->start_ns) / 1000000.0);
+		}
+	}
+}
+
+#endif
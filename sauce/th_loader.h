@@ -0,0 +1,200 @@
+#ifndef TH_LOADER_H
+#define TH_LOADER_H
+
+// Background image decoding. A few threads of its own, apart from the job system, so a slow
+// decode can never land on a thread the frame is waiting on. Submit from the main thread, then
+// peek/pop the finished decodes from it whenever there's time to upload them.
+// Requests and results sit in fixed rings behind one lock that's only held to copy an entry.
+// Results come back in completion order, not submit order.
+
+#define TH_LOADER_MAX_THREADS 8
+#define TH_LOADER_QUEUE_SIZE 1024 // loads in flight at once, power of two
+
+// must be thread safe, returns RGBA8 pixels or 0
+typedef U8* (*ImageDecodeFunc)(const char* path, S32* width, S32* height);
+typedef void (*ImageFreeFunc)(U8* pixels);
+
+struct ImageLoad {
+	const char* path; // has to outlive the load, interned names do
+	U32 user; // handed back untouched
+	S32 width;
+	S32 height;
+	U8* pixels; // 0 if decoding failed
+};
+
+struct ImageLoader {
+	ImageDecodeFunc decode;
+	ImageFreeFunc free_pixels;
+	U32 thread_count;
+	U32 in_flight; // submitted and not popped yet, main thread only. Keeps both rings from overflowing
+	std::atomic<B32> running;
+	ImageLoad requests[TH_LOADER_QUEUE_SIZE];
+	U32 request_head;
+	U32 request_tail;
+	ImageLoad results[TH_LOADER_QUEUE_SIZE];
+	U32 result_head;
+	U32 result_tail;
+#if OS_WINDOWS
+	SRWLOCK lock;
+	HANDLE work;
+	HANDLE threads[TH_LOADER_MAX_THREADS];
+#elif OS_LINUX || OS_MAC
+	pthread_mutex_t lock;
+	sem_t work;
+	pthread_t threads[TH_LOADER_MAX_THREADS];
+#endif
+};
+
+static void th_loader_lock(ImageLoader* loader) {
+#if OS_WINDOWS
+	AcquireSRWLockExclusive(&loader->lock);
+#elif OS_LINUX || OS_MAC
+	pthread_mutex_lock(&loader->lock);
+#endif
+}
+
+static void th_loader_unlock(ImageLoader* loader) {
+#if OS_WINDOWS
+	ReleaseSRWLockExclusive(&loader->lock);
+#elif OS_LINUX || OS_MAC
+	pthread_mutex_unlock(&loader->lock);
+#endif
+}
+
+static void th_loader_thread_loop(ImageLoader* loader) {
+	th_profile_thread_name("image loader");
+	for (;;) {
+#if OS_WINDOWS
+		WaitForSingleObject(loader->work, INFINITE);
+#elif OS_LINUX || OS_MAC
+		sem_wait(&loader->work);
+#endif
+		if (!loader->running.load(std::memory_order_acquire))
+			return;
+		th_loader_lock(loader);
+		ImageLoad load = loader->requests[loader->request_head++ & (TH_LOADER_QUEUE_SIZE - 1)];
+		th_loader_unlock(loader);
+
+		{
+			TH_PROFILE_ZONE("image decode");
+			load.pixels = loader->decode(load.path, &load.width, &load.height);
+		}
+
+		th_loader_lock(loader);
+		loader->results[loader->result_tail++ & (TH_LOADER_QUEUE_SIZE - 1)] = load;
+		th_loader_unlock(loader);
+	}
+}
+
+#if OS_WINDOWS
+static unsigned __stdcall th_loader_thread_proc(void* param) {
+	th_loader_thread_loop((ImageLoader*)param);
+	return 0;
+}
+#elif OS_LINUX || OS_MAC
+static void* th_loader_thread_proc(void* param) {
+	th_loader_thread_loop((ImageLoader*)param);
+	return 0;
+}
+#endif
+
+// with no threads (or no thread support) th_loader_submit decodes right away on the caller
+static void th_loader_init(ImageLoader* loader, U32 thread_count, ImageDecodeFunc decode, ImageFreeFunc free_pixels) {
+	memset((void*)loader, 0, sizeof(*loader));
+	loader->decode = decode;
+	loader->free_pixels = free_pixels;
+#if !(OS_WINDOWS || OS_LINUX || OS_MAC)
+	thread_count = 0;
+#endif
+	loader->thread_count = ClampTop(thread_count, (U32)TH_LOADER_MAX_THREADS);
+	loader->running.store(1);
+#if OS_WINDOWS
+	InitializeSRWLock(&loader->lock);
+	loader->work = CreateSemaphoreA(0, 0, TH_LOADER_QUEUE_SIZE, 0);
+	for (U32 i = 0; i < loader->thread_count; i++)
+		loader->threads[i] = (HANDLE)_beginthreadex(0, 0, th_loader_thread_proc, loader, 0, 0);
+#elif OS_LINUX || OS_MAC
+	pthread_mutex_init(&loader->lock, 0);
+	sem_init(&loader->work, 0, 0);
+	for (U32 i = 0; i < loader->thread_count; i++)
+		pthread_create(&loader->threads[i], 0, th_loader_thread_proc, loader);
+#endif
+}
+
+// 0 if too many loads are already in flight, try again after popping some
+static B8 th_loader_submit(ImageLoader* loader, const char* path, U32 user) {
+	if (loader->in_flight == TH_LOADER_QUEUE_SIZE)
+		return 0;
+	loader->in_flight++;
+	ImageLoad load = { 0 };
+	load.path = path;
+	load.user = user;
+	if (!loader->thread_count) {
+		{
+			TH_PROFILE_ZONE("image decode");
+			load.pixels = loader->decode(load.path, &load.width, &load.height);
+		}
+		loader->results[loader->result_tail++ & (TH_LOADER_QUEUE_SIZE - 1)] = load;
+		return 1;
+	}
+	th_loader_lock(loader);
+	loader->requests[loader->request_tail++ & (TH_LOADER_QUEUE_SIZE - 1)] = load;
+	th_loader_unlock(loader);
+#if OS_WINDOWS
+	ReleaseSemaphore(loader->work, 1, 0);
+#elif OS_LINUX || OS_MAC
+	sem_post(&loader->work);
+#endif
+	return 1;
+}
+
+// oldest finished decode, stays put until th_loader_pop. 0 if nothing has finished
+static const ImageLoad* th_loader_peek(ImageLoader* loader) {
+	th_loader_lock(loader);
+	B8 any = loader->result_head != loader->result_tail;
+	th_loader_unlock(loader);
+	return any ? &loader->results[loader->result_head & (TH_LOADER_QUEUE_SIZE - 1)] : 0;
+}
+
+// frees the peeked load's pixels, upload them first
+static void th_loader_pop(ImageLoader* loader) {
+	ImageLoad* load = &loader->results[loader->result_head & (TH_LOADER_QUEUE_SIZE - 1)];
+	if (load->pixels)
+		loader->free_pixels(load->pixels);
+	th_loader_lock(loader);
+	Assert(loader->result_head != loader->result_tail); // nothing to pop
+	loader->result_head++;
+	th_loader_unlock(loader);
+	loader->in_flight--;
+}
+
+// waits for decodes already running, drops the ones that haven't started
+static void th_loader_shutdown(ImageLoader* loader) {
+	loader->running.store(0, std::memory_order_release);
+	for (U32 i = 0; i < loader->thread_count; i++) {
+#if OS_WINDOWS
+		ReleaseSemaphore(loader->work, 1, 0);
+#elif OS_LINUX || OS_MAC
+		sem_post(&loader->work);
+#endif
+	}
+	for (U32 i = 0; i < loader->thread_count; i++) {
+#if OS_WINDOWS
+		WaitForSingleObject(loader->threads[i], INFINITE);
+		CloseHandle(loader->threads[i]);
+#elif OS_LINUX || OS_MAC
+		pthread_join(loader->threads[i], 0);
+#endif
+	}
+	while (th_loader_peek(loader))
+		th_loader_pop(loader);
+#if OS_WINDOWS
+	CloseHandle(loader->work);
+#elif OS_LINUX || OS_MAC
+	sem_destroy(&loader->work);
+	pthread_mutex_destroy(&loader->lock);
+#endif
+	loader->thread_count = 0;
+}
+
+#endif
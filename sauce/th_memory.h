@@ -1,2 +1,186 @@
 // what's the minimum amount of memory that we have available?
-// ^ answer this question. Allocate the amount. And then work backwards from there.
\ No newline at end of file
+// ^ answer this question. Allocate the amount. And then work backwards from there.
+#ifndef TH_MEMORY_H
+#define TH_MEMORY_H
+
+// Arenas reserve a big chunk of address space up front and only commit pages as the
+// push position walks into them. The base pointer never moves, so an arena that is only
+// used for one type doubles as a growable flat array with stable pointers.
+
+#if OS_WINDOWS
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif OS_LINUX || OS_MAC
+#include <sys/mman.h>
+#endif
+
+#define TH_ARENA_DEFAULT_RESERVE Gigabytes(1)
+#define TH_ARENA_COMMIT_SIZE Kilobytes(64)
+#define TH_ARENA_DEFAULT_ALIGN 8
+
+struct Arena {
+	const char* name;
+	U8* base;
+	U64 reserved;
+	U64 committed;
+	U64 pos;
+	U64 high_water; // largest pos ever reached, use this to size the reserve for shipping
+};
+
+struct TempArena {
+	Arena* arena;
+	U64 pos;
+};
+
+// running totals for everything the calling thread pushed, benchmarks diff them around a run
+struct ArenaCounters {
+	U64 push_count;
+	U64 push_bytes;
+	U64 commit_count; // trips to the OS
+	U64 commit_bytes;
+};
+
+#ifndef TH_SHIP
+static thread_local ArenaCounters th_arena_counters;
+#endif
+
+// OS VIRTUAL MEMORY
+
+static void* th_os_reserve(U64 size) {
+#if OS_WINDOWS
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+#elif OS_LINUX || OS_MAC
+	void* result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return result == MAP_FAILED ? 0 : result;
+#else
+	return malloc(size); // no virtual memory, everything is committed up front
+#endif
+}
+
+static B8 th_os_commit(void* ptr, U64 size) {
+#if OS_WINDOWS
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+#elif OS_LINUX || OS_MAC
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#else
+	return 1;
+#endif
+}
+
+static void th_os_release(void* ptr, U64 size) {
+#if OS_WINDOWS
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#elif OS_LINUX || OS_MAC
+	munmap(ptr, size);
+#else
+	free(ptr);
+#endif
+}
+
+// ARENA
+
+static void th_arena_init(Arena* arena, const char* name, U64 reserve = TH_ARENA_DEFAULT_RESERVE) {
+	MemoryZeroStruct(arena);
+	arena->name = name;
+	arena->reserved = reserve;
+	arena->base = (U8*)th_os_reserve(reserve);
+	Assert(arena->base); // out of address space
+}
+
+static void th_arena_release(Arena* arena) {
+	if (arena->base)
+		th_os_release(arena->base, arena->reserved);
+	MemoryZeroStruct(arena);
+}
+
+static void* th_arena_push(Arena* arena, U64 size, U64 align = TH_ARENA_DEFAULT_ALIGN) {
+	Assert(arena->base); // arena was never initialised
+	U64 pos = arena->pos;
+	U64 misalign = (U64)(arena->base + pos) & (align - 1);
+	if (misalign)
+		pos += align - misalign;
+	U64 new_pos = pos + size;
+	Assert(new_pos <= arena->reserved); // bump the reserve for this arena
+
+	if (new_pos > arena->committed) {
+		U64 commit_end = new_pos + TH_ARENA_COMMIT_SIZE - 1;
+		commit_end -= commit_end % TH_ARENA_COMMIT_SIZE;
+		commit_end = ClampTop(commit_end, arena->reserved);
+		B8 ok = th_os_commit(arena->base + arena->committed, commit_end - arena->committed);
+		Assert(ok);
+#ifndef TH_SHIP
+		th_arena_counters.commit_count++;
+		th_arena_counters.commit_bytes += commit_end - arena->committed;
+#endif
+		arena->committed = commit_end;
+	}
+#ifndef TH_SHIP
+	th_arena_counters.push_count++;
+	th_arena_counters.push_bytes += new_pos - arena->pos;
+#endif
+
+	arena->pos = new_pos;
+	arena->high_water = Max(arena->high_water, new_pos);
+	return arena->base + pos;
+}
+
+static void* th_arena_push_zero(Arena* arena, U64 size, U64 align = TH_ARENA_DEFAULT_ALIGN) {
+	void* result = th_arena_push(arena, size, align);
+	MemoryZero(result, size);
+	return result;
+}
+
+// pages stay committed, so clearing and refilling an arena every frame never touches the OS
+static void th_arena_pop_to(Arena* arena, U64 pos) {
+	Assert(pos <= arena->pos);
+	arena->pos = pos;
+}
+
+static void th_arena_clear(Arena* arena) {
+	th_arena_pop_to(arena, 0);
+}
+
+#define ArenaPushArray(arena, type, count) (type*)th_arena_push((arena), sizeof(type) * (count), alignof(type))
+#define ArenaPushArrayZero(arena, type, count) (type*)th_arena_push_zero((arena), sizeof(type) * (count), alignof(type))
+#define ArenaPushStruct(arena, type) ArenaPushArray(arena, type, 1)
+#define ArenaPushStructZero(arena, type) ArenaPushArrayZero(arena, type, 1)
+
+static TempArena th_temp_begin(Arena* arena) {
+	TempArena temp = { arena, arena->pos };
+	return temp;
+}
+
+static void th_temp_end(TempArena temp) {
+	th_arena_pop_to(temp.arena, temp.pos);
+}
+
+// ARENA ARRAYS
+// An arena that only ever holds one flat array. Same shape as TH_ARRAY_PUSH, but instead of
+// asserting at a hard cap it commits more pages behind the array.
+
+static void* th_arena_array_push(Arena* arena, void* array, U64 count, U64 element_size) {
+	Assert((U8*)array == arena->base); // array must own the whole arena
+	Assert(count * element_size == arena->pos);
+	return th_arena_push_zero(arena, element_size, 1);
+}
+
+#define TH_ARENA_ARRAY_INIT(arena, array) ((array) = (decltype(array))(arena)->base)
+#define TH_ARENA_ARRAY_PUSH(arena, array, count) (decltype(array))th_arena_array_push((arena), (array), (count)++, sizeof(*(array)))
+
+// STATS
+
+static void th_arena_log_stats(const Arena* arena) {
+	LOG("arena %-12s pos %8.1fkb  high water %8.1fkb  committed %8.1fkb  reserved %8.1fmb",
+		arena->name ? arena->name : "?",
+		arena->pos / 1024.0,
+		arena->high_water / 1024.0,
+		arena->committed / 1024.0,
+		arena->reserved / (1024.0 * 1024.0));
+}
+
+#endif
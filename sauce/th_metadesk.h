@@ -0,0 +1,21 @@
+#ifndef TH_METADESK_H
+#define TH_METADESK_H
+
+// Metadesk, the parser for the .mdesk definition files, built into whichever translation unit
+// includes this. Include it once per program.
+// md.c is C, built here as C++ it hands string literals to char* all over, so its warnings
+// are switched off for the include.
+
+#define MD_FUNCTION static
+#include "third_party/metadesk/md.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#pragma GCC diagnostic ignored "-Wdeprecated-enum-enum-conversion"
+#endif
+#include "third_party/metadesk/md.c"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
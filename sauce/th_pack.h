@@ -0,0 +1,225 @@
+#ifndef TH_PACK_H
+#define TH_PACK_H
+
+// Baked asset pack. One file: header, atlas table, sprite table, data tables, string table,
+// then every atlas's pixels, each starting on its own page. Pixels are stored exactly as sg_make_image
+// wants them (RGBA8, rows already flipped), so the loader maps the file and hands the mapped
+// pages straight to the GPU upload with no decode and no copy. Data tables are arrays of
+// whatever records the game defines, found by name and read in place.
+// Written by th_packer.cpp. Bump TH_PACK_VERSION on any layout change, old packs are refused.
+
+#if OS_LINUX || OS_MAC
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TH_PACK_MAGIC 0x4B505448 // "THPK"
+#define TH_PACK_VERSION 2
+#define TH_PACK_PIXEL_ALIGN 4096
+
+enum PackFormat {
+	PackFormat_rgba8,
+};
+
+struct PackHeader {
+	U32 magic;
+	U32 version;
+	U32 atlas_count;
+	U32 sprite_count;
+	U32 table_count;
+	U32 reserved;
+	U64 atlas_offset; // PackAtlas[atlas_count]
+	U64 sprite_offset; // PackSprite[sprite_count]
+	U64 table_offset; // PackTable[table_count]
+	U64 string_offset; // null terminated names, referenced by offset from here
+	U64 string_size;
+	U64 file_size;
+};
+
+struct PackAtlas {
+	U32 name; // string table offset
+	U32 format; // PackFormat
+	U32 width;
+	U32 height;
+	U64 pixel_offset; // from the start of the file, TH_PACK_PIXEL_ALIGN aligned
+	U64 pixel_size;
+};
+
+struct PackSprite {
+	U32 name;
+	U32 atlas; // index into the atlas table
+	Rng2F32 sub_rect;
+};
+
+struct PackTable {
+	U32 name;
+	U32 stride; // sizeof the record, a mismatch means the pack was baked from other code
+	U32 count;
+	U32 reserved;
+	U64 offset; // from the start of the file, 16 byte aligned
+};
+
+// FILES
+
+struct MappedFile {
+	U8* data;
+	U64 size;
+#if OS_WINDOWS
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+// read only. Returns 0 if the file can't be opened
+static B8 th_os_file_map(MappedFile* file, const char* path) {
+	MemoryZeroStruct(file);
+#if OS_WINDOWS
+	file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file->file == INVALID_HANDLE_VALUE)
+		return 0;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file->file, &size);
+	file->size = size.QuadPart;
+	file->mapping = CreateFileMappingA(file->file, 0, PAGE_READONLY, 0, 0, 0);
+	if (file->mapping)
+		file->data = (U8*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!file->data) {
+		if (file->mapping)
+			CloseHandle(file->mapping);
+		CloseHandle(file->file);
+		MemoryZeroStruct(file);
+		return 0;
+	}
+	return 1;
+#elif OS_LINUX || OS_MAC
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if (data == MAP_FAILED)
+		return 0;
+	file->data = (U8*)data;
+	file->size = st.st_size;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void th_os_file_unmap(MappedFile* file) {
+#if OS_WINDOWS
+	if (file->data) {
+		UnmapViewOfFile(file->data);
+		CloseHandle(file->mapping);
+		CloseHandle(file->file);
+	}
+#elif OS_LINUX || OS_MAC
+	if (file->data)
+		munmap(file->data, file->size);
+#endif
+	MemoryZeroStruct(file);
+}
+
+// reads the whole file into arena with a null after it. 0 if it can't be read
+static char* th_file_read(Arena* arena, const char* path, U64* out_size) {
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* data = 0;
+	if (size >= 0) {
+		data = (char*)th_arena_push(arena, size + 1, 1);
+		if (fread(data, 1, size, file) != (size_t)size)
+			data = 0;
+		else
+			data[size] = 0;
+	}
+	fclose(file);
+	if (data && out_size)
+		*out_size = size;
+	return data;
+}
+
+// PACK READING
+
+struct PackView {
+	const PackHeader* header;
+	const PackAtlas* atlases;
+	const PackSprite* sprites;
+	const PackTable* tables;
+	const char* strings;
+	const U8* base;
+};
+
+// checks everything the loader is about to index with, a bad pack is refused instead of trusted
+static B8 th_pack_open(PackView* view, const U8* data, U64 size) {
+	MemoryZeroStruct(view);
+	if (size < sizeof(PackHeader))
+		return 0;
+	const PackHeader* header = (const PackHeader*)data;
+	if (header->magic != TH_PACK_MAGIC || header->version != TH_PACK_VERSION || header->file_size != size)
+		return 0;
+	if (header->atlas_offset + (U64)header->atlas_count * sizeof(PackAtlas) > size ||
+		header->sprite_offset + (U64)header->sprite_count * sizeof(PackSprite) > size ||
+		header->table_offset + (U64)header->table_count * sizeof(PackTable) > size ||
+		header->string_offset + header->string_size > size ||
+		header->string_size == 0 || data[header->string_offset + header->string_size - 1] != 0)
+		return 0;
+
+	view->header = header;
+	view->base = data;
+	view->atlases = (const PackAtlas*)(data + header->atlas_offset);
+	view->sprites = (const PackSprite*)(data + header->sprite_offset);
+	view->tables = (const PackTable*)(data + header->table_offset);
+	view->strings = (const char*)(data + header->string_offset);
+	for (U32 i = 0; i < header->atlas_count; i++) {
+		const PackAtlas* atlas = &view->atlases[i];
+		if (atlas->format != PackFormat_rgba8 || atlas->name >= header->string_size ||
+			atlas->pixel_size != (U64)atlas->width * atlas->height * 4 ||
+			atlas->pixel_offset + atlas->pixel_size > size)
+			return 0;
+	}
+	for (U32 i = 0; i < header->sprite_count; i++) {
+		const PackSprite* sprite = &view->sprites[i];
+		if (sprite->atlas >= header->atlas_count || sprite->name >= header->string_size)
+			return 0;
+	}
+	for (U32 i = 0; i < header->table_count; i++) {
+		const PackTable* table = &view->tables[i];
+		if (table->name >= header->string_size || table->offset % 16 ||
+			table->offset + (U64)table->count * table->stride > size)
+			return 0;
+	}
+	return 1;
+}
+
+static const char* th_pack_string(const PackView* view, U32 offset) {
+	return view->strings + offset;
+}
+
+// records of the named table, 0 if there's no such table or its records aren't stride bytes.
+// Anything in them that indexes or names something else is the caller's to check
+static const void* th_pack_table(const PackView* view, const char* name, U32 stride, U32* out_count) {
+	*out_count = 0;
+	for (U32 i = 0; i < view->header->table_count; i++) {
+		const PackTable* table = &view->tables[i];
+		if (strcmp(th_pack_string(view, table->name), name) != 0)
+			continue;
+		if (table->stride != stride)
+			return 0;
+		*out_count = table->count;
+		return view->base + table->offset;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,210 @@
+// Offline asset packer. Parses the asset definitions, decodes every atlas they use and bakes
+// them, the sprite, archetype and emitter tables and the names into one pack the game can map
+// and upload without parsing or decoding anything.
+// Run from data/:
+//   thomas_packer [--out assets.pack] [--verify]
+// only the asset side of the engine, none of the runtime (jobs, coroutines, loaders)
+#include "th_telescope.h"
+#include "th_dump.h"
+#include "th_memory.h"
+#include "th_assets.h"
+#include "th_pack.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "third_party/stb_image.h"
+
+#include "th_metadesk.h"
+
+#include "anvil_assets.h"
+
+static U64 packer_align(U64 value, U64 align) {
+	return (value + align - 1) & ~(align - 1);
+}
+
+// names are referenced by their offset into the table
+struct PackStrings {
+	Arena arena;
+	char* data;
+	U32 size;
+};
+
+static U32 packer_push_string(PackStrings* strings, const char* string) {
+	U32 offset = strings->size;
+	U32 length = c_string_length(string);
+	for (U32 i = 0; i <= length; i++)
+		*TH_ARENA_ARRAY_PUSH(&strings->arena, strings->data, strings->size) = string[i];
+	return offset;
+}
+
+static B8 packer_write_zeros(FILE* file, U64 count) {
+	static const U8 zeros[TH_PACK_PIXEL_ALIGN] = { 0 };
+	while (count) {
+		U64 chunk = Min(count, (U64)sizeof(zeros));
+		if (fwrite(zeros, 1, chunk, file) != chunk)
+			return 0;
+		count -= chunk;
+	}
+	return 1;
+}
+
+// one data table's records, written after the sprite table
+struct PackerTable {
+	const char* name;
+	U32 stride;
+	U32 count;
+	const void* records;
+};
+
+static int packer_fail(const char* message, const char* detail) {
+	fprintf(stderr, "thomas_packer: %s %s\n", message, detail);
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	const char* out_path = ASSET_PACK_PATH;
+	B8 verify = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--out") && i + 1 < argc)
+			out_path = argv[++i];
+		else if (!strcmp(argv[i], "--verify"))
+			verify = 1;
+		else
+			return packer_fail("unknown argument", argv[i]);
+	}
+
+	Arena arena;
+	th_arena_init(&arena, "packer");
+	PackStrings strings = { 0 };
+	th_arena_init(&strings.arena, "pack strings", Megabytes(64));
+	TH_ARENA_ARRAY_INIT(&strings.arena, strings.data);
+
+	AssetDefs defs;
+	if (!th_asset_defs_load(&arena, ASSET_DEFS_PATH, &defs))
+		return packer_fail("can't load", ASSET_DEFS_PATH);
+	const U32 atlas_count = defs.atlas_count;
+	const U32 sprite_count = defs.sprite_count;
+	PackAtlas* atlases = ArenaPushArrayZero(&arena, PackAtlas, atlas_count);
+	PackSprite* sprites = ArenaPushArrayZero(&arena, PackSprite, sprite_count);
+	PackArchetype* archetypes = ArenaPushArrayZero(&arena, PackArchetype, defs.archetype_count);
+	PackEmitter* emitters = ArenaPushArrayZero(&arena, PackEmitter, defs.emitter_count);
+	U8** pixels = ArenaPushArrayZero(&arena, U8*, atlas_count);
+	const U64 atlas_table_size = sizeof(PackAtlas) * atlas_count;
+	const U64 sprite_table_size = sizeof(PackSprite) * sprite_count;
+
+	// same orientation and channel count the game's upload wants
+	stbi_set_flip_vertically_on_load(1);
+	for (U32 i = 0; i < atlas_count; i++) {
+		int width, height, comp;
+		pixels[i] = stbi_load(defs.atlases[i], &width, &height, &comp, 4);
+		if (!pixels[i])
+			return packer_fail("can't decode", defs.atlases[i]);
+		atlases[i].name = packer_push_string(&strings, defs.atlases[i]);
+		atlases[i].format = PackFormat_rgba8;
+		atlases[i].width = width;
+		atlases[i].height = height;
+		atlases[i].pixel_size = (U64)width * height * 4;
+	}
+	for (U32 i = 0; i < sprite_count; i++) {
+		const SpriteDef* def = &defs.sprites[i];
+		U32 atlas = 0;
+		while (defs.atlases[atlas] != def->atlas)
+			atlas++;
+		sprites[i].name = packer_push_string(&strings, def->name);
+		sprites[i].atlas = atlas;
+		sprites[i].sub_rect = def->sub_rect;
+	}
+	for (U32 i = 0; i < defs.archetype_count; i++) {
+		const ArchetypeDef* def = &defs.archetypes[i];
+		archetypes[i].name = packer_push_string(&strings, def->name);
+		for (U32 j = 0; j < sprite_count && def->sprite; j++) {
+			if (defs.sprites[j].name == def->sprite)
+				archetypes[i].sprite = j + 1;
+		}
+		archetypes[i].params = def->params;
+	}
+	for (U32 i = 0; i < defs.emitter_count; i++) {
+		emitters[i].name = packer_push_string(&strings, defs.emitters[i].name);
+		emitters[i].params = defs.emitters[i].params;
+	}
+	PackerTable tables[] = {
+		{ ASSET_TABLE_ARCHETYPES, sizeof(PackArchetype), defs.archetype_count, archetypes },
+		{ ASSET_TABLE_EMITTERS, sizeof(PackEmitter), defs.emitter_count, emitters },
+	};
+	const U32 table_count = ArrayCount(tables);
+	PackTable table_entries[ArrayCount(tables)] = { 0 };
+	for (U32 i = 0; i < table_count; i++) {
+		table_entries[i].name = packer_push_string(&strings, tables[i].name);
+		table_entries[i].stride = tables[i].stride;
+		table_entries[i].count = tables[i].count;
+	}
+
+	PackHeader header = { 0 };
+	header.magic = TH_PACK_MAGIC;
+	header.version = TH_PACK_VERSION;
+	header.atlas_count = atlas_count;
+	header.sprite_count = sprite_count;
+	header.table_count = table_count;
+	header.atlas_offset = packer_align(sizeof(PackHeader), 16);
+	header.sprite_offset = packer_align(header.atlas_offset + atlas_table_size, 16);
+	header.table_offset = packer_align(header.sprite_offset + sprite_table_size, 16);
+	U64 cursor = header.table_offset + sizeof(table_entries);
+	for (U32 i = 0; i < table_count; i++) {
+		table_entries[i].offset = packer_align(cursor, 16);
+		cursor = table_entries[i].offset + (U64)tables[i].stride * tables[i].count;
+	}
+	header.string_offset = cursor;
+	header.string_size = strings.size;
+	cursor = header.string_offset + strings.size;
+	for (U32 i = 0; i < atlas_count; i++) {
+		atlases[i].pixel_offset = packer_align(cursor, TH_PACK_PIXEL_ALIGN);
+		cursor = atlases[i].pixel_offset + atlases[i].pixel_size;
+	}
+	header.file_size = cursor;
+
+	FILE* file = fopen(out_path, "wb");
+	if (!file)
+		return packer_fail("can't open", out_path);
+	B8 ok = 1;
+	ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && packer_write_zeros(file, header.atlas_offset - sizeof(header));
+	ok = ok && fwrite(atlases, 1, atlas_table_size, file) == atlas_table_size;
+	ok = ok && packer_write_zeros(file, header.sprite_offset - (header.atlas_offset + atlas_table_size));
+	ok = ok && fwrite(sprites, 1, sprite_table_size, file) == sprite_table_size;
+	ok = ok && packer_write_zeros(file, header.table_offset - (header.sprite_offset + sprite_table_size));
+	ok = ok && fwrite(table_entries, sizeof(table_entries), 1, file) == 1;
+	U64 written = header.table_offset + sizeof(table_entries);
+	for (U32 i = 0; i < table_count; i++) {
+		U64 size = (U64)tables[i].stride * tables[i].count;
+		ok = ok && packer_write_zeros(file, table_entries[i].offset - written);
+		ok = ok && fwrite(tables[i].records, 1, size, file) == size;
+		written = table_entries[i].offset + size;
+	}
+	ok = ok && fwrite(strings.data, strings.size, 1, file) == 1;
+	written = header.string_offset + strings.size;
+	for (U32 i = 0; i < atlas_count && ok; i++) {
+		ok = ok && packer_write_zeros(file, atlases[i].pixel_offset - written);
+		ok = ok && fwrite(pixels[i], atlases[i].pixel_size, 1, file) == 1;
+		written = atlases[i].pixel_offset + atlases[i].pixel_size;
+		stbi_image_free(pixels[i]);
+	}
+	ok = (fclose(file) == 0) && ok;
+	if (!ok)
+		return packer_fail("failed writing", out_path);
+
+	if (verify) {
+		MappedFile mapped;
+		PackView view;
+		if (!th_os_file_map(&mapped, out_path) || !th_pack_open(&view, mapped.data, mapped.size))
+			return packer_fail("wrote a pack that doesn't load:", out_path);
+		for (U32 i = 0; i < table_count; i++) {
+			U32 count;
+			if (!th_pack_table(&view, tables[i].name, tables[i].stride, &count) && tables[i].count)
+				return packer_fail("wrote a pack without its table:", tables[i].name);
+		}
+		th_os_file_unmap(&mapped);
+	}
+
+	printf("%s: %u atlases, %u sprites, %u archetypes, %u emitters, %.1fkb\n", out_path, atlas_count, sprite_count,
+		defs.archetype_count, defs.emitter_count, header.file_size / 1024.0);
+	return 0;
+}
@@ -0,0 +1,203 @@
+#ifndef TH_PARTICLES_H
+#define TH_PARTICLES_H
+
+// Particles live in SoA buffers and the live ones are always packed into [0, count).
+// Simulation cost scales with how many particles are alive, not with capacity.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TH_PARTICLE_LANES 8
+#elif ARCH_X64 || defined(__SSE2__)
+#include <emmintrin.h>
+#define TH_PARTICLE_LANES 4
+#else
+#define TH_PARTICLE_LANES 1
+#endif
+
+// how alpha follows the particle's life, neither means it stays at its color's alpha
+enum ParticleFlag {
+	ParticleFlag_fade_in = 1 << 0, // from nothing up to full over the first half
+	ParticleFlag_fade_out = 1 << 1, // back down to nothing over the second half
+};
+
+// one particle at a time for th_particles_emit, bulk emitters fill the buffers after th_particles_reserve
+struct Particle {
+	Vec2 pos;
+	Vec2 vel;
+	Vec4 col;
+	F32 start_life;
+	F32 life;
+	F32 size_mult;
+	U32 flags; // ParticleFlag
+};
+
+struct ParticleSystem {
+	U32 capacity;
+	U32 count;
+	U32 dropped; // emits that didn't fit, running total
+	F32* pos_x;
+	F32* pos_y;
+	F32* vel_x;
+	F32* vel_y;
+	F32* col_r;
+	F32* col_g;
+	F32* col_b;
+	F32* col_a;
+	F32* life;
+	F32* start_life;
+	F32* size;
+	U32* flags;
+};
+
+static void th_particles_init(ParticleSystem* system, Arena* arena, U32 capacity) {
+	MemoryZeroStruct(system);
+	// pad to a full lane so the kernel never needs a masked tail
+	capacity = (capacity + 7) & ~7u;
+	system->capacity = capacity;
+	U64 size = sizeof(F32) * capacity;
+	system->pos_x = (F32*)th_arena_push_zero(arena, size, 32);
+	system->pos_y = (F32*)th_arena_push_zero(arena, size, 32);
+	system->vel_x = (F32*)th_arena_push_zero(arena, size, 32);
+	system->vel_y = (F32*)th_arena_push_zero(arena, size, 32);
+	system->col_r = (F32*)th_arena_push_zero(arena, size, 32);
+	system->col_g = (F32*)th_arena_push_zero(arena, size, 32);
+	system->col_b = (F32*)th_arena_push_zero(arena, size, 32);
+	system->col_a = (F32*)th_arena_push_zero(arena, size, 32);
+	system->life = (F32*)th_arena_push_zero(arena, size, 32);
+	system->start_life = (F32*)th_arena_push_zero(arena, size, 32);
+	system->size = (F32*)th_arena_push_zero(arena, size, 32);
+	system->flags = (U32*)th_arena_push_zero(arena, sizeof(U32) * capacity, 32);
+}
+
+static B8 th_particles_emit(ParticleSystem* system, const Particle* particle) {
+	if (system->count >= system->capacity) {
+		system->dropped++;
+		return 0;
+	}
+	U32 i = system->count++;
+	system->pos_x[i] = particle->pos.x;
+	system->pos_y[i] = particle->pos.y;
+	system->vel_x[i] = particle->vel.x;
+	system->vel_y[i] = particle->vel.y;
+	system->col_r[i] = particle->col.r;
+	system->col_g[i] = particle->col.g;
+	system->col_b[i] = particle->col.b;
+	system->col_a[i] = particle->col.a;
+	system->life[i] = particle->life;
+	system->start_life[i] = particle->start_life;
+	system->size[i] = particle->size_mult;
+	system->flags[i] = particle->flags;
+	return 1;
+}
+
+// Makes room for *count particles at the end of the live range and returns the first one's
+// index, the caller fills every buffer for them. *count comes back smaller if the system is full
+static U32 th_particles_reserve(ParticleSystem* system, U32* count) {
+	U32 room = system->capacity - system->count;
+	if (*count > room) {
+		system->dropped += *count - room;
+		*count = room;
+	}
+	U32 first = system->count;
+	system->count += *count;
+	return first;
+}
+
+// swap-remove, the last live particle moves into the hole
+static void th_particles_kill(ParticleSystem* system, U32 i) {
+	Assert(i < system->count);
+	U32 last = --system->count;
+	system->pos_x[i] = system->pos_x[last];
+	system->pos_y[i] = system->pos_y[last];
+	system->vel_x[i] = system->vel_x[last];
+	system->vel_y[i] = system->vel_y[last];
+	system->col_r[i] = system->col_r[last];
+	system->col_g[i] = system->col_g[last];
+	system->col_b[i] = system->col_b[last];
+	system->col_a[i] = system->col_a[last];
+	system->life[i] = system->life[last];
+	system->start_life[i] = system->start_life[last];
+	system->size[i] = system->size[last];
+	system->flags[i] = system->flags[last];
+}
+
+static void th_particles_integrate_scalar(ParticleSystem* system, U32 begin, U32 end, F32 delta_t) {
+	for (U32 i = begin; i < end; i++) {
+		system->pos_x[i] += system->vel_x[i] * delta_t;
+		system->pos_y[i] += system->vel_y[i] * delta_t;
+		system->life[i] -= delta_t;
+	}
+}
+
+// begin has to sit on a lane boundary, so ranges can be split across threads
+static void th_particles_integrate_range(ParticleSystem* system, U32 begin, U32 end, F32 delta_t) {
+	Assert((begin & (TH_PARTICLE_LANES - 1)) == 0);
+	// the buffers are padded, running past count only touches dead slots
+	end = (end + TH_PARTICLE_LANES - 1) & ~(TH_PARTICLE_LANES - 1);
+#if TH_PARTICLE_LANES == 8
+	__m256 dt = _mm256_set1_ps(delta_t);
+	for (U32 i = begin; i < end; i += 8) {
+		__m256 pos_x = _mm256_load_ps(system->pos_x + i);
+		__m256 pos_y = _mm256_load_ps(system->pos_y + i);
+		__m256 life = _mm256_load_ps(system->life + i);
+		pos_x = _mm256_add_ps(pos_x, _mm256_mul_ps(_mm256_load_ps(system->vel_x + i), dt));
+		pos_y = _mm256_add_ps(pos_y, _mm256_mul_ps(_mm256_load_ps(system->vel_y + i), dt));
+		_mm256_store_ps(system->pos_x + i, pos_x);
+		_mm256_store_ps(system->pos_y + i, pos_y);
+		_mm256_store_ps(system->life + i, _mm256_sub_ps(life, dt));
+	}
+#elif TH_PARTICLE_LANES == 4
+	__m128 dt = _mm_set1_ps(delta_t);
+	for (U32 i = begin; i < end; i += 4) {
+		__m128 pos_x = _mm_load_ps(system->pos_x + i);
+		__m128 pos_y = _mm_load_ps(system->pos_y + i);
+		__m128 life = _mm_load_ps(system->life + i);
+		pos_x = _mm_add_ps(pos_x, _mm_mul_ps(_mm_load_ps(system->vel_x + i), dt));
+		pos_y = _mm_add_ps(pos_y, _mm_mul_ps(_mm_load_ps(system->vel_y + i), dt));
+		_mm_store_ps(system->pos_x + i, pos_x);
+		_mm_store_ps(system->pos_y + i, pos_y);
+		_mm_store_ps(system->life + i, _mm_sub_ps(life, dt));
+	}
+#else
+	th_particles_integrate_scalar(system, begin, end, delta_t);
+#endif
+}
+
+static void th_particles_integrate(ParticleSystem* system, F32 delta_t) {
+	th_particles_integrate_range(system, 0, system->count, delta_t);
+}
+
+// walks the live range and swap-removes anything that ran out of life
+static void th_particles_compact(ParticleSystem* system) {
+	U32 i = 0;
+	while (i < system->count) {
+#if TH_PARTICLE_LANES >= 4
+		// skip whole lanes where everything is still alive
+		if (i + 4 <= system->count && (i & 3) == 0) {
+			__m128 dead = _mm_cmple_ps(_mm_load_ps(system->life + i), _mm_setzero_ps());
+			if (_mm_movemask_ps(dead) == 0) {
+				i += 4;
+				continue;
+			}
+		}
+#endif
+		if (system->life[i] <= 0.f)
+			th_particles_kill(system, i); // re-test i, it now holds the old last particle
+		else
+			i++;
+	}
+}
+
+// alpha multiplier for where the particle is in its life, by its fade flags
+static F32 th_particle_fade(U32 flags, F32 life, F32 start_life) {
+	F32 t = 1.f - life / start_life;
+	B8 fading = t < 0.5f ? (flags & ParticleFlag_fade_in) != 0 : (flags & ParticleFlag_fade_out) != 0;
+	return fading ? float_alpha_sin_mid(t) : 1.f;
+}
+
+static void th_particles_simulate(ParticleSystem* system, F32 delta_t) {
+	th_particles_integrate(system, delta_t);
+	th_particles_compact(system);
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef TH_PROFILE_H
+#define TH_PROFILE_H
+
+// Frame profiler. TH_PROFILE_ZONE("name") times the rest of its scope. Zones nest, and every
+// thread that opens one gets its own ring of finished zones. Only the owning thread writes its
+// ring, publishing with one atomic store per zone, so recording never takes a lock. Readers copy
+// the zones they want and then check the writer hasn't lapped them while they were copying.
+// Names must be string literals or otherwise live forever, only the pointer is kept.
+// th_profile_frame_mark() once a frame gives the overlay and the trace their frame boundaries.
+// Under TH_SHIP zones compile to nothing and the rest isn't there.
+
+#include <atomic>
+
+#if OS_LINUX || OS_MAC
+#include <time.h>
+#endif
+
+#define TH_PROFILE_MAX_THREADS 64
+#define TH_PROFILE_RING_SIZE 16384 // finished zones kept per thread, power of two
+#define TH_PROFILE_MAX_DEPTH 32
+#define TH_PROFILE_FRAME_HISTORY 256 // power of two
+
+static U64 th_os_time_ns() {
+#if OS_WINDOWS
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (U64)((F64)counter.QuadPart * 1000000000.0 / (F64)frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (U64)ts.tv_sec * 1000000000ull + (U64)ts.tv_nsec;
+#endif
+}
+
+#ifdef TH_SHIP
+
+#define TH_PROFILE_ZONE(name)
+#define th_profile_thread_name(name)
+
+#else
+
+struct ProfileZone {
+	const char* name;
+	U64 start_ns;
+	U64 end_ns;
+	U32 depth; // 0 for zones nothing else was open around
+	U32 thread; // index into the profiler's threads
+};
+
+struct ProfileThread {
+	U32 index;
+	char name[32];
+	U32 depth;
+	const char* open_names[TH_PROFILE_MAX_DEPTH];
+	U64 open_start_ns[TH_PROFILE_MAX_DEPTH];
+	std::atomic<U64> write; // zones ever finished, the ring holds the last TH_PROFILE_RING_SIZE
+	ProfileZone zones[TH_PROFILE_RING_SIZE];
+};
+
+struct Profiler {
+	std::atomic<U32> thread_count;
+	std::atomic<ProfileThread*> threads[TH_PROFILE_MAX_THREADS]; // 0 until the thread is set up
+	U64 frame_ns[TH_PROFILE_FRAME_HISTORY]; // frame starts, main thread only
+	U64 frame_count;
+};
+
+static Profiler th_profiler;
+static thread_local ProfileThread* th_profile_thread_local;
+static thread_local B8 th_profile_thread_dropped; // showed up after every slot was taken
+
+// name is only used the first time, when the thread gets its ring
+static ProfileThread* th_profile_thread(const char* name = 0) {
+	ProfileThread* thread = th_profile_thread_local;
+	if (thread || th_profile_thread_dropped)
+		return thread;
+	U32 index = th_profiler.thread_count.fetch_add(1, std::memory_order_relaxed);
+	if (index >= TH_PROFILE_MAX_THREADS) {
+		th_profile_thread_dropped = 1; // its zones aren't recorded
+		return 0;
+	}
+	// straight from the OS, these outlive every arena and are never freed
+	thread = (ProfileThread*)th_os_reserve(sizeof(ProfileThread));
+	B8 ok = thread && th_os_commit(thread, sizeof(ProfileThread));
+	Assert(ok);
+	thread->index = index;
+	if (name)
+		snprintf(thread->name, sizeof(thread->name), "%s", name);
+	else
+		snprintf(thread->name, sizeof(thread->name), "thread %u", index);
+	th_profile_thread_local = thread;
+	th_profiler.threads[index].store(thread, std::memory_order_release);
+	return thread;
+}
+
+// shows up in the trace instead of "thread N". Call from the thread itself before its first
+// zone, readers may already be looking at the ring after that so the name can't change
+static void th_profile_thread_name(const char* name) {
+	th_profile_thread(name);
+}
+
+static void th_profile_begin(const char* name) {
+	ProfileThread* thread = th_profile_thread();
+	if (!thread)
+		return;
+	Assert(thread->depth < TH_PROFILE_MAX_DEPTH); // zones nested too deep, or one was never ended
+	thread->open_names[thread->depth] = name;
+	thread->open_start_ns[thread->depth] = th_os_time_ns();
+	thread->depth++;
+}
+
+static void th_profile_end() {
+	U64 end_ns = th_os_time_ns();
+	ProfileThread* thread = th_profile_thread_local;
+	if (!thread)
+		return;
+	Assert(thread->depth > 0);
+	thread->depth--;
+	U64 write = thread->write.load(std::memory_order_relaxed);
+	ProfileZone* zone = &thread->zones[write & (TH_PROFILE_RING_SIZE - 1)];
+	zone->name = thread->open_names[thread->depth];
+	zone->start_ns = thread->open_start_ns[thread->depth];
+	zone->end_ns = end_ns;
+	zone->depth = thread->depth;
+	zone->thread = thread->index;
+	thread->write.store(write + 1, std::memory_order_release);
+}
+
+struct ProfileScope {
+	ProfileScope(const char* name) { th_profile_begin(name); }
+	~ProfileScope() { th_profile_end(); }
+};
+
+#define TH_PROFILE_GLUE_(a, b) a##b
+#define TH_PROFILE_GLUE(a, b) TH_PROFILE_GLUE_(a, b)
+#define TH_PROFILE_ZONE(name) ProfileScope TH_PROFILE_GLUE(profile_zone_, __LINE__)(name)
+
+// main thread, once a frame before anything else in it
+static void th_profile_frame_mark() {
+	th_profiler.frame_ns[th_profiler.frame_count & (TH_PROFILE_FRAME_HISTORY - 1)] = th_os_time_ns();
+	th_profiler.frame_count++;
+}
+
+// start and end of a finished frame, back = 0 is the last one. 0 if it's out of the history
+static B8 th_profile_frame(U32 back, U64* start_ns, U64* end_ns) {
+	U64 count = th_profiler.frame_count;
+	if (back + 2 > count || back + 2 > TH_PROFILE_FRAME_HISTORY)
+		return 0;
+	*start_ns = th_profiler.frame_ns[(count - back - 2) & (TH_PROFILE_FRAME_HISTORY - 1)];
+	*end_ns = th_profiler.frame_ns[(count - back - 1) & (TH_PROFILE_FRAME_HISTORY - 1)];
+	return 1;
+}
+
+// copies the finished zones of one thread that overlap [from_ns, to_ns) into arena, oldest first
+static ProfileZone* th_profile_read(Arena* arena, ProfileThread* thread, U64 from_ns, U64 to_ns, U32* out_count) {
+	U64 write = thread->write.load(std::memory_order_acquire);
+	U64 first = write > TH_PROFILE_RING_SIZE ? write - TH_PROFILE_RING_SIZE : 0;
+	// zones finish in end order, so walk back from the newest to the first that ended too early
+	U64 begin = write;
+	while (begin > first && thread->zones[(begin - 1) & (TH_PROFILE_RING_SIZE - 1)].end_ns > from_ns)
+		begin--;
+	ProfileZone* zones = ArenaPushArray(arena, ProfileZone, write - begin);
+	for (U64 i = begin; i < write; i++)
+		zones[i - begin] = thread->zones[i & (TH_PROFILE_RING_SIZE - 1)];
+	// anything the writer lapped while we were copying is garbage, skip it
+	U64 lapped = thread->write.load(std::memory_order_acquire);
+	U64 valid = lapped > TH_PROFILE_RING_SIZE ? lapped - TH_PROFILE_RING_SIZE : 0;
+	U32 count = 0;
+	for (U64 i = Max(begin, valid); i < write; i++) {
+		if (zones[i - begin].start_ns < to_ns)
+			zones[count++] = zones[i - begin];
+	}
+	*out_count = count;
+	return zones;
+}
+
+// CHROME TRACE
+// chrome://tracing or ui.perfetto.dev. Everything still in the rings, as complete events
+
+static void th_profile_write_json_string(FILE* file, const char* string) {
+	fputc('"', file);
+	for (const char* c = string; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fputc('\\', file);
+		if ((U8)*c >= 0x20)
+			fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+static B8 th_profile_write_chrome_trace(Arena* arena, const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return 0;
+	TempArena temp = th_temp_begin(arena);
+	U64 origin = th_profiler.frame_count ? th_profiler.frame_ns[0] : 0; // oldest frame mark kept
+	if (th_profiler.frame_count > TH_PROFILE_FRAME_HISTORY)
+		origin = th_profiler.frame_ns[th_profiler.frame_count & (TH_PROFILE_FRAME_HISTORY - 1)];
+	U32 event_count = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	U32 thread_count = Min(th_profiler.thread_count.load(std::memory_order_acquire), (U32)TH_PROFILE_MAX_THREADS);
+	for (U32 t = 0; t < thread_count; t++) {
+		ProfileThread* thread = th_profiler.threads[t].load(std::memory_order_acquire);
+		if (!thread)
+			continue;
+		fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", event_count++ ? ",\n" : "", t);
+		th_profile_write_json_string(file, thread->name);
+		fprintf(file, "}}");
+		U32 count;
+		ProfileZone* zones = th_profile_read(temp.arena, thread, origin, ~0ull, &count);
+		for (U32 i = 0; i < count; i++) {
+			const ProfileZone* zone = &zones[i];
+			if (zone->start_ns < origin)
+				continue;
+			fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", t,
+				(zone->start_ns - origin) / 1000.0, (zone->end_ns - zone->start_ns) / 1000.0);
+			th_profile_write_json_string(file, zone->name);
+			fprintf(file, "}");
+			event_count++;
+		}
+	}
+	U64 frames = Min(th_profiler.frame_count, (U64)TH_PROFILE_FRAME_HISTORY);
+	for (U64 i = th_profiler.frame_count - frames; i < th_profiler.frame_count; i++) {
+		U64 ns = th_profiler.frame_ns[i & (TH_PROFILE_FRAME_HISTORY - 1)];
+		fprintf(file, "%s{\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"name\":\"frame\"}",
+			event_count++ ? ",\n" : "", (ns - origin) / 1000.0);
+	}
+	fprintf(file, "\n]}\n");
+	th_temp_end(temp);
+	return fclose(file) == 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef TH_RANDOM_H
+#define TH_RANDOM_H
+
+// Random streams on pcg32 (third_party/pcg). Nothing is global: every system that wants random
+// numbers owns a RandomStream, seeded from the game seed and an id of its own. Streams with
+// different ids never share output, so systems don't disturb each other's sequences and a
+// stream can be used from whichever thread runs its owner, results don't depend on scheduling.
+// Same seed, same numbers, on every platform.
+
+#include "third_party/pcg/include/pcg_variants.h"
+
+#if ARCH_X64 || defined(__SSE2__)
+#include <emmintrin.h>
+#define TH_RANDOM_SSE2 1
+#endif
+
+#define TH_RANDOM_LANES 4 // fixed, the output of a fill can't depend on the build's SIMD width
+#define TH_RANDOM_BATCH_MIN 32 // fills below this aren't worth splitting into lanes
+
+struct RandomStream {
+	pcg32_random_t pcg;
+};
+
+static void th_random_seed(RandomStream* rng, U64 seed, U64 stream_id) {
+	pcg32_srandom_r(&rng->pcg, seed, stream_id);
+}
+
+static U32 th_random_u32(RandomStream* rng) {
+	return pcg32_random_r(&rng->pcg);
+}
+
+static U64 th_random_u64(RandomStream* rng) {
+	U64 high = th_random_u32(rng);
+	return (high << 32) | th_random_u32(rng);
+}
+
+// [0, bound), without the bias of a plain modulo
+static U32 th_random_below(RandomStream* rng, U32 bound) {
+	Assert(bound);
+	return pcg32_boundedrand_r(&rng->pcg, bound);
+}
+
+// [0, 1), 24 bits, every value is exact in a float
+static F32 th_random_f32(RandomStream* rng) {
+	return (F32)(th_random_u32(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+static F32 th_random_range(RandomStream* rng, F32 min, F32 max) {
+	return min + th_random_f32(rng) * (max - min);
+}
+
+// a new stream that depends only on where this one was, for handing work to someone else
+static RandomStream th_random_split(RandomStream* rng) {
+	RandomStream result;
+	U64 seed = th_random_u64(rng);
+	th_random_seed(&result, seed, th_random_u64(rng));
+	return result;
+}
+
+// BATCHES
+// Fills count floats in [min, max). Large fills split TH_RANDOM_LANES streams off rng and step
+// them side by side: one pcg32 is a chain of dependent 64 bit multiplies, four independent ones
+// overlap. SSE2 has no per-lane variable shift for pcg's rotate, so the lanes step in scalar
+// registers and the conversion and scaling to floats go four at a time.
+
+static void th_random_fill_f32(RandomStream* rng, F32* out, U32 count, F32 min, F32 max) {
+	if (count < TH_RANDOM_BATCH_MIN) {
+		for (U32 i = 0; i < count; i++)
+			out[i] = th_random_range(rng, min, max);
+		return;
+	}
+	RandomStream lanes[TH_RANDOM_LANES];
+	for (U32 l = 0; l < TH_RANDOM_LANES; l++)
+		lanes[l] = th_random_split(rng);
+	const F32 scale = (max - min) * (1.0f / 16777216.0f);
+	U32 i = 0;
+#if TH_RANDOM_SSE2
+	const __m128 base_4 = _mm_set1_ps(min);
+	const __m128 scale_4 = _mm_set1_ps(scale);
+	for (; i + TH_RANDOM_LANES <= count; i += TH_RANDOM_LANES) {
+		U32 r0 = th_random_u32(&lanes[0]);
+		U32 r1 = th_random_u32(&lanes[1]);
+		U32 r2 = th_random_u32(&lanes[2]);
+		U32 r3 = th_random_u32(&lanes[3]);
+		__m128i bits = _mm_srli_epi32(_mm_set_epi32((int)r3, (int)r2, (int)r1, (int)r0), 8);
+		_mm_storeu_ps(out + i, _mm_add_ps(base_4, _mm_mul_ps(_mm_cvtepi32_ps(bits), scale_4)));
+	}
+#endif
+	// same lanes and the same math as the SIMD loop, so both paths give identical floats
+	for (; i < count; i++)
+		out[i] = min + (F32)(th_random_u32(&lanes[i % TH_RANDOM_LANES]) >> 8) * scale;
+}
+
+#endif
@@ -0,0 +1,911 @@
+#ifndef TH_RENDER_H
+#define TH_RENDER_H
+
+// Batched draw paths that go around sokol_gp when per-draw state would kill us.
+// Needs sokol_gfx and sokol_gp to be included first.
+
+// handles from GameState::atlas_names / sprite_names, 0 is none
+typedef U32 AtlasID;
+typedef U32 SpriteID;
+
+enum AtlasStatus {
+	AtlasStatus_ready,
+	AtlasStatus_loading, // image is allocated but has no pixels yet, sprites draw as placeholders
+	AtlasStatus_failed,
+};
+
+struct TextureAtlas {
+	const char* name; // interned
+	sg_image image;
+	S32 width; // 0 until loaded
+	S32 height;
+	AtlasStatus status;
+};
+
+static B8 th_texture_atlas_ready(const TextureAtlas* atlas) {
+	return atlas->status == AtlasStatus_ready;
+}
+
+struct Sprite {
+	const char* name; // interned
+	TextureAtlas* atlas;
+	Rng2F32 sub_rect;
+};
+
+// one sprite submission, flip by handing in a rect with min.x > max.x
+struct RenderRect {
+	Rng2F32 rect;
+	Sprite* sprite; // 0 draws a flat colored rect
+	Vec4 col;
+	S16 layer; // lower layers draw first
+};
+
+// PARTICLE BATCH
+// sokol_gp bakes color into a uniform, so differently colored particles can't merge into one
+// command. Instead every live particle becomes a colored quad in one vertex stream, transformed
+// on the CPU the same way sokol_gp does it, and the whole lot goes out in a single draw.
+
+struct ParticleVertex {
+	F32 x;
+	F32 y;
+	U32 col; // rgba8, unpacked by the vertex fetch
+};
+
+struct ParticleBatch {
+	U32 capacity; // in quads
+	ParticleVertex* vertices;
+	sg_buffer vertex_buffer;
+	sg_buffer index_buffer;
+	sg_shader shader;
+	sg_pipeline pipeline;
+	// last frame
+	U32 quad_count;
+	U32 draw_calls;
+};
+
+#if defined(SOKOL_GLCORE33)
+static const char* th_particle_vs_source =
+"#version 330\n"
+"layout(location=0) in vec2 position;\n"
+"layout(location=1) in vec4 color0;\n"
+"out vec4 color;\n"
+"void main() {\n"
+"    gl_Position = vec4(position, 0.0, 1.0);\n"
+"    color = color0;\n"
+"}\n";
+static const char* th_particle_fs_source =
+"#version 330\n"
+"in vec4 color;\n"
+"out vec4 frag_color;\n"
+"void main() {\n"
+"    frag_color = color;\n"
+"}\n";
+#elif defined(SOKOL_D3D11)
+static const char* th_particle_vs_source =
+"struct vs_in {\n"
+"    float2 pos: POSITION;\n"
+"    float4 color: COLOR0;\n"
+"};\n"
+"struct vs_out {\n"
+"    float4 color: COLOR0;\n"
+"    float4 pos: SV_Position;\n"
+"};\n"
+"vs_out main(vs_in inp) {\n"
+"    vs_out outp;\n"
+"    outp.pos = float4(inp.pos, 0.0f, 1.0f);\n"
+"    outp.color = inp.color;\n"
+"    return outp;\n"
+"}\n";
+static const char* th_particle_fs_source =
+"float4 main(float4 color: COLOR0): SV_Target0 {\n"
+"    return color;\n"
+"}\n";
+#elif defined(SOKOL_DUMMY_BACKEND)
+static const char* th_particle_vs_source = "";
+static const char* th_particle_fs_source = "";
+#else
+#error "th_render.h only has shaders for SOKOL_GLCORE33, SOKOL_D3D11 and SOKOL_DUMMY_BACKEND"
+#endif
+
+static U32 th_pack_rgba8(F32 r, F32 g, F32 b, F32 a) {
+	U32 result = (U32)(Clamp(0.f, r, 1.f) * 255.f + 0.5f);
+	result |= (U32)(Clamp(0.f, g, 1.f) * 255.f + 0.5f) << 8;
+	result |= (U32)(Clamp(0.f, b, 1.f) * 255.f + 0.5f) << 16;
+	result |= (U32)(Clamp(0.f, a, 1.f) * 255.f + 0.5f) << 24;
+	return result;
+}
+
+// quads never change shape, so their index buffer is baked once
+static sg_buffer th_quad_index_buffer_make(Arena* arena, U32 quad_count, const char* label) {
+	TempArena temp = th_temp_begin(arena);
+	U32* indices = ArenaPushArray(temp.arena, U32, quad_count * 6);
+	for (U32 i = 0; i < quad_count; i++) {
+		U32 v = i * 4;
+		U32* quad = &indices[i * 6];
+		quad[0] = v + 0;
+		quad[1] = v + 1;
+		quad[2] = v + 2;
+		quad[3] = v + 0;
+		quad[4] = v + 2;
+		quad[5] = v + 3;
+	}
+	sg_buffer_desc desc = { 0 };
+	desc.type = SG_BUFFERTYPE_INDEXBUFFER;
+	desc.data = { indices, sizeof(U32) * quad_count * 6 };
+	desc.label = label;
+	sg_buffer result = sg_make_buffer(&desc);
+	th_temp_end(temp);
+	return result;
+}
+
+static sg_blend_state th_blend_state_alpha() {
+	// same as SGP_BLENDMODE_BLEND
+	sg_blend_state blend = { 0 };
+	blend.enabled = true;
+	blend.src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA;
+	blend.dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
+	blend.src_factor_alpha = SG_BLENDFACTOR_ONE;
+	blend.dst_factor_alpha = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
+	return blend;
+}
+
+static void th_particle_batch_init(ParticleBatch* batch, Arena* arena, U32 capacity) {
+	MemoryZeroStruct(batch);
+	batch->capacity = capacity;
+	batch->vertices = ArenaPushArray(arena, ParticleVertex, capacity * 4);
+
+	sg_buffer_desc vertex_desc = { 0 };
+	vertex_desc.size = sizeof(ParticleVertex) * capacity * 4;
+	vertex_desc.usage = SG_USAGE_STREAM;
+	vertex_desc.label = "particle vertices";
+	batch->vertex_buffer = sg_make_buffer(&vertex_desc);
+
+	batch->index_buffer = th_quad_index_buffer_make(arena, capacity, "particle indices");
+
+	sg_shader_desc shader_desc = { 0 };
+	shader_desc.attrs[0].name = "position";
+	shader_desc.attrs[0].sem_name = "POSITION";
+	shader_desc.attrs[1].name = "color0";
+	shader_desc.attrs[1].sem_name = "COLOR";
+	shader_desc.vs.source = th_particle_vs_source;
+	shader_desc.fs.source = th_particle_fs_source;
+	shader_desc.label = "particle shader";
+	batch->shader = sg_make_shader(&shader_desc);
+
+	sg_pipeline_desc pipeline_desc = { 0 };
+	pipeline_desc.shader = batch->shader;
+	pipeline_desc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
+	pipeline_desc.layout.attrs[1].format = SG_VERTEXFORMAT_UBYTE4N;
+	pipeline_desc.index_type = SG_INDEXTYPE_UINT32;
+	pipeline_desc.colors[0].blend = th_blend_state_alpha();
+	pipeline_desc.label = "particle pipeline";
+	batch->pipeline = sg_make_pipeline(&pipeline_desc);
+}
+
+// Has to be called inside a pass. Anything queued in sokol_gp must be flushed first or
+// it'll end up drawn on top of the particles.
+// time_offset moves each particle along its velocity, particles travel in straight lines so
+// this is exact interpolation between sim steps. Particles outside the view aren't sent at all.
+static void th_particle_batch_draw(ParticleBatch* batch, const ParticleSystem* particles, const CameraView& view, F32 time_offset) {
+	batch->quad_count = 0;
+	batch->draw_calls = 0;
+	if (particles->count == 0)
+		return;
+
+	const Mat2x3& mvp = view.world_to_clip;
+	const F32 m00 = mvp.v[0][0], m01 = mvp.v[0][1], m02 = mvp.v[0][2];
+	const F32 m10 = mvp.v[1][0], m11 = mvp.v[1][1], m12 = mvp.v[1][2];
+	const Rng2F32 bounds = view.bounds;
+	ParticleVertex* vertex = batch->vertices;
+	U32 count = 0;
+	for (U32 i = 0; i < particles->count && count < batch->capacity; i++) {
+		F32 x = particles->pos_x[i] + particles->vel_x[i] * time_offset;
+		F32 y = particles->pos_y[i] + particles->vel_y[i] * time_offset;
+		F32 half = particles->size[i] * 0.5f;
+		if (x + half < bounds.min.x || x - half > bounds.max.x || y + half < bounds.min.y || y - half > bounds.max.y)
+			continue;
+
+		F32 alpha = th_particle_fade(particles->flags[i], particles->life[i], particles->start_life[i]);
+		U32 col = th_pack_rgba8(particles->col_r[i], particles->col_g[i], particles->col_b[i], particles->col_a[i] * alpha);
+
+		// center and half extents into clip space, then build the corners from those
+		F32 cx = m00 * x + m01 * y + m02;
+		F32 cy = m10 * x + m11 * y + m12;
+		F32 ax = m00 * half, ay = m10 * half; // local x axis
+		F32 bx = m01 * half, by = m11 * half; // local y axis
+
+		vertex[0] = { cx - ax - bx, cy - ay - by, col };
+		vertex[1] = { cx + ax - bx, cy + ay - by, col };
+		vertex[2] = { cx + ax + bx, cy + ay + by, col };
+		vertex[3] = { cx - ax + bx, cy - ay + by, col };
+		vertex += 4;
+		count++;
+	}
+	if (count == 0)
+		return;
+
+	sg_range range = { batch->vertices, sizeof(ParticleVertex) * count * 4 };
+	int offset = sg_append_buffer(batch->vertex_buffer, &range);
+	if (sg_query_buffer_overflow(batch->vertex_buffer))
+		return;
+
+	sg_bindings bindings = { 0 };
+	bindings.vertex_buffers[0] = batch->vertex_buffer;
+	bindings.vertex_buffer_offsets[0] = offset;
+	bindings.index_buffer = batch->index_buffer;
+	sg_apply_pipeline(batch->pipeline);
+	sg_apply_bindings(&bindings);
+	sg_draw(0, count * 6, 1);
+	batch->quad_count = count;
+	batch->draw_calls = 1;
+}
+
+// SPRITE BATCH
+// Sprites are collected as RenderRects over the frame, sorted by layer then atlas, and each
+// run of the same atlas goes out as one draw. Submission order is kept inside a run so
+// overlapping sprites still layer the way they were pushed.
+
+struct SpriteVertex {
+	F32 x;
+	F32 y;
+	F32 u;
+	F32 v;
+	U32 col;
+};
+
+struct SpriteSortKey {
+	U64 key; // layer | image id
+	U32 index; // submission order, tie-break so the sort is stable
+};
+
+struct SpriteBatch {
+	U32 capacity; // in quads
+	RenderRect* rects;
+	U32 rect_count;
+	SpriteSortKey* keys;
+	SpriteVertex* vertices;
+	sg_buffer vertex_buffer;
+	sg_buffer index_buffer;
+	sg_image white_image; // for sprite-less rects
+	sg_shader shader;
+	sg_pipeline pipeline;
+	// last frame
+	U32 draw_calls;
+	U32 vertex_count;
+	U32 dropped;
+};
+
+#if defined(SOKOL_GLCORE33)
+static const char* th_sprite_vs_source =
+"#version 330\n"
+"layout(location=0) in vec2 position;\n"
+"layout(location=1) in vec2 texcoord0;\n"
+"layout(location=2) in vec4 color0;\n"
+"out vec2 uv;\n"
+"out vec4 color;\n"
+"void main() {\n"
+"    gl_Position = vec4(position, 0.0, 1.0);\n"
+"    uv = texcoord0;\n"
+"    color = color0;\n"
+"}\n";
+static const char* th_sprite_fs_source =
+"#version 330\n"
+"uniform sampler2D tex;\n"
+"in vec2 uv;\n"
+"in vec4 color;\n"
+"out vec4 frag_color;\n"
+"void main() {\n"
+"    frag_color = texture(tex, uv) * color;\n"
+"}\n";
+#elif defined(SOKOL_D3D11)
+static const char* th_sprite_vs_source =
+"struct vs_in {\n"
+"    float2 pos: POSITION;\n"
+"    float2 uv: TEXCOORD0;\n"
+"    float4 color: COLOR0;\n"
+"};\n"
+"struct vs_out {\n"
+"    float2 uv: TEXCOORD0;\n"
+"    float4 color: COLOR0;\n"
+"    float4 pos: SV_Position;\n"
+"};\n"
+"vs_out main(vs_in inp) {\n"
+"    vs_out outp;\n"
+"    outp.pos = float4(inp.pos, 0.0f, 1.0f);\n"
+"    outp.uv = inp.uv;\n"
+"    outp.color = inp.color;\n"
+"    return outp;\n"
+"}\n";
+static const char* th_sprite_fs_source =
+"Texture2D<float4> tex: register(t0);\n"
+"SamplerState smp: register(s0);\n"
+"float4 main(float2 uv: TEXCOORD0, float4 color: COLOR0): SV_Target0 {\n"
+"    return tex.Sample(smp, uv) * color;\n"
+"}\n";
+#elif defined(SOKOL_DUMMY_BACKEND)
+static const char* th_sprite_vs_source = "";
+static const char* th_sprite_fs_source = "";
+#endif
+
+static void th_sprite_batch_init(SpriteBatch* batch, Arena* arena, U32 capacity) {
+	MemoryZeroStruct(batch);
+	batch->capacity = capacity;
+	batch->rects = ArenaPushArray(arena, RenderRect, capacity);
+	batch->keys = ArenaPushArray(arena, SpriteSortKey, capacity);
+	batch->vertices = ArenaPushArray(arena, SpriteVertex, capacity * 4);
+
+	sg_buffer_desc vertex_desc = { 0 };
+	vertex_desc.size = sizeof(SpriteVertex) * capacity * 4;
+	vertex_desc.usage = SG_USAGE_STREAM;
+	vertex_desc.label = "sprite vertices";
+	batch->vertex_buffer = sg_make_buffer(&vertex_desc);
+	batch->index_buffer = th_quad_index_buffer_make(arena, capacity, "sprite indices");
+
+	U32 white = 0xFFFFFFFF;
+	sg_image_desc white_desc = { 0 };
+	white_desc.width = 1;
+	white_desc.height = 1;
+	white_desc.data.subimage[0][0] = { &white, sizeof(white) };
+	white_desc.label = "sprite white";
+	batch->white_image = sg_make_image(&white_desc);
+
+	sg_shader_desc shader_desc = { 0 };
+	shader_desc.attrs[0].name = "position";
+	shader_desc.attrs[0].sem_name = "POSITION";
+	shader_desc.attrs[1].name = "texcoord0";
+	shader_desc.attrs[1].sem_name = "TEXCOORD";
+	shader_desc.attrs[2].name = "color0";
+	shader_desc.attrs[2].sem_name = "COLOR";
+	shader_desc.vs.source = th_sprite_vs_source;
+	shader_desc.fs.source = th_sprite_fs_source;
+	shader_desc.fs.images[0].name = "tex";
+	shader_desc.fs.images[0].image_type = SG_IMAGETYPE_2D;
+	shader_desc.label = "sprite shader";
+	batch->shader = sg_make_shader(&shader_desc);
+
+	sg_pipeline_desc pipeline_desc = { 0 };
+	pipeline_desc.shader = batch->shader;
+	pipeline_desc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
+	pipeline_desc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT2;
+	pipeline_desc.layout.attrs[2].format = SG_VERTEXFORMAT_UBYTE4N;
+	pipeline_desc.index_type = SG_INDEXTYPE_UINT32;
+	pipeline_desc.colors[0].blend = th_blend_state_alpha();
+	pipeline_desc.label = "sprite pipeline";
+	batch->pipeline = sg_make_pipeline(&pipeline_desc);
+}
+
+static RenderRect* th_sprite_batch_push(SpriteBatch* batch) {
+	if (batch->rect_count >= batch->capacity) {
+		batch->dropped++;
+		return 0;
+	}
+	RenderRect* rect = &batch->rects[batch->rect_count++];
+	MemoryZeroStruct(rect);
+	return rect;
+}
+
+static int th_sprite_sort_key_compare(const void* a, const void* b) {
+	const SpriteSortKey* key_a = (const SpriteSortKey*)a;
+	const SpriteSortKey* key_b = (const SpriteSortKey*)b;
+	if (key_a->key != key_b->key)
+		return key_a->key < key_b->key ? -1 : 1;
+	return key_a->index < key_b->index ? -1 : (key_a->index > key_b->index);
+}
+
+static B8 th_sprite_is_ready(const Sprite* sprite) {
+	return sprite && th_texture_atlas_ready(sprite->atlas);
+}
+
+// sprites whose atlas is still loading draw as a dimmed flat rect
+static sg_image th_sprite_batch_image(const SpriteBatch* batch, const RenderRect* rect) {
+	return th_sprite_is_ready(rect->sprite) ? rect->sprite->atlas->image : batch->white_image;
+}
+
+// Has to be called inside a pass, after flushing sokol_gp. Clears the submitted rects.
+static void th_sprite_batch_draw(SpriteBatch* batch, const Mat2x3& mvp) {
+	batch->draw_calls = 0;
+	batch->vertex_count = 0;
+	U32 count = batch->rect_count;
+	batch->rect_count = 0;
+	if (count == 0)
+		return;
+
+	for (U32 i = 0; i < count; i++) {
+		const RenderRect* rect = &batch->rects[i];
+		SpriteSortKey* key = &batch->keys[i];
+		key->key = ((U64)(U16)(rect->layer + 0x8000) << 32) | th_sprite_batch_image(batch, rect).id;
+		key->index = i;
+	}
+	qsort(batch->keys, count, sizeof(SpriteSortKey), th_sprite_sort_key_compare);
+
+	const F32 m00 = mvp.v[0][0], m01 = mvp.v[0][1], m02 = mvp.v[0][2];
+	const F32 m10 = mvp.v[1][0], m11 = mvp.v[1][1], m12 = mvp.v[1][2];
+	SpriteVertex* vertex = batch->vertices;
+	for (U32 i = 0; i < count; i++) {
+		const RenderRect* rect = &batch->rects[batch->keys[i].index];
+		F32 u0 = 0.f, v0 = 0.f, u1 = 1.f, v1 = 1.f;
+		Vec4 rect_col = rect->col;
+		if (rect->sprite && !th_sprite_is_ready(rect->sprite)) {
+			rect_col.r *= 0.5f;
+			rect_col.g *= 0.5f;
+			rect_col.b *= 0.5f;
+		} else if (rect->sprite) {
+			const TextureAtlas* atlas = rect->sprite->atlas;
+			Assert(atlas); // invalid atlas
+			Rng2F32 src = Pad2F32(rect->sprite->sub_rect, -0.1f); // todo - fix this texture bleeding issue without padding it in
+			F32 iw = 1.f / (F32)atlas->width;
+			F32 ih = 1.f / (F32)atlas->height;
+			u0 = src.min.x * iw;
+			v0 = src.min.y * ih;
+			u1 = src.max.x * iw;
+			v1 = src.max.y * ih;
+		}
+		U32 col = th_pack_rgba8(rect_col.r, rect_col.g, rect_col.b, rect_col.a);
+
+		F32 x0 = rect->rect.min.x, y0 = rect->rect.min.y;
+		F32 x1 = rect->rect.max.x, y1 = rect->rect.max.y;
+		vertex[0] = { m00 * x0 + m01 * y1 + m02, m10 * x0 + m11 * y1 + m12, u0, v1, col };
+		vertex[1] = { m00 * x1 + m01 * y1 + m02, m10 * x1 + m11 * y1 + m12, u1, v1, col };
+		vertex[2] = { m00 * x1 + m01 * y0 + m02, m10 * x1 + m11 * y0 + m12, u1, v0, col };
+		vertex[3] = { m00 * x0 + m01 * y0 + m02, m10 * x0 + m11 * y0 + m12, u0, v0, col };
+		vertex += 4;
+	}
+
+	sg_range range = { batch->vertices, sizeof(SpriteVertex) * count * 4 };
+	int offset = sg_append_buffer(batch->vertex_buffer, &range);
+	if (sg_query_buffer_overflow(batch->vertex_buffer))
+		return;
+
+	sg_bindings bindings = { 0 };
+	bindings.vertex_buffers[0] = batch->vertex_buffer;
+	bindings.vertex_buffer_offsets[0] = offset;
+	bindings.index_buffer = batch->index_buffer;
+	sg_apply_pipeline(batch->pipeline);
+
+	// one draw per run of equal keys
+	U32 run_start = 0;
+	for (U32 i = 1; i <= count; i++) {
+		if (i < count && batch->keys[i].key == batch->keys[run_start].key)
+			continue;
+		bindings.fs_images[0] = th_sprite_batch_image(batch, &batch->rects[batch->keys[run_start].index]);
+		sg_apply_bindings(&bindings);
+		sg_draw(run_start * 6, (i - run_start) * 6, 1);
+		batch->draw_calls++;
+		run_start = i;
+	}
+	batch->vertex_count = count * 4;
+}
+
+// TILEMAP
+// A grid of tiles from one atlas, cut into square chunks. A chunk bakes its tiles into an
+// immutable vertex buffer in world space the first time it's on screen, and only bakes again
+// when one of its tiles changes. Drawing it is then one draw per visible chunk with the view
+// in a uniform, nothing per tile. Once more than TH_TILEMAP_MAX_BAKED chunks hold a buffer,
+// the ones that weren't on screen give theirs back and bake again if they come back.
+
+#define TH_TILEMAP_CHUNK_TILES 32 // per side
+#define TH_TILEMAP_MAX_TILES 64 // in the tile set
+#define TH_TILEMAP_MAX_BAKED 64
+
+typedef U16 TileID; // 1 + index into the tile set, 0 is empty
+
+struct TilemapChunk {
+	S32 x; // in chunks, chunk (0, 0) starts at tile (0, 0)
+	S32 y;
+	TileID tiles[TH_TILEMAP_CHUNK_TILES * TH_TILEMAP_CHUNK_TILES]; // rows, bottom first
+	sg_buffer vertex_buffer; // invalid until baked
+	U32 quad_count; // in the baked buffer
+	U64 drawn_frame;
+	B8 dirty; // tiles changed since the bake
+};
+
+struct TilemapUniforms {
+	F32 mvp[2][4]; // rows of world_to_clip, padded to vec4s
+};
+
+struct Tilemap {
+	F32 tile_size; // world units, tile (0, 0) has its bottom left corner at the origin
+	Sprite* tiles[TH_TILEMAP_MAX_TILES];
+	U32 tile_count;
+	TextureAtlas* atlas; // of every tile
+	S32 baked_width; // atlas size the bakes used, a reload that changes it rebakes everything
+	S32 baked_height;
+	Arena chunk_arena;
+	TilemapChunk* chunks; // sorted by y, then x
+	U32 chunk_count;
+	U32 baked_count;
+	U64 frame;
+	sg_buffer index_buffer;
+	sg_shader shader;
+	sg_pipeline pipeline;
+	// last frame
+	U32 draw_calls;
+	U32 quad_count;
+	U32 bake_count;
+};
+
+#if defined(SOKOL_GLCORE33)
+static const char* th_tilemap_vs_source =
+"#version 330\n"
+"uniform vec4 mvp[2];\n"
+"layout(location=0) in vec2 position;\n"
+"layout(location=1) in vec2 texcoord0;\n"
+"layout(location=2) in vec4 color0;\n"
+"out vec2 uv;\n"
+"out vec4 color;\n"
+"void main() {\n"
+"    vec3 p = vec3(position, 1.0);\n"
+"    gl_Position = vec4(dot(mvp[0].xyz, p), dot(mvp[1].xyz, p), 0.0, 1.0);\n"
+"    uv = texcoord0;\n"
+"    color = color0;\n"
+"}\n";
+#elif defined(SOKOL_D3D11)
+static const char* th_tilemap_vs_source =
+"cbuffer params: register(b0) {\n"
+"    float4 mvp[2];\n"
+"};\n"
+"struct vs_in {\n"
+"    float2 pos: POSITION;\n"
+"    float2 uv: TEXCOORD0;\n"
+"    float4 color: COLOR0;\n"
+"};\n"
+"struct vs_out {\n"
+"    float2 uv: TEXCOORD0;\n"
+"    float4 color: COLOR0;\n"
+"    float4 pos: SV_Position;\n"
+"};\n"
+"vs_out main(vs_in inp) {\n"
+"    vs_out outp;\n"
+"    float3 p = float3(inp.pos, 1.0f);\n"
+"    outp.pos = float4(dot(mvp[0].xyz, p), dot(mvp[1].xyz, p), 0.0f, 1.0f);\n"
+"    outp.uv = inp.uv;\n"
+"    outp.color = inp.color;\n"
+"    return outp;\n"
+"}\n";
+#elif defined(SOKOL_DUMMY_BACKEND)
+static const char* th_tilemap_vs_source = "";
+#endif
+
+static void th_tilemap_init(Tilemap* map, Arena* arena, F32 tile_size) {
+	MemoryZeroStruct(map);
+	map->tile_size = tile_size;
+	th_arena_init(&map->chunk_arena, "tilemap chunks");
+	TH_ARENA_ARRAY_INIT(&map->chunk_arena, map->chunks);
+	map->index_buffer = th_quad_index_buffer_make(arena, TH_TILEMAP_CHUNK_TILES * TH_TILEMAP_CHUNK_TILES, "tilemap indices");
+
+	// the sprite shader's fragment stage, with the transform moved onto the GPU
+	sg_shader_desc shader_desc = { 0 };
+	shader_desc.attrs[0].name = "position";
+	shader_desc.attrs[0].sem_name = "POSITION";
+	shader_desc.attrs[1].name = "texcoord0";
+	shader_desc.attrs[1].sem_name = "TEXCOORD";
+	shader_desc.attrs[2].name = "color0";
+	shader_desc.attrs[2].sem_name = "COLOR";
+	shader_desc.vs.source = th_tilemap_vs_source;
+	shader_desc.vs.uniform_blocks[0].size = sizeof(TilemapUniforms);
+	shader_desc.vs.uniform_blocks[0].uniforms[0].name = "mvp";
+	shader_desc.vs.uniform_blocks[0].uniforms[0].type = SG_UNIFORMTYPE_FLOAT4;
+	shader_desc.vs.uniform_blocks[0].uniforms[0].array_count = 2;
+	shader_desc.fs.source = th_sprite_fs_source;
+	shader_desc.fs.images[0].name = "tex";
+	shader_desc.fs.images[0].image_type = SG_IMAGETYPE_2D;
+	shader_desc.label = "tilemap shader";
+	map->shader = sg_make_shader(&shader_desc);
+
+	sg_pipeline_desc pipeline_desc = { 0 };
+	pipeline_desc.shader = map->shader;
+	pipeline_desc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
+	pipeline_desc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT2;
+	pipeline_desc.layout.attrs[2].format = SG_VERTEXFORMAT_UBYTE4N;
+	pipeline_desc.index_type = SG_INDEXTYPE_UINT32;
+	pipeline_desc.colors[0].blend = th_blend_state_alpha();
+	pipeline_desc.label = "tilemap pipeline";
+	map->pipeline = sg_make_pipeline(&pipeline_desc);
+}
+
+// every tile has to come from the same atlas, so a chunk is one draw
+static TileID th_tilemap_tile_add(Tilemap* map, Sprite* sprite) {
+	Assert(map->tile_count < TH_TILEMAP_MAX_TILES); // raise TH_TILEMAP_MAX_TILES
+	Assert(!map->atlas || sprite->atlas == map->atlas); // tiles from a second atlas
+	map->atlas = sprite->atlas;
+	map->tiles[map->tile_count++] = sprite;
+	return (TileID)map->tile_count;
+}
+
+static S32 th_tilemap_chunk_coord(S32 tile) {
+	return (tile >= 0 ? tile : tile - (TH_TILEMAP_CHUNK_TILES - 1)) / TH_TILEMAP_CHUNK_TILES;
+}
+
+static B8 th_tilemap_chunk_before(const TilemapChunk* chunk, S32 x, S32 y) {
+	return chunk->y < y || (chunk->y == y && chunk->x < x);
+}
+
+// 0 if there's no such chunk and create is off
+static TilemapChunk* th_tilemap_chunk(Tilemap* map, S32 x, S32 y, B8 create) {
+	U32 low = 0;
+	U32 high = map->chunk_count;
+	while (low < high) {
+		U32 middle = (low + high) / 2;
+		if (th_tilemap_chunk_before(&map->chunks[middle], x, y))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low < map->chunk_count && map->chunks[low].x == x && map->chunks[low].y == y)
+		return &map->chunks[low];
+	if (!create)
+		return 0;
+	TH_ARENA_ARRAY_PUSH(&map->chunk_arena, map->chunks, map->chunk_count);
+	memmove(&map->chunks[low + 1], &map->chunks[low], sizeof(TilemapChunk) * (map->chunk_count - 1 - low));
+	TilemapChunk* chunk = &map->chunks[low];
+	MemoryZeroStruct(chunk);
+	chunk->x = x;
+	chunk->y = y;
+	chunk->dirty = 1;
+	return chunk;
+}
+
+static void th_tilemap_set(Tilemap* map, S32 x, S32 y, TileID tile) {
+	Assert(tile <= map->tile_count); // not in the tile set
+	S32 chunk_x = th_tilemap_chunk_coord(x);
+	S32 chunk_y = th_tilemap_chunk_coord(y);
+	TilemapChunk* chunk = th_tilemap_chunk(map, chunk_x, chunk_y, tile != 0);
+	if (!chunk)
+		return; // clearing a tile that was never set
+	TileID* slot = &chunk->tiles[(y - chunk_y * TH_TILEMAP_CHUNK_TILES) * TH_TILEMAP_CHUNK_TILES + (x - chunk_x * TH_TILEMAP_CHUNK_TILES)];
+	if (*slot != tile) {
+		*slot = tile;
+		chunk->dirty = 1;
+	}
+}
+
+static TileID th_tilemap_get(Tilemap* map, S32 x, S32 y) {
+	S32 chunk_x = th_tilemap_chunk_coord(x);
+	S32 chunk_y = th_tilemap_chunk_coord(y);
+	TilemapChunk* chunk = th_tilemap_chunk(map, chunk_x, chunk_y, 0);
+	if (!chunk)
+		return 0;
+	return chunk->tiles[(y - chunk_y * TH_TILEMAP_CHUNK_TILES) * TH_TILEMAP_CHUNK_TILES + (x - chunk_x * TH_TILEMAP_CHUNK_TILES)];
+}
+
+// bakes every chunk again when it's next drawn, after the tile sprites changed
+static void th_tilemap_invalidate(Tilemap* map) {
+	for (U32 i = 0; i < map->chunk_count; i++)
+		map->chunks[i].dirty = 1;
+}
+
+static void th_tilemap_chunk_release(Tilemap* map, TilemapChunk* chunk) {
+	if (chunk->vertex_buffer.id == SG_INVALID_ID)
+		return;
+	sg_destroy_buffer(chunk->vertex_buffer);
+	chunk->vertex_buffer.id = SG_INVALID_ID;
+	chunk->quad_count = 0;
+	map->baked_count--;
+}
+
+static void th_tilemap_release(Tilemap* map) {
+	for (U32 i = 0; i < map->chunk_count; i++)
+		th_tilemap_chunk_release(map, &map->chunks[i]);
+	sg_destroy_pipeline(map->pipeline);
+	sg_destroy_shader(map->shader);
+	sg_destroy_buffer(map->index_buffer);
+	th_arena_release(&map->chunk_arena);
+	MemoryZeroStruct(map);
+}
+
+static void th_tilemap_chunk_bake(Tilemap* map, TilemapChunk* chunk, Arena* scratch) {
+	th_tilemap_chunk_release(map, chunk);
+	chunk->dirty = 0;
+	TempArena temp = th_temp_begin(scratch);
+	SpriteVertex* vertices = ArenaPushArray(temp.arena, SpriteVertex, TH_TILEMAP_CHUNK_TILES * TH_TILEMAP_CHUNK_TILES * 4);
+	SpriteVertex* vertex = vertices;
+	const F32 iw = 1.f / (F32)map->atlas->width;
+	const F32 ih = 1.f / (F32)map->atlas->height;
+	const F32 size = map->tile_size;
+	const U32 white = 0xFFFFFFFF;
+	U32 quad_count = 0;
+	for (U32 ty = 0; ty < TH_TILEMAP_CHUNK_TILES; ty++) {
+		for (U32 tx = 0; tx < TH_TILEMAP_CHUNK_TILES; tx++) {
+			TileID tile = chunk->tiles[ty * TH_TILEMAP_CHUNK_TILES + tx];
+			if (!tile)
+				continue;
+			Rng2F32 src = Pad2F32(map->tiles[tile - 1]->sub_rect, -0.1f); // same inset as the sprite batch
+			F32 u0 = src.min.x * iw, v0 = src.min.y * ih;
+			F32 u1 = src.max.x * iw, v1 = src.max.y * ih;
+			F32 x0 = (F32)(chunk->x * TH_TILEMAP_CHUNK_TILES + (S32)tx) * size;
+			F32 y0 = (F32)(chunk->y * TH_TILEMAP_CHUNK_TILES + (S32)ty) * size;
+			F32 x1 = x0 + size, y1 = y0 + size;
+			vertex[0] = { x0, y1, u0, v1, white };
+			vertex[1] = { x1, y1, u1, v1, white };
+			vertex[2] = { x1, y0, u1, v0, white };
+			vertex[3] = { x0, y0, u0, v0, white };
+			vertex += 4;
+			quad_count++;
+		}
+	}
+	if (quad_count) {
+		sg_buffer_desc desc = { 0 };
+		desc.data = { vertices, sizeof(SpriteVertex) * quad_count * 4 };
+		desc.label = "tilemap chunk";
+		chunk->vertex_buffer = sg_make_buffer(&desc);
+		if (chunk->vertex_buffer.id != SG_INVALID_ID) { // 0 when the buffer pool is out, the chunk stays empty
+			chunk->quad_count = quad_count;
+			map->baked_count++;
+		}
+	}
+	map->bake_count++;
+	th_temp_end(temp);
+}
+
+// Has to be called inside a pass, after flushing sokol_gp. Bakes what's on screen and needs it,
+// with scratch for the vertices. Nothing draws until the atlas has its pixels.
+static void th_tilemap_draw(Tilemap* map, const CameraView& view, Arena* scratch) {
+	map->frame++;
+	map->draw_calls = 0;
+	map->quad_count = 0;
+	map->bake_count = 0;
+	if (!map->atlas || !th_texture_atlas_ready(map->atlas))
+		return;
+	if (map->atlas->width != map->baked_width || map->atlas->height != map->baked_height) {
+		th_tilemap_invalidate(map);
+		map->baked_width = map->atlas->width;
+		map->baked_height = map->atlas->height;
+	}
+
+	const F32 chunk_size = map->tile_size * TH_TILEMAP_CHUNK_TILES;
+	S32 min_x = (S32)floorf(view.bounds.min.x / chunk_size);
+	S32 max_x = (S32)floorf(view.bounds.max.x / chunk_size);
+	S32 min_y = (S32)floorf(view.bounds.min.y / chunk_size);
+	S32 max_y = (S32)floorf(view.bounds.max.y / chunk_size);
+	sg_bindings bindings = { 0 };
+	bindings.index_buffer = map->index_buffer;
+	bindings.fs_images[0] = map->atlas->image;
+	TilemapUniforms uniforms;
+	MemoryZeroStruct(&uniforms);
+	for (U32 row = 0; row < 2; row++) {
+		for (U32 column = 0; column < 3; column++)
+			uniforms.mvp[row][column] = view.world_to_clip.v[row][column];
+	}
+	B8 applied = 0;
+	for (S32 y = min_y; y <= max_y; y++) {
+		for (S32 x = min_x; x <= max_x; x++) {
+			TilemapChunk* chunk = th_tilemap_chunk(map, x, y, 0);
+			if (!chunk)
+				continue;
+			if (chunk->dirty)
+				th_tilemap_chunk_bake(map, chunk, scratch);
+			chunk->drawn_frame = map->frame;
+			if (!chunk->quad_count)
+				continue;
+			if (!applied) {
+				sg_apply_pipeline(map->pipeline);
+				sg_range range = { &uniforms, sizeof(uniforms) };
+				sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, &range);
+				applied = 1;
+			}
+			bindings.vertex_buffers[0] = chunk->vertex_buffer;
+			sg_apply_bindings(&bindings);
+			sg_draw(0, chunk->quad_count * 6, 1);
+			map->draw_calls++;
+			map->quad_count += chunk->quad_count;
+		}
+	}
+
+	if (map->baked_count <= TH_TILEMAP_MAX_BAKED)
+		return;
+	for (U32 i = 0; i < map->chunk_count; i++) {
+		TilemapChunk* chunk = &map->chunks[i];
+		if (chunk->drawn_frame != map->frame && chunk->vertex_buffer.id != SG_INVALID_ID) {
+			th_tilemap_chunk_release(map, chunk);
+			chunk->dirty = 1;
+		}
+	}
+}
+
+// PROFILER OVERLAY
+// The last finished frame as a timeline, one band per thread with nested zones stacked under
+// their parents, then a graph of recent frame times below it. Both are scaled so the full width
+// and height is TH_PROFILE_OVERLAY_MS. There's no text, colors come from the zone's name.
+// Dump a trace for the names.
+
+#ifndef TH_SHIP
+
+#define TH_PROFILE_OVERLAY_MS 33.3
+#define TH_PROFILE_OVERLAY_BUDGET_MS 16.6 // marked on both
+#define TH_PROFILE_OVERLAY_FRAMES 120
+#define TH_PROFILE_OVERLAY_ROW 6.0f // per nesting level
+#define TH_PROFILE_OVERLAY_MAX_DEPTH 6
+
+static void th_profile_overlay_color(const char* name) {
+	U32 hash = hash_from_string(name);
+	sgp_set_color(0.35f + 0.65f * ((hash & 0xff) / 255.0f), 0.35f + 0.65f * (((hash >> 8) & 0xff) / 255.0f),
+		0.35f + 0.65f * (((hash >> 16) & 0xff) / 255.0f), 1.0f);
+}
+
+// Has to be called inside sgp_begin/sgp_end, last, it resets the projection and transform.
+static void th_profile_overlay_draw(Arena* arena, Vec2 window_size) {
+	U64 frame_start, frame_end;
+	if (!th_profile_frame(0, &frame_start, &frame_end))
+		return;
+	sgp_reset_project();
+	sgp_reset_transform();
+	const F32 margin = 8.0f;
+	const F32 width = window_size.x - margin * 2.0f;
+	const F32 ns_to_x = width / (F32)(TH_PROFILE_OVERLAY_MS * 1000000.0);
+	const F32 graph_height = 48.0f;
+	TempArena temp = th_temp_begin(arena);
+
+	// gather first, the band heights decide the panel size
+	U32 thread_count = Min(th_profiler.thread_count.load(std::memory_order_acquire), (U32)TH_PROFILE_MAX_THREADS);
+	ProfileZone** thread_zones = ArenaPushArrayZero(temp.arena, ProfileZone*, thread_count);
+	U32* zone_counts = ArenaPushArrayZero(temp.arena, U32, thread_count);
+	U32* band_depths = ArenaPushArrayZero(temp.arena, U32, thread_count);
+	F32 timeline_height = 0.0f;
+	for (U32 t = 0; t < thread_count; t++) {
+		ProfileThread* thread = th_profiler.threads[t].load(std::memory_order_acquire);
+		if (!thread)
+			continue;
+		thread_zones[t] = th_profile_read(temp.arena, thread, frame_start, frame_end, &zone_counts[t]);
+		for (U32 i = 0; i < zone_counts[t]; i++)
+			band_depths[t] = Max(band_depths[t], Min(thread_zones[t][i].depth + 1, (U32)TH_PROFILE_OVERLAY_MAX_DEPTH));
+		if (band_depths[t])
+			timeline_height += band_depths[t] * TH_PROFILE_OVERLAY_ROW + 2.0f;
+	}
+
+	sgp_set_color(0.0f, 0.0f, 0.0f, 0.75f);
+	sgp_draw_filled_rect(0.0f, 0.0f, window_size.x, timeline_height + graph_height + margin * 3.0f);
+
+	// timeline
+	F32 y = margin;
+	for (U32 t = 0; t < thread_count; t++) {
+		if (!band_depths[t])
+			continue;
+		for (U32 i = 0; i < zone_counts[t]; i++) {
+			const ProfileZone* zone = &thread_zones[t][i];
+			if (zone->depth >= TH_PROFILE_OVERLAY_MAX_DEPTH)
+				continue;
+			U64 start = Max(zone->start_ns, frame_start);
+			U64 end = Min(zone->end_ns, frame_end);
+			F32 x0 = margin + (start - frame_start) * ns_to_x;
+			F32 x1 = margin + (end - frame_start) * ns_to_x;
+			if (x0 > margin + width)
+				continue;
+			th_profile_overlay_color(zone->name);
+			sgp_draw_filled_rect(x0, y + zone->depth * TH_PROFILE_OVERLAY_ROW, Max(Min(x1, margin + width) - x0, 1.0f),
+				TH_PROFILE_OVERLAY_ROW - 1.0f);
+		}
+		y += band_depths[t] * TH_PROFILE_OVERLAY_ROW + 2.0f;
+	}
+	sgp_set_color(1.0f, 1.0f, 1.0f, 0.6f);
+	F32 frame_x = margin + Min((F32)(frame_end - frame_start) * ns_to_x, width);
+	sgp_draw_line(frame_x, margin, frame_x, margin + timeline_height);
+
+	// frame time graph, newest on the right
+	F32 graph_top = margin * 2.0f + timeline_height;
+	F32 bar_width = width / TH_PROFILE_OVERLAY_FRAMES;
+	for (U32 back = 0; back < TH_PROFILE_OVERLAY_FRAMES; back++) {
+		U64 start, end;
+		if (!th_profile_frame(back, &start, &end))
+			break;
+		F64 ms = (end - start) / 1000000.0;
+		F32 height = (F32)Min(ms / TH_PROFILE_OVERLAY_MS, 1.0) * graph_height;
+		if (ms <= TH_PROFILE_OVERLAY_BUDGET_MS)
+			sgp_set_color(0.3f, 0.8f, 0.3f, 1.0f);
+		else if (ms <= TH_PROFILE_OVERLAY_MS)
+			sgp_set_color(0.9f, 0.8f, 0.2f, 1.0f);
+		else
+			sgp_set_color(0.9f, 0.25f, 0.2f, 1.0f);
+		F32 x = margin + width - (back + 1) * bar_width;
+		sgp_draw_filled_rect(x, graph_top + graph_height - height, Max(bar_width - 1.0f, 1.0f), height);
+	}
+	F32 budget_x = margin + (F32)(TH_PROFILE_OVERLAY_BUDGET_MS * 1000000.0) * ns_to_x;
+	F32 budget_y = graph_top + graph_height * (F32)(1.0 - TH_PROFILE_OVERLAY_BUDGET_MS / TH_PROFILE_OVERLAY_MS);
+	sgp_set_color(0.3f, 0.8f, 0.3f, 0.6f);
+	sgp_draw_line(budget_x, margin, budget_x, margin + timeline_height);
+	sgp_draw_line(margin, budget_y, margin + width, budget_y);
+	th_temp_end(temp);
+}
+
+#endif
+
+#endif
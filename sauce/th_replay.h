@@ -0,0 +1,220 @@
+#ifndef TH_REPLAY_H
+#define TH_REPLAY_H
+
+// Input replays. A replay is a start payload, the game's state when recording began, followed
+// by every frame's input and delta_t from then on. The game decides what goes in both, here
+// they're a blob and a fixed size input struct. Frames are stored as the bytes of the input
+// that changed since the frame before, so a frame where nothing happened costs one byte. A
+// replay also keeps the hash of the state it ended in: playing it back into a deterministic
+// sim has to land on the same one, anything else means the sim or the file changed.
+//   header, start payload (keyframe encoded, see th_snapshot.h), frames
+// Each frame is varint(changed byte count << 1 | delta_t changed), the new delta_t if it did,
+// then varint(gap since the last changed byte) and the new value for every changed byte.
+
+#define TH_REPLAY_MAGIC 0x50524854 // "THRP"
+#define TH_REPLAY_VERSION 1
+#define TH_REPLAY_INPUT_MAX Kilobytes(4)
+
+struct ReplayFileHeader {
+	U32 magic;
+	U32 version;
+	U32 input_size; // a replay only plays back into the input struct it was recorded from
+	U32 frame_count;
+	U64 start_size; // decoded start payload
+	U64 start_encoded_size;
+	U64 start_hash;
+	U64 end_hash; // of the payload the game saved when recording stopped
+	U64 frames_size;
+	U64 frames_hash;
+};
+
+// RECORDING
+
+struct ReplayRecorder {
+	char path[TH_SNAPSHOT_PATH_MAX];
+	Arena payload; // the game saves its state here before begin and before end
+	Arena start; // encoded start payload
+	Arena frames; // encoded frames
+	U8 previous[TH_REPLAY_INPUT_MAX];
+	U32 input_size;
+	U32 frame_count;
+	F32 previous_delta_t;
+	U64 start_size;
+	U64 start_hash;
+	B8 recording;
+};
+
+static void th_replay_recorder_init(ReplayRecorder* recorder) {
+	MemoryZeroStruct(recorder);
+	th_arena_init(&recorder->payload, "replay payload");
+	th_arena_init(&recorder->start, "replay start");
+	th_arena_init(&recorder->frames, "replay frames");
+}
+
+static void th_replay_recorder_release(ReplayRecorder* recorder) {
+	th_arena_release(&recorder->payload);
+	th_arena_release(&recorder->start);
+	th_arena_release(&recorder->frames);
+	recorder->recording = 0;
+}
+
+// empty, for the state that goes with the next begin or end
+static Arena* th_replay_payload(ReplayRecorder* recorder) {
+	th_arena_clear(&recorder->payload);
+	return &recorder->payload;
+}
+
+// Starts from what's in the payload arena. The first frame is stored against all zeros.
+// 0, and not recording, if the path doesn't fit
+static B8 th_replay_record_begin(ReplayRecorder* recorder, const char* path, U32 input_size) {
+	Assert(input_size <= TH_REPLAY_INPUT_MAX);
+	Assert(!recorder->recording);
+	if (snprintf(recorder->path, sizeof(recorder->path), "%s", path) >= (int)sizeof(recorder->path))
+		return 0;
+	th_arena_clear(&recorder->start);
+	th_arena_clear(&recorder->frames);
+	recorder->start_size = recorder->payload.pos;
+	recorder->start_hash = th_snapshot_hash(recorder->payload.base, recorder->payload.pos);
+	U64 encoded_size;
+	th_snapshot_delta_encode(&recorder->start, 0, 0, recorder->payload.base, recorder->payload.pos, &encoded_size);
+	memset(recorder->previous, 0, sizeof(recorder->previous));
+	recorder->input_size = input_size;
+	recorder->frame_count = 0;
+	recorder->previous_delta_t = 0.0f;
+	recorder->recording = 1;
+	return 1;
+}
+
+static void th_replay_record_frame(ReplayRecorder* recorder, const void* input, F32 delta_t) {
+	Assert(recorder->recording);
+	const U8* bytes = (const U8*)input;
+	U32 change_count = 0;
+	for (U32 i = 0; i < recorder->input_size; i++)
+		change_count += bytes[i] != recorder->previous[i];
+	B8 delta_t_changed = memcmp(&delta_t, &recorder->previous_delta_t, sizeof(delta_t)) != 0;
+	// worst case, every byte changed with a full varint gap in front
+	U8* out = (U8*)th_arena_push(&recorder->frames, 16 + sizeof(delta_t) + change_count * 6, 1);
+	U8* at = th_snapshot_write_varint(out, ((U64)change_count << 1) | delta_t_changed);
+	if (delta_t_changed) {
+		memcpy(at, &delta_t, sizeof(delta_t));
+		at += sizeof(delta_t);
+	}
+	U32 next = 0; // first offset the next gap counts from
+	for (U32 i = 0; i < recorder->input_size; i++) {
+		if (bytes[i] == recorder->previous[i])
+			continue;
+		at = th_snapshot_write_varint(at, i - next);
+		*at++ = bytes[i];
+		next = i + 1;
+	}
+	th_arena_pop_to(&recorder->frames, (at - recorder->frames.base));
+	memcpy(recorder->previous, input, recorder->input_size);
+	recorder->previous_delta_t = delta_t;
+	recorder->frame_count++;
+}
+
+// stops and writes the file, with the payload arena as the end state. 0 if it didn't make it to disk
+static B8 th_replay_record_end(ReplayRecorder* recorder) {
+	Assert(recorder->recording);
+	recorder->recording = 0;
+	ReplayFileHeader header = { 0 };
+	header.magic = TH_REPLAY_MAGIC;
+	header.version = TH_REPLAY_VERSION;
+	header.input_size = recorder->input_size;
+	header.frame_count = recorder->frame_count;
+	header.start_size = recorder->start_size;
+	header.start_encoded_size = recorder->start.pos;
+	header.start_hash = recorder->start_hash;
+	header.end_hash = th_snapshot_hash(recorder->payload.base, recorder->payload.pos);
+	header.frames_size = recorder->frames.pos;
+	header.frames_hash = th_snapshot_hash(recorder->frames.base, recorder->frames.pos);
+
+	char temp_path[sizeof(recorder->path) + sizeof(".tmp")];
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", recorder->path);
+	FILE* file = fopen(temp_path, "wb");
+	if (!file)
+		return 0;
+	B8 ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(recorder->start.base, 1, recorder->start.pos, file) == recorder->start.pos;
+	ok = ok && fwrite(recorder->frames.base, 1, recorder->frames.pos, file) == recorder->frames.pos;
+	ok = (fclose(file) == 0) && ok;
+	ok = ok && th_snapshot_replace_file(temp_path, recorder->path);
+	if (!ok)
+		remove(temp_path);
+	return ok;
+}
+
+// PLAYBACK
+
+struct ReplayPlayer {
+	const U8* start; // decoded start payload, 8 byte aligned
+	U64 start_size;
+	U64 end_hash;
+	U32 input_size;
+	U32 frame_count;
+	U32 frame; // frames played so far
+	F32 delta_t;
+	SnapshotReader frames;
+	U8 input[TH_REPLAY_INPUT_MAX];
+};
+
+// Reads the whole replay into arena. 0 if it's missing, damaged, or recorded with a different input size
+static B8 th_replay_open(ReplayPlayer* player, Arena* arena, const char* path, U32 input_size) {
+	MemoryZeroStruct(player);
+	U64 file_size;
+	U8* file = th_snapshot_read_whole_file(arena, path, &file_size);
+	SnapshotReader reader = th_snapshot_reader(file, file ? file_size : 0);
+	ReplayFileHeader header;
+	th_snapshot_read_struct(&reader, &header);
+	B8 ok = !reader.failed && header.magic == TH_REPLAY_MAGIC && header.version == TH_REPLAY_VERSION;
+	ok = ok && header.input_size == input_size && input_size <= TH_REPLAY_INPUT_MAX;
+	ok = ok && header.start_encoded_size <= file_size - sizeof(header);
+	ok = ok && header.frames_size == file_size - sizeof(header) - header.start_encoded_size;
+	if (!ok)
+		return 0;
+	const U8* start_encoded = (const U8*)th_snapshot_read_in_place(&reader, header.start_encoded_size);
+	const U8* frames = (const U8*)th_snapshot_read_in_place(&reader, header.frames_size);
+	if (th_snapshot_hash(frames, header.frames_size) != header.frames_hash)
+		return 0;
+	U8* start = th_snapshot_delta_decode(arena, 0, 0, start_encoded, header.start_encoded_size, header.start_size);
+	if (!start || th_snapshot_hash(start, header.start_size) != header.start_hash)
+		return 0;
+	player->start = start;
+	player->start_size = header.start_size;
+	player->end_hash = header.end_hash;
+	player->input_size = input_size;
+	player->frame_count = header.frame_count;
+	player->frames = th_snapshot_reader(frames, header.frames_size);
+	return 1;
+}
+
+// the next frame's input and delta_t, 0 after the last one or if the frames don't decode
+static B8 th_replay_next(ReplayPlayer* player, void* input, F32* delta_t) {
+	if (player->frame >= player->frame_count)
+		return 0;
+	SnapshotReader* reader = &player->frames;
+	U64 tag = th_snapshot_read_varint(reader);
+	if (tag & 1)
+		th_snapshot_read_struct(reader, &player->delta_t);
+	U64 change_count = tag >> 1;
+	U64 next = 0;
+	for (U64 i = 0; i < change_count && !reader->failed; i++) {
+		U64 offset = next + th_snapshot_read_varint(reader);
+		U8 value = 0;
+		th_snapshot_read_struct(reader, &value);
+		if (offset >= player->input_size) {
+			reader->failed = 1;
+			break;
+		}
+		player->input[offset] = value;
+		next = offset + 1;
+	}
+	if (reader->failed)
+		return 0;
+	memcpy(input, player->input, player->input_size);
+	*delta_t = player->delta_t;
+	player->frame++;
+	return 1;
+}
+
+#endif
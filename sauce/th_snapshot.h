@@ -0,0 +1,513 @@
+#ifndef TH_SNAPSHOT_H
+#define TH_SNAPSHOT_H
+
+// Snapshot files. The game serializes its state into a flat payload however it likes, this
+// handles getting payloads to and from disk. A file holds one payload encoded against a base:
+// the bytes are XORed with the base and the zero runs that leaves are skipped, so the parts
+// that didn't change cost a couple of bytes. Keyframes are encoded against nothing, which still
+// squeezes out the zero fields. Deltas name their base by hash and are refused if it's missing.
+// The saver thread does the encoding and the writing. The caller only copies its state into the
+// saver's staging arena, which is cheap, and goes on simulating while that gets written out.
+// Files are written next to their final path and renamed over it, a crash mid-save leaves the
+// previous file alone.
+
+#if OS_LINUX || OS_MAC
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#define TH_SNAPSHOT_MAGIC 0x4E534854 // "THSN"
+#define TH_SNAPSHOT_VERSION 1
+#define TH_SNAPSHOT_KEYFRAME_EVERY 8 // saves, one keyframe then deltas against it
+#define TH_SNAPSHOT_PATH_MAX 256
+
+enum SnapshotKind {
+	SnapshotKind_keyframe,
+	SnapshotKind_delta,
+};
+
+struct SnapshotFileHeader {
+	U32 magic;
+	U32 version;
+	U32 kind; // SnapshotKind
+	U32 reserved;
+	U64 size; // decoded payload
+	U64 hash; // of the decoded payload
+	U64 base_hash; // payload the delta applies to, 0 for keyframes
+	U64 encoded_size; // bytes after the header
+};
+
+// READING
+// Payloads come from disk, so reads never trust a size: running off the end sets failed and
+// everything after that reads zeros. Check failed once at the end instead of after every read.
+
+struct SnapshotReader {
+	const U8* data;
+	U64 size;
+	U64 at;
+	B8 failed;
+};
+
+static SnapshotReader th_snapshot_reader(const void* data, U64 size) {
+	SnapshotReader reader = { (const U8*)data, size, 0, 0 };
+	return reader;
+}
+
+static B8 th_snapshot_read(SnapshotReader* reader, void* out, U64 size) {
+	if (reader->failed || size > reader->size - reader->at) {
+		reader->failed = 1;
+		memset(out, 0, size);
+		return 0;
+	}
+	memcpy(out, reader->data + reader->at, size);
+	reader->at += size;
+	return 1;
+}
+
+// points into the payload instead of copying, 0 if it runs off the end
+static const void* th_snapshot_read_in_place(SnapshotReader* reader, U64 size) {
+	if (reader->failed || size > reader->size - reader->at) {
+		reader->failed = 1;
+		return 0;
+	}
+	const void* result = reader->data + reader->at;
+	reader->at += size;
+	return result;
+}
+
+#define th_snapshot_read_struct(reader, out) th_snapshot_read((reader), (out), sizeof(*(out)))
+
+// WRITING
+// Straight into an arena, the payload is everything pushed between begin and the end
+
+static void th_snapshot_write(Arena* arena, const void* data, U64 size) {
+	void* dest = th_arena_push(arena, size, 1);
+	memcpy(dest, data, size);
+}
+
+#define th_snapshot_write_struct(arena, value) th_snapshot_write((arena), (value), sizeof(*(value)))
+
+// not cryptographic, only tells payloads apart. Eight bytes a step, it runs over whole saves
+static U64 th_snapshot_hash(const void* data, U64 size) {
+	const U8* bytes = (const U8*)data;
+	U64 hash = 0x9E3779B97F4A7C15ull ^ size;
+	U64 i = 0;
+	for (; i + 8 <= size; i += 8) {
+		U64 word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	hash ^= hash >> 29;
+	return hash ? hash : 1; // 0 means "no base"
+}
+
+// DELTA ENCODING
+// A list of ops, each a varint count of bytes the base already has right, a varint count of
+// literal bytes, then the literals XORed with the base. Past the end of the base it's XORed
+// with zeros. Ops run until the whole payload is covered. The decoder takes any byte counts,
+// the encoder only cuts on 8 byte words.
+
+static U8* th_snapshot_write_varint(U8* out, U64 value) {
+	while (value >= 0x80) {
+		*out++ = (U8)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (U8)value;
+	return out;
+}
+
+static U64 th_snapshot_read_varint(SnapshotReader* reader) {
+	U64 value = 0;
+	for (U32 shift = 0; shift < 64; shift += 7) {
+		U8 byte;
+		if (!th_snapshot_read(reader, &byte, 1))
+			return 0;
+		value |= (U64)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+	reader->failed = 1; // too long to be ours
+	return 0;
+}
+
+// base can be 0 for a keyframe. Returns the encoded bytes in arena
+static U8* th_snapshot_delta_encode(Arena* arena, const U8* base, U64 base_size, const U8* payload, U64 size, U64* out_size) {
+	// XOR first, in words, then the scan only has to find zeros
+	U8* diff = (U8*)th_arena_push(arena, size + 8, 8);
+	U64 shared = Min(base_size, size);
+	U64 i = 0;
+	for (; i + 8 <= shared; i += 8) {
+		U64 a, b;
+		memcpy(&a, payload + i, 8);
+		memcpy(&b, base + i, 8);
+		a ^= b;
+		memcpy(diff + i, &a, 8);
+	}
+	for (; i < shared; i++)
+		diff[i] = payload[i] ^ base[i];
+	memcpy(diff + shared, payload + shared, size - shared);
+
+	// Runs break on whole words only, the scan never looks at single bytes. A zero word between
+	// two literals still costs less as an op of its own than as eight literal bytes
+	U8* out = (U8*)th_arena_push(arena, size + size / 4 + 64, 1); // an op is at least 16 bytes of payload
+	U8* cursor = out;
+	const U64* words = (const U64*)diff;
+	U64 word_count = size / 8;
+	i = 0;
+	while (i < word_count) {
+		U64 literal = i;
+		while (literal < word_count && !words[literal])
+			literal++;
+		U64 end = literal;
+		while (end < word_count && words[end])
+			end++;
+		cursor = th_snapshot_write_varint(cursor, (literal - i) * 8);
+		cursor = th_snapshot_write_varint(cursor, (end - literal) * 8);
+		memcpy(cursor, diff + literal * 8, (end - literal) * 8);
+		cursor += (end - literal) * 8;
+		i = end;
+	}
+	U64 tail = size - word_count * 8;
+	if (tail) {
+		cursor = th_snapshot_write_varint(cursor, 0);
+		cursor = th_snapshot_write_varint(cursor, tail);
+		memcpy(cursor, diff + word_count * 8, tail);
+		cursor += tail;
+	}
+	*out_size = cursor - out;
+	// the encoded bytes are all that's kept, slide them down over the diff
+	memmove(diff, out, *out_size);
+	th_arena_pop_to(arena, (diff - arena->base) + *out_size);
+	return diff;
+}
+
+// 0 if the ops don't fit the sizes they claim
+static U8* th_snapshot_delta_decode(Arena* arena, const U8* base, U64 base_size, const U8* encoded, U64 encoded_size, U64 size) {
+	U8* out = (U8*)th_arena_push(arena, size, 8);
+	U64 shared = Min(base_size, size);
+	if (shared)
+		memcpy(out, base, shared);
+	memset(out + shared, 0, size - shared);
+	SnapshotReader reader = th_snapshot_reader(encoded, encoded_size);
+	U64 at = 0;
+	while (at < size && !reader.failed) {
+		U64 skip = th_snapshot_read_varint(&reader);
+		if (skip > size - at)
+			return 0;
+		at += skip;
+		U64 literal = th_snapshot_read_varint(&reader);
+		const U8* bytes = (const U8*)th_snapshot_read_in_place(&reader, literal);
+		if (!bytes || literal > size - at)
+			return 0;
+		for (U64 i = 0; i < literal; i++)
+			out[at + i] ^= bytes[i];
+		at += literal;
+	}
+	if (reader.failed || reader.at != encoded_size)
+		return 0;
+	return out;
+}
+
+// FILES
+
+static B8 th_snapshot_replace_file(const char* temp_path, const char* path) {
+#if OS_WINDOWS
+	return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(temp_path, path) == 0;
+#endif
+}
+
+// base = 0 for a keyframe
+static SnapshotFileHeader th_snapshot_header(const U8* payload, U64 size, const U8* base, U64 base_size, U64 encoded_size) {
+	SnapshotFileHeader header = { 0 };
+	header.magic = TH_SNAPSHOT_MAGIC;
+	header.version = TH_SNAPSHOT_VERSION;
+	header.kind = base ? SnapshotKind_delta : SnapshotKind_keyframe;
+	header.size = size;
+	header.hash = th_snapshot_hash(payload, size);
+	header.base_hash = base ? th_snapshot_hash(base, base_size) : 0;
+	header.encoded_size = encoded_size;
+	return header;
+}
+
+// header.encoded_size bytes from th_snapshot_delta_encode
+static B8 th_snapshot_write_encoded(const char* path, const SnapshotFileHeader* header, const U8* encoded, U64* out_file_size = 0) {
+	char temp_path[TH_SNAPSHOT_PATH_MAX];
+	B8 fits = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) < (int)sizeof(temp_path);
+	FILE* file = fits ? fopen(temp_path, "wb") : 0;
+	B8 ok = file != 0;
+	if (file) {
+		ok = fwrite(header, sizeof(*header), 1, file) == 1;
+		ok = ok && fwrite(encoded, 1, header->encoded_size, file) == header->encoded_size;
+		ok = (fclose(file) == 0) && ok;
+		ok = ok && th_snapshot_replace_file(temp_path, path);
+		if (!ok)
+			remove(temp_path);
+	}
+	if (out_file_size)
+		*out_file_size = ok ? sizeof(*header) + header->encoded_size : 0;
+	return ok;
+}
+
+// base = 0 writes a keyframe. Scratch comes out of arena and is given back
+static B8 th_snapshot_write_file(Arena* arena, const char* path, const U8* payload, U64 size, const U8* base, U64 base_size, U64* out_file_size = 0) {
+	TempArena temp = th_temp_begin(arena);
+	U64 encoded_size;
+	U8* encoded = th_snapshot_delta_encode(temp.arena, base, base ? base_size : 0, payload, size, &encoded_size);
+	SnapshotFileHeader header = th_snapshot_header(payload, size, base, base_size, encoded_size);
+	B8 ok = th_snapshot_write_encoded(path, &header, encoded, out_file_size);
+	th_temp_end(temp);
+	return ok;
+}
+
+static U8* th_snapshot_read_whole_file(Arena* arena, const char* path, U64* out_size) {
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	U8* data = 0;
+	if (size > 0) {
+		data = (U8*)th_arena_push(arena, size, 8);
+		if (fread(data, 1, size, file) != (size_t)size)
+			data = 0;
+	}
+	fclose(file);
+	*out_size = data ? (U64)size : 0;
+	return data;
+}
+
+// Decoded payload in arena, 0 if the file is missing, damaged or a delta against some other
+// base. Keyframes ignore base
+static U8* th_snapshot_read_file(Arena* arena, const char* path, const U8* base, U64 base_size, U64* out_size) {
+	TempArena temp = th_temp_begin(arena);
+	U64 file_size;
+	U8* file = th_snapshot_read_whole_file(arena, path, &file_size);
+	SnapshotReader reader = th_snapshot_reader(file, file ? file_size : 0);
+	SnapshotFileHeader header;
+	th_snapshot_read_struct(&reader, &header);
+	B8 ok = !reader.failed && header.magic == TH_SNAPSHOT_MAGIC && header.version == TH_SNAPSHOT_VERSION;
+	ok = ok && header.encoded_size == file_size - sizeof(header);
+	if (ok && header.kind == SnapshotKind_delta)
+		ok = base && th_snapshot_hash(base, base_size) == header.base_hash;
+	else if (ok)
+		ok = header.kind == SnapshotKind_keyframe && !header.base_hash;
+	if (!ok) {
+		th_temp_end(temp);
+		return 0;
+	}
+	if (header.kind == SnapshotKind_keyframe) {
+		base = 0;
+		base_size = 0;
+	}
+	// decoded right behind the file, then moved down over it so only the payload stays
+	U8* payload = th_snapshot_delta_decode(arena, base, base_size, file + sizeof(header), header.encoded_size, header.size);
+	if (!payload || th_snapshot_hash(payload, header.size) != header.hash) {
+		th_temp_end(temp);
+		return 0;
+	}
+	memmove(file, payload, header.size);
+	th_arena_pop_to(arena, (file - arena->base) + header.size);
+	*out_size = header.size;
+	return file;
+}
+
+// SAVER
+// One background thread and one save in flight. The main thread fills staging while the saver
+// is idle and submits it; the thread encodes it against the current keyframe and writes
+// path.delta, or every TH_SNAPSHOT_KEYFRAME_EVERY saves writes a new keyframe to path. A delta
+// that comes out no smaller than the keyframe encode would be gets written as a keyframe instead.
+// th_snapshot_load reads the pair back the same way.
+
+struct SnapshotSaver {
+	char path[TH_SNAPSHOT_PATH_MAX]; // keyframes
+	char delta_path[TH_SNAPSHOT_PATH_MAX];
+	Arena staging; // main thread fills it while idle, the saver thread reads it while busy
+	Arena keyframe; // the thread's copy of the last keyframe it wrote
+	Arena scratch;
+	U32 saves_since_keyframe; // saver thread only
+	B8 force_keyframe; // set with the submit
+	std::atomic<B32> busy;
+	std::atomic<B32> running;
+	std::atomic<U32> failed_count; // writes that didn't make it to disk
+	// the last save, readable once busy drops
+	U64 last_save_ns; // encode and write
+	U64 last_file_size;
+	B8 last_keyframe;
+	B8 has_thread;
+#if OS_WINDOWS
+	HANDLE work;
+	HANDLE thread;
+#elif OS_LINUX || OS_MAC
+	sem_t work;
+	pthread_t thread;
+#endif
+};
+
+static void th_snapshot_saver_save(SnapshotSaver* saver) {
+	TH_PROFILE_ZONE("snapshot save");
+	U64 start_ns = th_os_time_ns();
+	const U8* payload = saver->staging.base;
+	U64 size = saver->staging.pos;
+	TempArena temp = th_temp_begin(&saver->scratch);
+	U64 keyframe_size;
+	U8* keyframe_encoded = th_snapshot_delta_encode(temp.arena, 0, 0, payload, size, &keyframe_size);
+	B8 keyframe = saver->force_keyframe || !saver->keyframe.pos || saver->saves_since_keyframe + 1 >= TH_SNAPSHOT_KEYFRAME_EVERY;
+	U64 delta_size = 0;
+	U8* delta_encoded = 0;
+	if (!keyframe) {
+		delta_encoded = th_snapshot_delta_encode(temp.arena, saver->keyframe.base, saver->keyframe.pos, payload, size, &delta_size);
+		// once enough has moved since the keyframe, XOR against it stops leaving zeros and the
+		// delta is only a bigger keyframe. Start over from this save then
+		keyframe = delta_size >= keyframe_size;
+	}
+	B8 ok;
+	if (keyframe) {
+		SnapshotFileHeader header = th_snapshot_header(payload, size, 0, 0, keyframe_size);
+		ok = th_snapshot_write_encoded(saver->path, &header, keyframe_encoded, &saver->last_file_size);
+		if (ok) {
+			th_arena_clear(&saver->keyframe);
+			th_snapshot_write(&saver->keyframe, payload, size);
+			saver->saves_since_keyframe = 0;
+			remove(saver->delta_path); // was against the old keyframe
+		}
+	} else {
+		SnapshotFileHeader header = th_snapshot_header(payload, size, saver->keyframe.base, saver->keyframe.pos, delta_size);
+		ok = th_snapshot_write_encoded(saver->delta_path, &header, delta_encoded, &saver->last_file_size);
+		if (ok)
+			saver->saves_since_keyframe++;
+	}
+	th_temp_end(temp);
+	if (!ok)
+		saver->failed_count.fetch_add(1, std::memory_order_relaxed);
+	saver->last_keyframe = keyframe;
+	saver->last_save_ns = th_os_time_ns() - start_ns;
+}
+
+static void th_snapshot_saver_loop(SnapshotSaver* saver) {
+	th_profile_thread_name("snapshot saver");
+	for (;;) {
+#if OS_WINDOWS
+		WaitForSingleObject(saver->work, INFINITE);
+#elif OS_LINUX || OS_MAC
+		sem_wait(&saver->work);
+#endif
+		if (!saver->running.load(std::memory_order_acquire))
+			return;
+		th_snapshot_saver_save(saver);
+		saver->busy.store(0, std::memory_order_release);
+	}
+}
+
+#if OS_WINDOWS
+static unsigned __stdcall th_snapshot_saver_proc(void* param) {
+	th_snapshot_saver_loop((SnapshotSaver*)param);
+	return 0;
+}
+#elif OS_LINUX || OS_MAC
+static void* th_snapshot_saver_proc(void* param) {
+	th_snapshot_saver_loop((SnapshotSaver*)param);
+	return 0;
+}
+#endif
+
+// without thread support the save happens inside th_snapshot_saver_submit
+static void th_snapshot_saver_init(SnapshotSaver* saver, const char* path) {
+	memset((void*)saver, 0, sizeof(*saver));
+	snprintf(saver->path, sizeof(saver->path), "%s", path);
+	snprintf(saver->delta_path, sizeof(saver->delta_path), "%s.delta", path);
+	th_arena_init(&saver->staging, "snapshot staging");
+	th_arena_init(&saver->keyframe, "snapshot keyframe");
+	th_arena_init(&saver->scratch, "snapshot scratch");
+	saver->running.store(1);
+#if OS_WINDOWS
+	saver->work = CreateSemaphoreA(0, 0, 1, 0);
+	saver->thread = (HANDLE)_beginthreadex(0, 0, th_snapshot_saver_proc, saver, 0, 0);
+	saver->has_thread = 1;
+#elif OS_LINUX || OS_MAC
+	sem_init(&saver->work, 0, 0);
+	saver->has_thread = pthread_create(&saver->thread, 0, th_snapshot_saver_proc, saver) == 0;
+#endif
+}
+
+static B8 th_snapshot_saver_busy(const SnapshotSaver* saver) {
+	return saver->busy.load(std::memory_order_acquire);
+}
+
+// Empty staging arena to serialize into, 0 while the last save is still being written. Submit
+// when it's filled in, staging is off limits from then until the saver is idle again
+static Arena* th_snapshot_saver_begin(SnapshotSaver* saver) {
+	if (th_snapshot_saver_busy(saver))
+		return 0;
+	th_arena_clear(&saver->staging);
+	return &saver->staging;
+}
+
+static void th_snapshot_saver_submit(SnapshotSaver* saver, B8 keyframe = 0) {
+	Assert(!th_snapshot_saver_busy(saver)); // th_snapshot_saver_begin first
+	saver->force_keyframe = keyframe;
+	saver->busy.store(1, std::memory_order_release);
+	if (!saver->has_thread) {
+		th_snapshot_saver_save(saver);
+		saver->busy.store(0, std::memory_order_release);
+		return;
+	}
+#if OS_WINDOWS
+	ReleaseSemaphore(saver->work, 1, 0);
+#elif OS_LINUX || OS_MAC
+	sem_post(&saver->work);
+#endif
+}
+
+// blocks until the save in flight, if any, is on disk
+static void th_snapshot_saver_flush(SnapshotSaver* saver) {
+	while (th_snapshot_saver_busy(saver))
+		th_os_thread_yield();
+}
+
+static void th_snapshot_saver_shutdown(SnapshotSaver* saver) {
+	th_snapshot_saver_flush(saver);
+	saver->running.store(0, std::memory_order_release);
+	if (saver->has_thread) {
+#if OS_WINDOWS
+		ReleaseSemaphore(saver->work, 1, 0);
+		WaitForSingleObject(saver->thread, INFINITE);
+		CloseHandle(saver->thread);
+		CloseHandle(saver->work);
+#elif OS_LINUX || OS_MAC
+		sem_post(&saver->work);
+		pthread_join(saver->thread, 0);
+		sem_destroy(&saver->work);
+#endif
+	}
+	th_arena_release(&saver->staging);
+	th_arena_release(&saver->keyframe);
+	th_arena_release(&saver->scratch);
+	saver->has_thread = 0;
+}
+
+// newest payload a saver left at path: the delta if it still matches the keyframe, otherwise
+// the keyframe. 0 if there's nothing usable
+static U8* th_snapshot_load(Arena* arena, const char* path, U64* out_size) {
+	U64 keyframe_size;
+	U8* keyframe = th_snapshot_read_file(arena, path, 0, 0, &keyframe_size);
+	if (!keyframe)
+		return 0;
+	char delta_path[TH_SNAPSHOT_PATH_MAX];
+	snprintf(delta_path, sizeof(delta_path), "%s.delta", path);
+	U64 delta_size;
+	U8* delta = th_snapshot_read_file(arena, delta_path, keyframe, keyframe_size, &delta_size);
+	if (!delta) {
+		*out_size = keyframe_size;
+		return keyframe;
+	}
+	*out_size = delta_size;
+	return delta;
+}
+
+#endif
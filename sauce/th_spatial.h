@@ -0,0 +1,166 @@
+#ifndef TH_SPATIAL_H
+#define TH_SPATIAL_H
+
+// Broadphase spatial hash. Rebuilt from scratch each sim step: insert every item's bounds,
+// finish, then run as many region queries as you like until the next rebuild.
+// Cells are a uniform grid hashed into a power of two table, so the world has no fixed size.
+// Building is a counting sort, each cell's entries end up packed next to each other.
+
+#define TH_SPATIAL_MIN_TABLE 64
+#define TH_SPATIAL_MAX_CELLS_PER_ITEM 64 // anything bigger than this many cells is treated as huge
+
+struct SpatialHash {
+	F32 cell_size;
+	F32 inv_cell_size;
+	U32 capacity;
+	U32 item_count;
+	U32* item_ids;
+	Rng2F32* item_bounds;
+	U32* item_marks; // query stamp, stops items that span cells being reported twice
+	U32 query_stamp;
+	U32 table_mask;
+	U32* cell_start; // table_mask + 2 entries, cell h lives in entries[cell_start[h], cell_start[h + 1])
+	U32* entries; // item indices
+	U32 entry_count;
+	// items that cover too many cells to insert, every query tests them directly
+	U32* huge_items;
+	U32 huge_count;
+};
+
+static U32 th_spatial_hash_cell(S32 x, S32 y) {
+	return ((U32)x * 73856093u) ^ ((U32)y * 19349663u);
+}
+
+static S32 th_spatial_cell_coord(const SpatialHash* hash, F32 value) {
+	return (S32)floorf(value * hash->inv_cell_size);
+}
+
+static B8 th_spatial_cell_range(const SpatialHash* hash, Rng2F32 bounds, S32* min_x, S32* min_y, S32* max_x, S32* max_y) {
+	*min_x = th_spatial_cell_coord(hash, bounds.min.x);
+	*min_y = th_spatial_cell_coord(hash, bounds.min.y);
+	*max_x = th_spatial_cell_coord(hash, bounds.max.x);
+	*max_y = th_spatial_cell_coord(hash, bounds.max.y);
+	S64 cells = (S64)(*max_x - *min_x + 1) * (S64)(*max_y - *min_y + 1);
+	return cells <= TH_SPATIAL_MAX_CELLS_PER_ITEM;
+}
+
+// all memory comes from arena and is only valid until the arena is reset
+static void th_spatial_begin(SpatialHash* hash, Arena* arena, F32 cell_size, U32 capacity) {
+	Assert(cell_size > 0.f);
+	MemoryZeroStruct(hash);
+	hash->cell_size = cell_size;
+	hash->inv_cell_size = 1.f / cell_size;
+	hash->capacity = capacity;
+	hash->item_ids = ArenaPushArray(arena, U32, capacity);
+	hash->item_bounds = ArenaPushArray(arena, Rng2F32, capacity);
+	hash->item_marks = ArenaPushArrayZero(arena, U32, capacity);
+
+	U32 table_size = TH_SPATIAL_MIN_TABLE;
+	while (table_size < capacity * 2)
+		table_size <<= 1;
+	hash->table_mask = table_size - 1;
+	hash->cell_start = ArenaPushArrayZero(arena, U32, table_size + 1);
+	hash->huge_items = ArenaPushArray(arena, U32, capacity);
+}
+
+static void th_spatial_insert(SpatialHash* hash, U32 id, Rng2F32 bounds) {
+	Assert(hash->item_count < hash->capacity);
+	U32 item = hash->item_count++;
+	hash->item_ids[item] = id;
+	hash->item_bounds[item] = bounds;
+
+	S32 min_x, min_y, max_x, max_y;
+	if (!th_spatial_cell_range(hash, bounds, &min_x, &min_y, &max_x, &max_y)) {
+		hash->huge_items[hash->huge_count++] = item;
+		return;
+	}
+	// count pass, cell_start[h + 1] holds the count of cell h until th_spatial_finish
+	for (S32 y = min_y; y <= max_y; y++) {
+		for (S32 x = min_x; x <= max_x; x++) {
+			hash->cell_start[(th_spatial_hash_cell(x, y) & hash->table_mask) + 1]++;
+			hash->entry_count++;
+		}
+	}
+}
+
+static void th_spatial_finish(SpatialHash* hash, Arena* arena) {
+	U32 table_size = hash->table_mask + 1;
+	for (U32 i = 0; i < table_size; i++)
+		hash->cell_start[i + 1] += hash->cell_start[i];
+
+	// fill pass, each cell's cursor starts at its end and walks back to its start
+	hash->entries = ArenaPushArray(arena, U32, hash->entry_count);
+	U32* cursor = ArenaPushArray(arena, U32, table_size);
+	memcpy(cursor, hash->cell_start + 1, sizeof(U32) * table_size);
+	for (U32 item = 0; item < hash->item_count; item++) {
+		S32 min_x, min_y, max_x, max_y;
+		if (!th_spatial_cell_range(hash, hash->item_bounds[item], &min_x, &min_y, &max_x, &max_y))
+			continue;
+		for (S32 y = min_y; y <= max_y; y++) {
+			for (S32 x = min_x; x <= max_x; x++) {
+				U32 h = th_spatial_hash_cell(x, y) & hash->table_mask;
+				hash->entries[--cursor[h]] = item;
+			}
+		}
+	}
+}
+
+static B8 th_spatial_overlap(Rng2F32 a, Rng2F32 b) {
+	return a.min.x < b.max.x && b.min.x < a.max.x && a.min.y < b.max.y && b.min.y < a.max.y;
+}
+
+// Pushes the id of every item overlapping region onto arena as one packed U32 array. Don't
+// push anything else to the arena while a query is running.
+static U32* th_spatial_query(SpatialHash* hash, Rng2F32 region, Arena* arena, U32* out_count) {
+	U32* result = (U32*)th_arena_push(arena, 0, alignof(U32));
+	U32 count = 0;
+	*out_count = 0;
+	if (!hash->cell_start)
+		return result; // never built
+	U32 stamp = ++hash->query_stamp;
+
+	for (U32 i = 0; i < hash->huge_count; i++) {
+		U32 item = hash->huge_items[i];
+		if (th_spatial_overlap(hash->item_bounds[item], region)) {
+			*(U32*)th_arena_push(arena, sizeof(U32), alignof(U32)) = hash->item_ids[item];
+			count++;
+		}
+	}
+
+	S32 min_x, min_y, max_x, max_y;
+	if (!th_spatial_cell_range(hash, region, &min_x, &min_y, &max_x, &max_y)) {
+		// bigger than the grid is useful for, testing everything is cheaper than walking cells
+		for (U32 item = 0; item < hash->item_count; item++) {
+			if (hash->item_marks[item] == stamp)
+				continue;
+			hash->item_marks[item] = stamp;
+			Rng2F32 bounds = hash->item_bounds[item];
+			if (th_spatial_cell_range(hash, bounds, &min_x, &min_y, &max_x, &max_y) && th_spatial_overlap(bounds, region)) {
+				*(U32*)th_arena_push(arena, sizeof(U32), alignof(U32)) = hash->item_ids[item];
+				count++;
+			}
+		}
+		*out_count = count;
+		return result;
+	}
+
+	for (S32 y = min_y; y <= max_y; y++) {
+		for (S32 x = min_x; x <= max_x; x++) {
+			U32 h = th_spatial_hash_cell(x, y) & hash->table_mask;
+			for (U32 e = hash->cell_start[h]; e < hash->cell_start[h + 1]; e++) {
+				U32 item = hash->entries[e];
+				if (hash->item_marks[item] == stamp)
+					continue;
+				hash->item_marks[item] = stamp;
+				if (th_spatial_overlap(hash->item_bounds[item], region)) {
+					*(U32*)th_arena_push(arena, sizeof(U32), alignof(U32)) = hash->item_ids[item];
+					count++;
+				}
+			}
+		}
+	}
+	*out_count = count;
+	return result;
+}
+
+#endif
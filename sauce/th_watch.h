@@ -0,0 +1,147 @@
+#ifndef TH_WATCH_H
+#define TH_WATCH_H
+
+// File change notification for hot reload. Register files, then poll once a frame for the ones
+// that were rewritten since. inotify on Linux, elsewhere the files' write times get compared
+// every TH_WATCH_POLL_MS. Polling never blocks.
+
+#if OS_LINUX
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif OS_WINDOWS || OS_MAC
+#include <sys/stat.h>
+#endif
+
+#define TH_WATCH_MAX_FILES 256
+#define TH_WATCH_POLL_MS 250
+
+struct WatchedFile {
+	const char* path; // has to outlive the watch, interned names do
+	U64 write_time;
+#if OS_LINUX
+	int wd; // directory watch
+	const char* file_name; // points into path, what inotify reports
+#endif
+};
+
+struct FileWatch {
+	WatchedFile files[TH_WATCH_MAX_FILES];
+	U32 file_count;
+	U64 next_poll_ns;
+#if OS_LINUX
+	int fd;
+#endif
+};
+
+static U64 th_os_file_write_time(const char* path) {
+#if OS_WINDOWS
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0)
+		return 0;
+	return (U64)st.st_mtime;
+#elif OS_LINUX || OS_MAC
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return 0;
+	#if OS_MAC
+	return (U64)st.st_mtimespec.tv_sec * 1000000000ull + st.st_mtimespec.tv_nsec;
+	#else
+	return (U64)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	#endif
+#else
+	return 0;
+#endif
+}
+
+static void th_watch_init(FileWatch* watch) {
+	memset((void*)watch, 0, sizeof(*watch));
+#if OS_LINUX
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+// returns the index th_watch_poll reports the file with
+static U32 th_watch_add(FileWatch* watch, const char* path) {
+	for (U32 i = 0; i < watch->file_count; i++) {
+		if (strcmp(watch->files[i].path, path) == 0)
+			return i;
+	}
+	U32 index = watch->file_count;
+	WatchedFile* file = TH_ARRAY_PUSH(watch->files, watch->file_count);
+	file->path = path;
+	file->write_time = th_os_file_write_time(path);
+#if OS_LINUX
+	// watch the directory, not the file: editors that save by renaming replace the inode
+	const char* slash = strrchr(path, '/');
+	file->file_name = slash ? slash + 1 : path;
+	char dir[512] = ".";
+	if (slash) {
+		U64 length = ClampTop((U64)(slash - path), sizeof(dir) - 1);
+		memcpy(dir, path, length);
+		dir[length] = 0;
+	}
+	file->wd = watch->fd >= 0 ? inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+#endif
+	return index;
+}
+
+static void th_watch_mark(U32* changed, U32* count, U32 max, U32 index) {
+	for (U32 i = 0; i < *count; i++) {
+		if (changed[i] == index)
+			return;
+	}
+	if (*count < max)
+		changed[(*count)++] = index;
+}
+
+// writes the indices of files that changed since the last poll, each at most once
+static U32 th_watch_poll(FileWatch* watch, U32* changed, U32 max) {
+	U32 count = 0;
+#if OS_LINUX
+	if (watch->fd >= 0) {
+		alignas(struct inotify_event) char buffer[4096];
+		for (;;) {
+			ssize_t size = read(watch->fd, buffer, sizeof(buffer));
+			if (size <= 0)
+				break;
+			for (char* cursor = buffer; cursor < buffer + size;) {
+				struct inotify_event* event = (struct inotify_event*)cursor;
+				cursor += sizeof(struct inotify_event) + event->len;
+				if (!event->len)
+					continue;
+				for (U32 i = 0; i < watch->file_count; i++) {
+					WatchedFile* file = &watch->files[i];
+					if (file->wd == event->wd && strcmp(file->file_name, event->name) == 0)
+						th_watch_mark(changed, &count, max, i);
+				}
+			}
+		}
+		return count;
+	}
+#endif
+	U64 now = th_os_time_ns();
+	if (now < watch->next_poll_ns)
+		return 0;
+	watch->next_poll_ns = now + TH_WATCH_POLL_MS * 1000000ull;
+	for (U32 i = 0; i < watch->file_count; i++) {
+		WatchedFile* file = &watch->files[i];
+		U64 write_time = th_os_file_write_time(file->path);
+		if (write_time && write_time != file->write_time) {
+			file->write_time = write_time;
+			th_watch_mark(changed, &count, max, i);
+		}
+	}
+	return count;
+}
+
+static void th_watch_shutdown(FileWatch* watch) {
+#if OS_LINUX
+	if (watch->fd >= 0)
+		close(watch->fd);
+	watch->fd = -1;
+#endif
+	watch->file_count = 0;
+}
+
+#endif
@@ -382,7 +382,7 @@ struct Rng2F32
  Rng2F32(float _x0 = 0.0f, float _y0 = 0.0f, float _x1 = 0.0f, float _y1 = 0.0f)
   : x0(_x0), y0(_y0), x1(_x1), y1(_y1) {};
  Rng2F32(Vec2F32 _min, Vec2F32 _max)
-  : min(min), max(_max) {};
+  : min(_min), max(_max) {};
  union
  {
   struct
@@ -1,7 +1,7 @@
 #ifndef TELESCOPE_LIGHT_H
 #define TELESCOPE_LIGHT_H
 
-// NOTE - memory arenas are disabled for now until I do my own portable implementation
+// NOTE - telescope's memory arenas stay disabled, the portable implementation lives in th_memory.h
 
 #include "third_party/telescope/base/base_ctx_crack.h"
 #include "third_party/telescope/base/base_types.h"
@@ -5,5 +5,18 @@
 #include "th_telescope.h"
 #include "th_dump.h"
 #include "th_memory.h"
+#include "th_random.h"
+#include "th_assets.h"
+#include "th_pack.h"
+#include "th_particles.h"
+#include "th_spatial.h"
+#include "th_camera.h"
+#include "th_profile.h"
+#include "th_jobs.h"
+#include "th_loader.h"
+#include "th_watch.h"
+#include "th_coro.h"
+#include "th_snapshot.h"
+#include "th_replay.h"
 
 #endif